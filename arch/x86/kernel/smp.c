@@ -261,20 +261,26 @@ void smp_reschedule_interrupt(struct pt_regs *regs)
 
 void smp_call_function_interrupt(struct pt_regs *regs)
 {
+	struct pt_regs *old_regs = set_irq_regs(regs);
+
 	ack_APIC_irq();
 	irq_enter();
 	generic_smp_call_function_interrupt();
 	inc_irq_stat(irq_call_count);
 	irq_exit();
+	set_irq_regs(old_regs);
 }
 
 void smp_call_function_single_interrupt(struct pt_regs *regs)
 {
+	struct pt_regs *old_regs = set_irq_regs(regs);
+
 	ack_APIC_irq();
 	irq_enter();
 	generic_smp_call_function_single_interrupt();
 	inc_irq_stat(irq_call_count);
 	irq_exit();
+	set_irq_regs(old_regs);
 }
 
 static int __init nonmi_ipi_setup(char *str)
@@ -31,6 +31,13 @@ EXPORT_SYMBOL_GPL(blkcg_root);
 
 static struct blkcg_policy *blkcg_policy[BLKCG_MAX_POLS];
 
+/* list and work item to allocate percpu latency histograms */
+static DEFINE_SPINLOCK(blkg_lat_alloc_lock);
+static LIST_HEAD(blkg_lat_alloc_list);
+
+static void blkg_lat_alloc_fn(struct work_struct *);
+static DECLARE_DELAYED_WORK(blkg_lat_alloc_work, blkg_lat_alloc_fn);
+
 static bool blkcg_policy_enabled(struct request_queue *q,
 				 const struct blkcg_policy *pol)
 {
@@ -45,11 +52,18 @@ static bool blkcg_policy_enabled(struct request_queue *q,
  */
 static void blkg_free(struct blkcg_gq *blkg)
 {
+	unsigned long flags;
 	int i;
 
 	if (!blkg)
 		return;
 
+	spin_lock_irqsave(&blkg_lat_alloc_lock, flags);
+	list_del_init(&blkg->lat_alloc_node);
+	spin_unlock_irqrestore(&blkg_lat_alloc_lock, flags);
+
+	free_percpu(blkg->lat_hist);
+
 	for (i = 0; i < BLKCG_MAX_POLS; i++) {
 		struct blkcg_policy *pol = blkcg_policy[i];
 		struct blkg_policy_data *pd = blkg->pd[i];
@@ -67,6 +81,44 @@ static void blkg_free(struct blkcg_gq *blkg)
 	kfree(blkg);
 }
 
+/*
+ * Worker for allocating per cpu latency histograms of blkgs.  This is
+ * scheduled on the system_nrt_wq once there are some blkgs on the
+ * alloc_list waiting for allocation.
+ */
+static void blkg_lat_alloc_fn(struct work_struct *work)
+{
+	static struct blkg_lat_hist *lat_hist;	/* this fn is non-reentrant */
+	struct delayed_work *dwork = to_delayed_work(work);
+	bool empty = false;
+
+alloc_hist:
+	if (!lat_hist) {
+		lat_hist = alloc_percpu(struct blkg_lat_hist);
+		if (!lat_hist) {
+			/* allocation failed, try again after some time */
+			queue_delayed_work(system_nrt_wq, dwork,
+					   msecs_to_jiffies(10));
+			return;
+		}
+	}
+
+	spin_lock_irq(&blkg_lat_alloc_lock);
+
+	if (!list_empty(&blkg_lat_alloc_list)) {
+		struct blkcg_gq *blkg = list_first_entry(&blkg_lat_alloc_list,
+							 struct blkcg_gq,
+							 lat_alloc_node);
+		swap(blkg->lat_hist, lat_hist);
+		list_del_init(&blkg->lat_alloc_node);
+	}
+
+	empty = list_empty(&blkg_lat_alloc_list);
+	spin_unlock_irq(&blkg_lat_alloc_lock);
+	if (!empty)
+		goto alloc_hist;
+}
+
 /**
  * blkg_alloc - allocate a blkg
  * @blkcg: block cgroup the new blkg is associated with
@@ -79,6 +131,7 @@ static struct blkcg_gq *blkg_alloc(struct blkcg *blkcg, struct request_queue *q,
 				   gfp_t gfp_mask)
 {
 	struct blkcg_gq *blkg;
+	unsigned long flags;
 	int i;
 
 	/* alloc and init base part */
@@ -88,6 +141,7 @@ static struct blkcg_gq *blkg_alloc(struct blkcg *blkcg, struct request_queue *q,
 
 	blkg->q = q;
 	INIT_LIST_HEAD(&blkg->q_node);
+	INIT_LIST_HEAD(&blkg->lat_alloc_node);
 	blkg->blkcg = blkcg;
 	blkg->refcnt = 1;
 
@@ -118,6 +172,16 @@ static struct blkcg_gq *blkg_alloc(struct blkcg *blkcg, struct request_queue *q,
 			pol->pd_init_fn(blkg);
 	}
 
+	/*
+	 * The percpu allocator can't be called from IO path.  Queue blkg
+	 * on blkg_lat_alloc_list and allocate the histogram from work item.
+	 * Completions until then simply aren't recorded.
+	 */
+	spin_lock_irqsave(&blkg_lat_alloc_lock, flags);
+	list_add(&blkg->lat_alloc_node, &blkg_lat_alloc_list);
+	queue_delayed_work(system_nrt_wq, &blkg_lat_alloc_work, 0);
+	spin_unlock_irqrestore(&blkg_lat_alloc_lock, flags);
+
 	return blkg;
 
 err_free:
@@ -373,6 +437,14 @@ static int blkcg_reset_stats(struct cgroup *cgroup, struct cftype *cftype,
 			    pol->pd_reset_stats_fn)
 				pol->pd_reset_stats_fn(blkg);
 		}
+
+		if (blkg->lat_hist) {
+			int cpu;
+
+			for_each_possible_cpu(cpu)
+				memset(per_cpu_ptr(blkg->lat_hist, cpu), 0,
+				       sizeof(struct blkg_lat_hist));
+		}
 	}
 
 	spin_unlock_irq(&blkcg->lock);
@@ -588,11 +660,96 @@ void blkg_conf_finish(struct blkg_conf_ctx *ctx)
 }
 EXPORT_SYMBOL_GPL(blkg_conf_finish);
 
+/**
+ * blkg_account_io_latency - record the latency of a completed request
+ * @rq: request being completed
+ *
+ * Add the time @rq took from allocation to completion to the latency
+ * histogram of the blkg it was allocated for.  Called with queue_lock held
+ * from blk_finish_request().
+ */
+void blkg_account_io_latency(struct request *rq)
+{
+	struct request_list *rl = blk_rq_rl(rq);
+	struct blkg_lat_hist *hist;
+	u64 now = sched_clock();
+	u64 usecs = 0;
+	int bucket;
+
+	if (!(rq->cmd_flags & REQ_ALLOCED) || rq->cmd_type != REQ_TYPE_FS ||
+	    !rl || !rl->blkg || !rl->blkg->lat_hist)
+		return;
+
+	if (time_after64(now, rq_start_time_ns(rq)))
+		usecs = div_u64(now - rq_start_time_ns(rq), NSEC_PER_USEC);
+	bucket = min_t(int, fls64(usecs), BLKG_LAT_NR_BUCKETS - 1);
+
+	hist = this_cpu_ptr(rl->blkg->lat_hist);
+	if (rq->cmd_flags & REQ_WRITE)
+		hist->cnt[BLKG_RWSTAT_WRITE][bucket]++;
+	else
+		hist->cnt[BLKG_RWSTAT_READ][bucket]++;
+	if (rq->cmd_flags & REQ_SYNC)
+		hist->cnt[BLKG_RWSTAT_SYNC][bucket]++;
+	else
+		hist->cnt[BLKG_RWSTAT_ASYNC][bucket]++;
+}
+
+static void blkg_print_lat_hist(struct seq_file *sf, struct blkcg_gq *blkg)
+{
+	static const char *rwstr[] = {
+		[BLKG_RWSTAT_READ]	= "Read",
+		[BLKG_RWSTAT_WRITE]	= "Write",
+		[BLKG_RWSTAT_SYNC]	= "Sync",
+		[BLKG_RWSTAT_ASYNC]	= "Async",
+	};
+	const char *dname = blkg_dev_name(blkg);
+	struct blkg_lat_hist sum;
+	int cpu, i, j;
+
+	if (!dname || !blkg->lat_hist)
+		return;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		struct blkg_lat_hist *hist = per_cpu_ptr(blkg->lat_hist, cpu);
+
+		for (i = 0; i < BLKG_RWSTAT_NR; i++)
+			for (j = 0; j < BLKG_LAT_NR_BUCKETS; j++)
+				sum.cnt[i][j] += hist->cnt[i][j];
+	}
+
+	for (i = 0; i < BLKG_RWSTAT_NR; i++) {
+		seq_printf(sf, "%s %s", dname, rwstr[i]);
+		for (j = 0; j < BLKG_LAT_NR_BUCKETS; j++)
+			seq_printf(sf, " %lu", sum.cnt[i][j]);
+		seq_putc(sf, '\n');
+	}
+}
+
+static int blkcg_print_lat_hist(struct cgroup *cgrp, struct cftype *cft,
+				struct seq_file *sf)
+{
+	struct blkcg *blkcg = cgroup_to_blkcg(cgrp);
+	struct blkcg_gq *blkg;
+	struct hlist_node *n;
+
+	spin_lock_irq(&blkcg->lock);
+	hlist_for_each_entry(blkg, n, &blkcg->blkg_list, blkcg_node)
+		blkg_print_lat_hist(sf, blkg);
+	spin_unlock_irq(&blkcg->lock);
+	return 0;
+}
+
 struct cftype blkcg_files[] = {
 	{
 		.name = "reset_stats",
 		.write_u64 = blkcg_reset_stats,
 	},
+	{
+		.name = "io_latency_hist",
+		.read_seq_string = blkcg_print_lat_hist,
+	},
 	{ }	/* terminate */
 };
 
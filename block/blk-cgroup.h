@@ -39,6 +39,13 @@ enum blkg_rwstat_type {
 	BLKG_RWSTAT_TOTAL = BLKG_RWSTAT_NR,
 };
 
+/*
+ * Request latency histogram buckets.  Bucket 0 counts requests completed
+ * in less than 1us, bucket i > 0 those taking [2^(i-1), 2^i) us.  The last
+ * bucket is open-ended.
+ */
+#define BLKG_LAT_NR_BUCKETS	25
+
 struct blkcg_gq;
 
 struct blkcg {
@@ -66,6 +73,10 @@ struct blkg_rwstat {
 	uint64_t			cnt[BLKG_RWSTAT_NR];
 };
 
+struct blkg_lat_hist {
+	unsigned long			cnt[BLKG_RWSTAT_NR][BLKG_LAT_NR_BUCKETS];
+};
+
 /*
  * A blkcg_gq (blkg) is association between a block cgroup (blkcg) and a
  * request_queue (q).  This is used by blkcg policies which need to track
@@ -101,6 +112,10 @@ struct blkcg_gq {
 
 	struct blkg_policy_data		*pd[BLKCG_MAX_POLS];
 
+	/* per cpu request latency histogram, allocated asynchronously */
+	struct blkg_lat_hist __percpu	*lat_hist;
+	struct list_head		lat_alloc_node;
+
 	struct rcu_head			rcu_head;
 };
 
@@ -129,6 +144,7 @@ struct blkcg_gq *blkg_lookup_create(struct blkcg *blkcg,
 int blkcg_init_queue(struct request_queue *q);
 void blkcg_drain_queue(struct request_queue *q);
 void blkcg_exit_queue(struct request_queue *q);
+void blkg_account_io_latency(struct request *rq);
 
 /* Blkio controller policy registration */
 int blkcg_policy_register(struct blkcg_policy *pol);
@@ -475,6 +491,7 @@ static inline struct blkcg_gq *blkg_lookup(struct blkcg *blkcg, void *key) { ret
 static inline int blkcg_init_queue(struct request_queue *q) { return 0; }
 static inline void blkcg_drain_queue(struct request_queue *q) { }
 static inline void blkcg_exit_queue(struct request_queue *q) { }
+static inline void blkg_account_io_latency(struct request *rq) { }
 static inline int blkcg_policy_register(struct blkcg_policy *pol) { return 0; }
 static inline void blkcg_policy_unregister(struct blkcg_policy *pol) { }
 static inline int blkcg_activate_policy(struct request_queue *q,
@@ -228,6 +228,53 @@ void blk_delay_queue(struct request_queue *q, unsigned long msecs)
 }
 EXPORT_SYMBOL(blk_delay_queue);
 
+static enum hrtimer_restart blk_hold_timer_fn(struct hrtimer *timer)
+{
+	struct request_queue *q =
+		container_of(timer, struct request_queue, hold_timer);
+
+	blk_run_queue_async(q);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * The hold window scales with the device queue depth, up to hold_usecs at
+ * BLK_HOLD_DEPTH requests in flight.
+ */
+#define BLK_HOLD_DEPTH	4
+
+/*
+ * blk_queue_hold - postpone dispatch of newly added requests
+ * @q:	the queue requests were added to
+ * @nr:	number of requests added
+ *
+ * Plugging only coalesces I/O from a single task.  When several tasks
+ * write small adjacent chunks, each of them ends up as its own request
+ * unless dispatch waits a little.  Holding is only worth it while the
+ * device is busy anyway, so nothing is held back from an idle device.
+ * Returns true if dispatch was postponed, in which case the hold timer
+ * will run the queue.  Queue lock must be held.
+ */
+static bool blk_queue_hold(struct request_queue *q, unsigned int nr)
+{
+	unsigned int depth = queue_in_flight(q);
+	unsigned int usecs;
+
+	if (!q->hold_usecs || !depth)
+		return false;
+
+	q->hold_stat.held += nr;
+	if (!hrtimer_active(&q->hold_timer)) {
+		usecs = q->hold_usecs * min_t(unsigned int, depth,
+					      BLK_HOLD_DEPTH) / BLK_HOLD_DEPTH;
+		q->hold_stat.windows++;
+		hrtimer_start(&q->hold_timer,
+			      ns_to_ktime((u64)usecs * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+	}
+	return true;
+}
+
 /**
  * blk_start_queue - restart a previously stopped queue
  * @q:    The &struct request_queue in question
@@ -288,6 +335,7 @@ EXPORT_SYMBOL(blk_stop_queue);
 void blk_sync_queue(struct request_queue *q)
 {
 	del_timer_sync(&q->timeout);
+	hrtimer_cancel(&q->hold_timer);
 	cancel_delayed_work_sync(&q->delay_work);
 }
 EXPORT_SYMBOL(blk_sync_queue);
@@ -569,6 +617,10 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	if (q->id < 0)
 		goto fail_q;
 
+	q->poll_stat = alloc_percpu(struct blk_poll_stat);
+	if (!q->poll_stat)
+		goto fail_id;
+
 	q->backing_dev_info.ra_pages =
 			(VM_MAX_READAHEAD * 1024) / PAGE_CACHE_SIZE;
 	q->backing_dev_info.state = 0;
@@ -578,7 +630,7 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 
 	err = bdi_init(&q->backing_dev_info);
 	if (err)
-		goto fail_id;
+		goto fail_stat;
 
 	setup_timer(&q->backing_dev_info.laptop_mode_wb_timer,
 		    laptop_mode_timer_fn, (unsigned long) q);
@@ -593,6 +645,8 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	INIT_LIST_HEAD(&q->flush_queue[1]);
 	INIT_LIST_HEAD(&q->flush_data_in_flight);
 	INIT_DELAYED_WORK(&q->delay_work, blk_delay_work);
+	hrtimer_init(&q->hold_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	q->hold_timer.function = blk_hold_timer_fn;
 
 	kobject_init(&q->kobj, &blk_queue_ktype);
 
@@ -615,10 +669,12 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	__set_bit(QUEUE_FLAG_BYPASS, &q->queue_flags);
 
 	if (blkcg_init_queue(q))
-		goto fail_id;
+		goto fail_stat;
 
 	return q;
 
+fail_stat:
+	free_percpu(q->poll_stat);
 fail_id:
 	ida_simple_remove(&blk_queue_ida, q->id);
 fail_q:
@@ -1459,6 +1515,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	if (el_ret == ELEVATOR_BACK_MERGE) {
 		if (bio_attempt_back_merge(q, req, bio)) {
 			elv_bio_merged(q, req, bio);
+			blk_hold_account_merge(q);
 			if (!attempt_back_merge(q, req))
 				elv_merged_request(q, req, el_ret);
 			goto out_unlock;
@@ -1466,6 +1523,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	} else if (el_ret == ELEVATOR_FRONT_MERGE) {
 		if (bio_attempt_front_merge(q, req, bio)) {
 			elv_bio_merged(q, req, bio);
+			blk_hold_account_merge(q);
 			if (!attempt_front_merge(q, req))
 				elv_merged_request(q, req, el_ret);
 			goto out_unlock;
@@ -1531,7 +1589,8 @@ get_rq:
 	} else {
 		spin_lock_irq(q->queue_lock);
 		add_acct_request(q, req, where);
-		__blk_run_queue(q);
+		if (where == ELEVATOR_INSERT_FLUSH || !blk_queue_hold(q, 1))
+			__blk_run_queue(q);
 out_unlock:
 		spin_unlock_irq(q->queue_lock);
 	}
@@ -1699,10 +1758,15 @@ generic_make_request_checks(struct bio *bio)
 		}
 	}
 
-	if ((bio->bi_rw & REQ_DISCARD) &&
-	    (!blk_queue_discard(q) ||
-	     ((bio->bi_rw & REQ_SECURE) &&
-	      !blk_queue_secdiscard(q)))) {
+	if (bio->bi_rw & REQ_WRITE_ZEROES) {
+		if (!q->limits.max_write_zeroes_sectors) {
+			err = -EOPNOTSUPP;
+			goto end_io;
+		}
+	} else if ((bio->bi_rw & REQ_DISCARD) &&
+		   (!blk_queue_discard(q) ||
+		    ((bio->bi_rw & REQ_SECURE) &&
+		     !blk_queue_secdiscard(q)))) {
 		err = -EOPNOTSUPP;
 		goto end_io;
 	}
@@ -2425,6 +2489,7 @@ static void blk_finish_request(struct request *req, int error)
 
 
 	blk_account_io_done(req);
+	blkg_account_io_latency(req);
 
 	if (req->end_io)
 		req->end_io(req, error);
@@ -2716,6 +2781,58 @@ int blk_lld_busy(struct request_queue *q)
 }
 EXPORT_SYMBOL_GPL(blk_lld_busy);
 
+/**
+ * blk_poll - poll the driver for completed I/O
+ * @q : the queue the caller is waiting on
+ *
+ * Description:
+ *    Synchronous waiters on queues with QUEUE_FLAG_POLL set may spin on
+ *    their own completion instead of sleeping until the interrupt arrives.
+ *    Each call asks the driver, through the function registered with
+ *    blk_queue_poll_fn(), to reap whatever completions are pending on the
+ *    hardware queue of the calling CPU.  Completions are run from the
+ *    caller's context.
+ *
+ * Return:
+ *    true if at least one completion was reaped, false otherwise.
+ */
+bool blk_poll(struct request_queue *q)
+{
+	struct blk_poll_stat *stat;
+	int found;
+
+	if (!q->poll_fn || !blk_queue_poll(q))
+		return false;
+
+	found = q->poll_fn(q);
+
+	stat = get_cpu_ptr(q->poll_stat);
+	stat->invoked++;
+	if (found > 0)
+		stat->success++;
+	put_cpu_ptr(q->poll_stat);
+
+	return found > 0;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
+/**
+ * blk_poll_account - account the completion of I/O a poller waited on
+ * @q : the queue the I/O was issued to
+ * @polled : whether the completion was reaped by the polling task
+ */
+void blk_poll_account(struct request_queue *q, bool polled)
+{
+	struct blk_poll_stat *stat = get_cpu_ptr(q->poll_stat);
+
+	if (polled)
+		stat->polled++;
+	else
+		stat->interrupt++;
+	put_cpu_ptr(q->poll_stat);
+}
+EXPORT_SYMBOL_GPL(blk_poll_account);
+
 /**
  * blk_rq_unprep_clone - Helper function to free all bios in a cloned request
  * @rq: the clone request to be cleaned up
@@ -2896,6 +3013,11 @@ static void queue_unplugged(struct request_queue *q, unsigned int depth,
 		return;
 	}
 
+	if (blk_queue_hold(q, depth)) {
+		spin_unlock(q->queue_lock);
+		return;
+	}
+
 	/*
 	 * If we are punting this to kblockd, then we can safely drop
 	 * the queue_lock before waking kblockd (which needs to take
@@ -9,45 +9,53 @@
 
 #include "blk.h"
 
-struct bio_batch {
-	atomic_t		done;
-	unsigned long		flags;
-	struct completion	*wait;
-};
-
 static void bio_batch_end_io(struct bio *bio, int err)
 {
 	struct bio_batch *bb = bio->bi_private;
 
-	if (err && (err != -EOPNOTSUPP))
+	/*
+	 * An unsupported discard is only a lost hint, but a write zeroes
+	 * that didn't happen leaves stale data behind.
+	 */
+	if (err && (err != -EOPNOTSUPP || (bio->bi_rw & REQ_WRITE_ZEROES)))
 		clear_bit(BIO_UPTODATE, &bb->flags);
 	if (atomic_dec_and_test(&bb->done))
 		complete(bb->wait);
 	bio_put(bio);
 }
 
-/**
- * blkdev_issue_discard - queue a discard
- * @bdev:	blockdev to issue discard for
- * @sector:	start sector
- * @nr_sects:	number of sectors to discard
- * @gfp_mask:	memory allocation flags (for bio_alloc)
- * @flags:	BLKDEV_IFL_* flags to control behaviour
- *
- * Description:
- *    Issue a discard request for the sectors in question.
+static void bio_batch_init(struct bio_batch *bb, struct completion *wait)
+{
+	atomic_set(&bb->done, 1);
+	bb->flags = 1 << BIO_UPTODATE;
+	bb->wait = wait;
+}
+
+static int bio_batch_wait(struct bio_batch *bb)
+{
+	/* Wait for bios in-flight */
+	if (!atomic_dec_and_test(&bb->done))
+		wait_for_completion(bb->wait);
+
+	if (!test_bit(BIO_UPTODATE, &bb->flags))
+		return -EIO;
+
+	return 0;
+}
+
+/*
+ * Issue discard bios for the range without waiting for them, accounting
+ * them in @bb.
  */
-int blkdev_issue_discard(struct block_device *bdev, sector_t sector,
-		sector_t nr_sects, gfp_t gfp_mask, unsigned long flags)
+static int __blkdev_issue_discard(struct block_device *bdev, sector_t sector,
+		sector_t nr_sects, gfp_t gfp_mask, unsigned long flags,
+		struct bio_batch *bb)
 {
-	DECLARE_COMPLETION_ONSTACK(wait);
 	struct request_queue *q = bdev_get_queue(bdev);
 	int type = REQ_WRITE | REQ_DISCARD;
 	unsigned int max_discard_sectors;
 	unsigned int granularity, alignment, mask;
-	struct bio_batch bb;
 	struct bio *bio;
-	int ret = 0;
 
 	if (!q)
 		return -ENXIO;
@@ -77,19 +85,13 @@ int blkdev_issue_discard(struct block_device *bdev, sector_t sector,
 		type |= REQ_SECURE;
 	}
 
-	atomic_set(&bb.done, 1);
-	bb.flags = 1 << BIO_UPTODATE;
-	bb.wait = &wait;
-
 	while (nr_sects) {
 		unsigned int req_sects;
 		sector_t end_sect;
 
 		bio = bio_alloc(gfp_mask, 1);
-		if (!bio) {
-			ret = -ENOMEM;
-			break;
-		}
+		if (!bio)
+			return -ENOMEM;
 
 		req_sects = min_t(sector_t, nr_sects, max_discard_sectors);
 
@@ -108,36 +110,194 @@ int blkdev_issue_discard(struct block_device *bdev, sector_t sector,
 		bio->bi_sector = sector;
 		bio->bi_end_io = bio_batch_end_io;
 		bio->bi_bdev = bdev;
-		bio->bi_private = &bb;
+		bio->bi_private = bb;
 
 		bio->bi_size = req_sects << 9;
 		nr_sects -= req_sects;
 		sector = end_sect;
 
-		atomic_inc(&bb.done);
+		atomic_inc(&bb->done);
 		submit_bio(type, bio);
 	}
 
-	/* Wait for bios in-flight */
-	if (!atomic_dec_and_test(&bb.done))
-		wait_for_completion(&wait);
+	return 0;
+}
 
-	if (!test_bit(BIO_UPTODATE, &bb.flags))
-		ret = -EIO;
+/**
+ * blkdev_issue_discard - queue a discard
+ * @bdev:	blockdev to issue discard for
+ * @sector:	start sector
+ * @nr_sects:	number of sectors to discard
+ * @gfp_mask:	memory allocation flags (for bio_alloc)
+ * @flags:	BLKDEV_IFL_* flags to control behaviour
+ *
+ * Description:
+ *    Issue a discard request for the sectors in question.
+ */
+int blkdev_issue_discard(struct block_device *bdev, sector_t sector,
+		sector_t nr_sects, gfp_t gfp_mask, unsigned long flags)
+{
+	DECLARE_COMPLETION_ONSTACK(wait);
+	struct bio_batch bb;
+	int ret, err;
 
-	return ret;
+	bio_batch_init(&bb, &wait);
+	ret = __blkdev_issue_discard(bdev, sector, nr_sects, gfp_mask, flags,
+				     &bb);
+	err = bio_batch_wait(&bb);
+
+	return err ? err : ret;
 }
 EXPORT_SYMBOL(blkdev_issue_discard);
 
+/*
+ * Issue the pending range of @batch, if any.
+ */
+static void blk_discard_batch_issue(struct blk_discard_batch *batch)
+{
+	int ret;
+
+	if (!batch->nr_sects)
+		return;
+
+	ret = __blkdev_issue_discard(batch->bdev, batch->sector,
+				     batch->nr_sects, batch->gfp_mask,
+				     batch->flags, &batch->bb);
+	if (ret && !batch->error)
+		batch->error = ret;
+	batch->nr_sects = 0;
+}
+
+/**
+ * blk_discard_batch_init - prepare an asynchronous discard batch
+ * @batch:	batch to initialise
+ * @bdev:	blockdev to issue discards for
+ * @gfp_mask:	memory allocation flags (for bio_alloc)
+ * @flags:	BLKDEV_DISCARD_* flags to control behaviour
+ *
+ * Description:
+ *    Callers that discard many ranges, such as FITRIM, queue them with
+ *    blk_discard_batch_add() so that the device sees them back to back
+ *    instead of one synchronous round trip per range, and then wait for
+ *    all of them with blk_discard_batch_finish().
+ */
+void blk_discard_batch_init(struct blk_discard_batch *batch,
+		struct block_device *bdev, gfp_t gfp_mask, unsigned long flags)
+{
+	batch->bdev = bdev;
+	batch->gfp_mask = gfp_mask;
+	batch->flags = flags;
+	batch->sector = 0;
+	batch->nr_sects = 0;
+	batch->error = 0;
+	init_completion(&batch->wait);
+	bio_batch_init(&batch->bb, &batch->wait);
+}
+EXPORT_SYMBOL(blk_discard_batch_init);
+
+/**
+ * blk_discard_batch_add - add a range to a discard batch
+ * @batch:	batch set up with blk_discard_batch_init()
+ * @sector:	start sector
+ * @nr_sects:	number of sectors to discard
+ *
+ * Description:
+ *    A range that directly follows the previous one is merged with it,
+ *    otherwise the previous range is issued and @sector starts a new one.
+ *    Never waits for I/O, but may sleep in bio allocation depending on
+ *    the batch's gfp_mask.  Returns the first submission error seen so far.
+ */
+int blk_discard_batch_add(struct blk_discard_batch *batch,
+		sector_t sector, sector_t nr_sects)
+{
+	if (batch->nr_sects && sector == batch->sector + batch->nr_sects) {
+		batch->nr_sects += nr_sects;
+		return batch->error;
+	}
+
+	blk_discard_batch_issue(batch);
+	batch->sector = sector;
+	batch->nr_sects = nr_sects;
+
+	return batch->error;
+}
+EXPORT_SYMBOL(blk_discard_batch_add);
+
+/**
+ * blk_discard_batch_finish - issue the rest of a batch and wait for it
+ * @batch:	batch set up with blk_discard_batch_init()
+ *
+ * Description:
+ *    Returns 0 once every discard in the batch has completed, or the
+ *    first error seen.  As with blkdev_issue_discard(), discards the
+ *    device rejected as unsupported are not reported as errors.  The
+ *    batch must be initialised again before it is reused.
+ */
+int blk_discard_batch_finish(struct blk_discard_batch *batch)
+{
+	int err;
+
+	blk_discard_batch_issue(batch);
+	err = bio_batch_wait(&batch->bb);
+
+	return batch->error ? batch->error : err;
+}
+EXPORT_SYMBOL(blk_discard_batch_finish);
+
+/*
+ * Zero the range with payload-less write zeroes commands, without waiting
+ * for them.
+ */
+static int __blkdev_issue_write_zeroes(struct block_device *bdev,
+		sector_t sector, sector_t nr_sects, gfp_t gfp_mask,
+		struct bio_batch *bb)
+{
+	unsigned int max_write_zeroes_sectors, bs_sects;
+	struct bio *bio;
+
+	bs_sects = bdev_logical_block_size(bdev) >> 9;
+	max_write_zeroes_sectors = min(bdev_write_zeroes_sectors(bdev),
+				       UINT_MAX >> 9);
+	max_write_zeroes_sectors = round_down(max_write_zeroes_sectors,
+					      bs_sects);
+	if (!max_write_zeroes_sectors)
+		return -EOPNOTSUPP;
+
+	while (nr_sects) {
+		unsigned int req_sects;
+
+		bio = bio_alloc(gfp_mask, 1);
+		if (!bio)
+			return -ENOMEM;
+
+		req_sects = min_t(sector_t, nr_sects, max_write_zeroes_sectors);
+
+		bio->bi_sector = sector;
+		bio->bi_end_io = bio_batch_end_io;
+		bio->bi_bdev = bdev;
+		bio->bi_private = bb;
+		bio->bi_size = req_sects << 9;
+
+		nr_sects -= req_sects;
+		sector += req_sects;
+
+		atomic_inc(&bb->done);
+		submit_bio(REQ_WRITE | REQ_DISCARD | REQ_WRITE_ZEROES, bio);
+	}
+
+	return 0;
+}
+
 /**
- * blkdev_issue_zeroout - generate number of zero filed write bios
+ * blkdev_issue_zeroout - zero a range of sectors
  * @bdev:	blockdev to issue
  * @sector:	start sector
  * @nr_sects:	number of sectors to write
  * @gfp_mask:	memory allocation flags (for bio_alloc)
  *
  * Description:
- *  Generate and issue number of bios with zerofiled pages.
+ *  Use the device's write zeroes command if it has one, which moves no
+ *  data, and otherwise generate and issue bios with zerofiled pages.
  */
 
 int blkdev_issue_zeroout(struct block_device *bdev, sector_t sector,
@@ -149,9 +309,16 @@ int blkdev_issue_zeroout(struct block_device *bdev, sector_t sector,
 	unsigned int sz;
 	DECLARE_COMPLETION_ONSTACK(wait);
 
-	atomic_set(&bb.done, 1);
-	bb.flags = 1 << BIO_UPTODATE;
-	bb.wait = &wait;
+	if (bdev_write_zeroes_sectors(bdev)) {
+		bio_batch_init(&bb, &wait);
+		ret = __blkdev_issue_write_zeroes(bdev, sector, nr_sects,
+						  gfp_mask, &bb);
+		if (!bio_batch_wait(&bb) && !ret)
+			return 0;
+		/* Fall back to writing the zeroes out */
+	}
+
+	bio_batch_init(&bb, &wait);
 
 	ret = 0;
 	while (nr_sects != 0) {
@@ -180,11 +347,7 @@ int blkdev_issue_zeroout(struct block_device *bdev, sector_t sector,
 		submit_bio(WRITE, bio);
 	}
 
-	/* Wait for bios in-flight */
-	if (!atomic_dec_and_test(&bb.done))
-		wait_for_completion(&wait);
-
-	if (!test_bit(BIO_UPTODATE, &bb.flags))
+	if (bio_batch_wait(&bb))
 		/* One of bios in the batch was completed with error.*/
 		ret = -EIO;
 
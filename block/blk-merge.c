@@ -429,6 +429,13 @@ static int attempt_merge(struct request_queue *q, struct request *req,
 	if ((req->cmd_flags & REQ_SECURE) != (next->cmd_flags & REQ_SECURE))
 		return 0;
 
+	/*
+	 * Don't merge discard requests and write zeroes requests
+	 */
+	if ((req->cmd_flags & REQ_WRITE_ZEROES) !=
+	    (next->cmd_flags & REQ_WRITE_ZEROES))
+		return 0;
+
 	/*
 	 * not contiguous
 	 */
@@ -482,6 +489,7 @@ static int attempt_merge(struct request_queue *q, struct request *req,
 	 * 'next' is going away, so update stats accordingly
 	 */
 	blk_account_io_merge(next);
+	blk_hold_account_merge(q);
 
 	req->ioprio = ioprio_best(req->ioprio, next->ioprio);
 	if (blk_rq_cpu_valid(next))
@@ -532,6 +540,11 @@ bool blk_rq_merge_ok(struct request *rq, struct bio *bio)
 	if ((bio->bi_rw & REQ_SECURE) != (rq->bio->bi_rw & REQ_SECURE))
 		return false;
 
+	/* don't merge discard requests and write zeroes requests */
+	if ((bio->bi_rw & REQ_WRITE_ZEROES) !=
+	    (rq->bio->bi_rw & REQ_WRITE_ZEROES))
+		return false;
+
 	/* different data direction or already started, don't merge */
 	if (bio_data_dir(bio) != rq_data_dir(rq))
 		return false;
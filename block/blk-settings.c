@@ -99,6 +99,20 @@ void blk_queue_lld_busy(struct request_queue *q, lld_busy_fn *fn)
 }
 EXPORT_SYMBOL_GPL(blk_queue_lld_busy);
 
+/**
+ * blk_queue_poll_fn - set driver's completion polling function
+ * @q:		queue
+ * @fn:		function that reaps pending completions and returns their number
+ *
+ * Registering a poll function makes the io_poll queue attribute writable.
+ * Polling itself stays disabled until it is switched on through sysfs.
+ */
+void blk_queue_poll_fn(struct request_queue *q, poll_q_fn *fn)
+{
+	q->poll_fn = fn;
+}
+EXPORT_SYMBOL_GPL(blk_queue_poll_fn);
+
 /**
  * blk_set_default_limits - reset limits to default values
  * @lim:  the queue_limits structure to reset
@@ -114,6 +128,7 @@ void blk_set_default_limits(struct queue_limits *lim)
 	lim->max_segment_size = BLK_MAX_SEGMENT_SIZE;
 	lim->max_sectors = lim->max_hw_sectors = BLK_SAFE_MAX_SECTORS;
 	lim->max_discard_sectors = 0;
+	lim->max_write_zeroes_sectors = 0;
 	lim->discard_granularity = 0;
 	lim->discard_alignment = 0;
 	lim->discard_misaligned = 0;
@@ -285,6 +300,24 @@ void blk_queue_max_discard_sectors(struct request_queue *q,
 }
 EXPORT_SYMBOL(blk_queue_max_discard_sectors);
 
+/**
+ * blk_queue_max_write_zeroes_sectors - set max sectors for a single write zeroes
+ * @q:  the request queue for the device
+ * @max_write_zeroes_sectors: maximum number of sectors to zero per command
+ *
+ * Description:
+ *    Drivers that can zero a range of blocks without a data payload set
+ *    this to a non-zero value.  Such requests arrive with both
+ *    %REQ_DISCARD and %REQ_WRITE_ZEROES set and, unlike a discard, must
+ *    leave the range reading back as zeroes.
+ **/
+void blk_queue_max_write_zeroes_sectors(struct request_queue *q,
+		unsigned int max_write_zeroes_sectors)
+{
+	q->limits.max_write_zeroes_sectors = max_write_zeroes_sectors;
+}
+EXPORT_SYMBOL(blk_queue_max_write_zeroes_sectors);
+
 /**
  * blk_queue_max_segments - set max hw segments for a request for this queue
  * @q:  the request queue for the device
@@ -510,6 +543,8 @@ int blk_stack_limits(struct queue_limits *t, struct queue_limits *b,
 
 	t->max_sectors = min_not_zero(t->max_sectors, b->max_sectors);
 	t->max_hw_sectors = min_not_zero(t->max_hw_sectors, b->max_hw_sectors);
+	t->max_write_zeroes_sectors = min(t->max_write_zeroes_sectors,
+					  b->max_write_zeroes_sectors);
 	t->bounce_pfn = min_not_zero(t->bounce_pfn, b->bounce_pfn);
 
 	t->seg_boundary_mask = min_not_zero(t->seg_boundary_mask,
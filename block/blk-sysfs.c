@@ -168,6 +168,12 @@ static ssize_t queue_discard_zeroes_data_show(struct request_queue *q, char *pag
 	return queue_var_show(queue_discard_zeroes_data(q), page);
 }
 
+static ssize_t queue_write_zeroes_max_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%llu\n",
+		(unsigned long long)q->limits.max_write_zeroes_sectors << 9);
+}
+
 static ssize_t
 queue_max_sectors_store(struct request_queue *q, const char *page, size_t count)
 {
@@ -280,6 +286,84 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_poll(q), page);
+}
+
+static ssize_t queue_poll_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long poll_on;
+	ssize_t ret;
+
+	if (!q->poll_fn)
+		return -EINVAL;
+
+	ret = queue_var_store(&poll_on, page, count);
+	spin_lock_irq(q->queue_lock);
+	if (poll_on)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_poll_stat_show(struct request_queue *q, char *page)
+{
+	struct blk_poll_stat sum = { 0, };
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_poll_stat *stat = per_cpu_ptr(q->poll_stat, cpu);
+
+		sum.invoked += stat->invoked;
+		sum.success += stat->success;
+		sum.polled += stat->polled;
+		sum.interrupt += stat->interrupt;
+	}
+
+	return sprintf(page, "invoked %lu\nsuccess %lu\n"
+			     "polled %lu\ninterrupt %lu\n",
+		       sum.invoked, sum.success, sum.polled, sum.interrupt);
+}
+
+static ssize_t queue_hold_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->hold_usecs, page);
+}
+
+static ssize_t queue_hold_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long usecs;
+	ssize_t ret;
+
+	ret = queue_var_store(&usecs, page, count);
+	if (usecs > 10 * USEC_PER_MSEC)
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	q->hold_usecs = usecs;
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_hold_stat_show(struct request_queue *q, char *page)
+{
+	struct blk_hold_stat stat;
+
+	spin_lock_irq(q->queue_lock);
+	stat = q->hold_stat;
+	spin_unlock_irq(q->queue_lock);
+
+	return sprintf(page, "held %lu\nwindows %lu\nmerged %lu\n",
+		       stat.held, stat.windows, stat.merged);
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -364,6 +448,11 @@ static struct queue_sysfs_entry queue_discard_zeroes_data_entry = {
 	.show = queue_discard_zeroes_data_show,
 };
 
+static struct queue_sysfs_entry queue_write_zeroes_max_entry = {
+	.attr = {.name = "write_zeroes_max_bytes", .mode = S_IRUGO },
+	.show = queue_write_zeroes_max_show,
+};
+
 static struct queue_sysfs_entry queue_nonrot_entry = {
 	.attr = {.name = "rotational", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_show_nonrot,
@@ -394,6 +483,28 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+static struct queue_sysfs_entry queue_poll_stat_entry = {
+	.attr = {.name = "io_poll_stat", .mode = S_IRUGO },
+	.show = queue_poll_stat_show,
+};
+
+static struct queue_sysfs_entry queue_hold_entry = {
+	.attr = {.name = "io_hold_us", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_hold_show,
+	.store = queue_hold_store,
+};
+
+static struct queue_sysfs_entry queue_hold_stat_entry = {
+	.attr = {.name = "io_hold_stat", .mode = S_IRUGO },
+	.show = queue_hold_stat_show,
+};
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -411,11 +522,16 @@ static struct attribute *default_attrs[] = {
 	&queue_discard_granularity_entry.attr,
 	&queue_discard_max_entry.attr,
 	&queue_discard_zeroes_data_entry.attr,
+	&queue_write_zeroes_max_entry.attr,
 	&queue_nonrot_entry.attr,
 	&queue_nomerges_entry.attr,
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_stat_entry.attr,
+	&queue_hold_entry.attr,
+	&queue_hold_stat_entry.attr,
 	NULL,
 };
 
@@ -503,6 +619,8 @@ static void blk_release_queue(struct kobject *kobj)
 
 	bdi_destroy(&q->backing_dev_info);
 
+	free_percpu(q->poll_stat);
+
 	ida_simple_remove(&blk_queue_ida, q->id);
 	kmem_cache_free(blk_requestq_cachep, q);
 }
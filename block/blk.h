@@ -66,6 +66,20 @@ static inline void blk_clear_rq_complete(struct request *rq)
 void blk_insert_flush(struct request *rq);
 void blk_abort_flushes(struct request_queue *q);
 
+/*
+ * Dispatch hold window, see blk_queue_hold()
+ */
+static inline bool blk_queue_held(struct request_queue *q)
+{
+	return hrtimer_active(&q->hold_timer) && queue_in_flight(q);
+}
+
+static inline void blk_hold_account_merge(struct request_queue *q)
+{
+	if (hrtimer_active(&q->hold_timer))
+		q->hold_stat.merged++;
+}
+
 static inline struct request *__elv_next_request(struct request_queue *q)
 {
 	struct request *rq;
@@ -96,6 +110,13 @@ static inline struct request *__elv_next_request(struct request_queue *q)
 			q->flush_queue_delayed = 1;
 			return NULL;
 		}
+		/*
+		 * While a hold window is open and the device has work, leave
+		 * sorted requests in the elevator so that they can still pick
+		 * up merges from other submitters.
+		 */
+		if (blk_queue_held(q))
+			return NULL;
 		if (unlikely(blk_queue_dead(q)) ||
 		    !q->elevator->type->ops.elevator_dispatch_fn(q, 0))
 			return NULL;
@@ -0,0 +1,530 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  Based on the deadline i/o scheduler, Copyright (C) 2002 Jens Axboe.
+ *
+ *  SD cards and eMMC devices have no seek penalty, but small writes that
+ *  straddle or hop between erase blocks force the card's translation layer
+ *  into expensive read-modify-write cycles. Reads are therefore served in
+ *  arrival order and preferred over writes, while writes are collected and
+ *  dispatched in batches that stay within a single erase block, in
+ *  ascending sector order. The scheduler never idles.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int read_expire = HZ / 4;	/* max time before a read is submitted. */
+static const int write_expire = 2 * HZ;	/* ditto for writes, these limits are SOFT! */
+static const int writes_starved = 4;	/* max times reads can starve a write */
+static const int write_batch = 16;	/* max # of writes dispatched per erase block */
+static const unsigned int default_erase_sectors = (4 << 20) >> 9;
+
+struct flash_data {
+	struct request_queue *queue;
+
+	/*
+	 * run time data
+	 */
+
+	/*
+	 * requests are present on both sort_list and fifo_list
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	/*
+	 * next write in the erase block currently being batched
+	 */
+	struct request *next_rq;
+	sector_t batch_block;		/* erase block of the current batch */
+	unsigned int batching;		/* number of writes in current batch */
+	unsigned int starved;		/* times reads have starved writes */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[2];
+	int write_batch;
+	int writes_starved;
+	int front_merges;
+	unsigned int erase_sectors;
+
+	/*
+	 * statistics, exported read-only through sysfs
+	 */
+	unsigned long merged_writes;
+	unsigned long aligned_writes;
+	unsigned long straddling_writes;
+	unsigned long write_batches;
+};
+
+/*
+ * The erase block size is taken from the discard granularity, which the MMC
+ * layer sets to the card's preferred erase size, falling back to the optimal
+ * I/O size and finally to a conservative 4MiB.
+ */
+static unsigned int flash_queue_erase_sectors(struct request_queue *q)
+{
+	unsigned int bytes = q->limits.discard_granularity;
+
+	if (!bytes)
+		bytes = q->limits.io_opt;
+	if (bytes < PAGE_SIZE)
+		return default_erase_sectors;
+
+	return bytes >> 9;
+}
+
+static inline sector_t
+flash_erase_block(struct flash_data *fd, sector_t sector)
+{
+	sector_div(sector, fd->erase_sectors);
+	return sector;
+}
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+flash_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static inline void
+flash_del_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	if (fd->next_rq == rq)
+		fd->next_rq = flash_latter_request(rq);
+
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int data_dir = rq_data_dir(rq);
+
+	elv_rb_add(flash_rb_root(fd, rq), rq);
+
+	/*
+	 * set expire time and add to fifo list
+	 */
+	rq_set_fifo_time(rq, jiffies + fd->fifo_expire[data_dir]);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[data_dir]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	flash_del_rq_rb(fd, rq);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (fd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	if (rq_data_dir(req) == WRITE)
+		fd->merged_writes++;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		elv_rb_add(flash_rb_root(fd, req), req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	if (rq_data_dir(req) == WRITE)
+		fd->merged_writes++;
+
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+/*
+ * move request from sort list to dispatch queue.
+ */
+static inline void
+flash_move_to_dispatch(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	flash_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+/*
+ * flash_check_fifo returns 1 if the oldest request in direction ddir has
+ * expired, 0 otherwise (including when there are no requests at all).
+ */
+static inline int flash_check_fifo(struct flash_data *fd, int ddir)
+{
+	struct request *rq;
+
+	if (list_empty(&fd->fifo_list[ddir]))
+		return 0;
+
+	rq = rq_entry_fifo(fd->fifo_list[ddir].next);
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * walk back from rq to the lowest-sectored write in the same erase block,
+ * so that a batch covers the erase block in ascending order.
+ */
+static struct request *
+flash_first_in_erase_block(struct flash_data *fd, struct request *rq)
+{
+	sector_t block = flash_erase_block(fd, blk_rq_pos(rq));
+	struct rb_node *node;
+
+	while ((node = rb_prev(&rq->rb_node)) != NULL) {
+		struct request *prev = rb_entry_rq(node);
+
+		if (flash_erase_block(fd, blk_rq_pos(prev)) != block)
+			break;
+		rq = prev;
+	}
+
+	return rq;
+}
+
+/*
+ * account a write about to be dispatched, and remember where the batch
+ * continues.
+ */
+static void flash_dispatch_write(struct flash_data *fd, struct request *rq)
+{
+	sector_t first = flash_erase_block(fd, blk_rq_pos(rq));
+	sector_t last = flash_erase_block(fd, rq_end_sector(rq) - 1);
+
+	if (first == last)
+		fd->aligned_writes++;
+	else
+		fd->straddling_writes++;
+
+	fd->batching++;
+	fd->next_rq = flash_latter_request(rq);
+	flash_move_to_dispatch(fd, rq);
+}
+
+/*
+ * flash_dispatch_requests selects the next request: reads first, in arrival
+ * order, unless writes have been starved or have expired, in which case a
+ * batch of writes confined to one erase block is started.
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int reads = !list_empty(&fd->fifo_list[READ]);
+	const int writes = !list_empty(&fd->fifo_list[WRITE]);
+	struct request *rq = fd->next_rq;
+
+	/*
+	 * keep going within the current erase block, unless a read has
+	 * waited too long
+	 */
+	if (rq && fd->batching < fd->write_batch &&
+	    !flash_check_fifo(fd, READ) &&
+	    flash_erase_block(fd, blk_rq_pos(rq)) == fd->batch_block) {
+		flash_dispatch_write(fd, rq);
+		return 1;
+	}
+
+	fd->next_rq = NULL;
+
+	if (reads) {
+		if (writes && (fd->starved++ >= fd->writes_starved ||
+			       flash_check_fifo(fd, WRITE)))
+			goto dispatch_writes;
+
+		rq = rq_entry_fifo(fd->fifo_list[READ].next);
+		flash_move_to_dispatch(fd, rq);
+		return 1;
+	}
+
+	if (writes) {
+dispatch_writes:
+		BUG_ON(RB_EMPTY_ROOT(&fd->sort_list[WRITE]));
+
+		fd->starved = 0;
+
+		/*
+		 * start from the erase block of the oldest write
+		 */
+		rq = rq_entry_fifo(fd->fifo_list[WRITE].next);
+		rq = flash_first_in_erase_block(fd, rq);
+
+		fd->batch_block = flash_erase_block(fd, blk_rq_pos(rq));
+		fd->batching = 0;
+		fd->write_batches++;
+
+		flash_dispatch_write(fd, rq);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	BUG_ON(!list_empty(&fd->fifo_list[READ]));
+	BUG_ON(!list_empty(&fd->fifo_list[WRITE]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static int flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return -ENOMEM;
+
+	fd->queue = q;
+	INIT_LIST_HEAD(&fd->fifo_list[READ]);
+	INIT_LIST_HEAD(&fd->fifo_list[WRITE]);
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	fd->fifo_expire[READ] = read_expire;
+	fd->fifo_expire[WRITE] = write_expire;
+	fd->writes_starved = writes_starved;
+	fd->front_merges = 1;
+	fd->write_batch = write_batch;
+	fd->erase_sectors = flash_queue_erase_sectors(q);
+
+	q->elevator->elevator_data = fd;
+	return 0;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_read_expire_show, fd->fifo_expire[READ], 1);
+SHOW_FUNCTION(flash_write_expire_show, fd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+SHOW_FUNCTION(flash_write_batch_show, fd->write_batch, 0);
+SHOW_FUNCTION(flash_erase_block_kb_show, fd->erase_sectors >> 1, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_read_expire_store, &fd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_write_expire_store, &fd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, INT_MIN, INT_MAX, 0);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+STORE_FUNCTION(flash_write_batch_store, &fd->write_batch, 1, INT_MAX, 0);
+#undef STORE_FUNCTION
+
+static ssize_t
+flash_erase_block_kb_store(struct elevator_queue *e, const char *page,
+			   size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+	int kb;
+	int ret = flash_var_store(&kb, page, count);
+
+	/* erase_sectors is shown as an int, keep the shift below from overflowing */
+	if (kb > (INT_MAX >> 1))
+		return -EINVAL;
+
+	/* 0 reverts to the size advertised by the device */
+	if (kb <= 0)
+		fd->erase_sectors = flash_queue_erase_sectors(fd->queue);
+	else
+		fd->erase_sectors = max(kb, (int)(PAGE_SIZE >> 10)) << 1;
+
+	return ret;
+}
+
+#define STAT_FUNCTION(__FUNC, __VAR)					\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	return sprintf(page, "%lu\n", __VAR);				\
+}
+STAT_FUNCTION(flash_merged_writes_show, fd->merged_writes);
+STAT_FUNCTION(flash_aligned_writes_show, fd->aligned_writes);
+STAT_FUNCTION(flash_straddling_writes_show, fd->straddling_writes);
+STAT_FUNCTION(flash_write_batches_show, fd->write_batches);
+#undef STAT_FUNCTION
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+#define FD_STAT_ATTR(name) \
+	__ATTR(name, S_IRUGO, flash_##name##_show, NULL)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(read_expire),
+	FD_ATTR(write_expire),
+	FD_ATTR(writes_starved),
+	FD_ATTR(front_merges),
+	FD_ATTR(write_batch),
+	FD_ATTR(erase_block_kb),
+	FD_STAT_ATTR(merged_writes),
+	FD_STAT_ATTR(aligned_writes),
+	FD_STAT_ATTR(straddling_writes),
+	FD_STAT_ATTR(write_batches),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	return elv_register(&iosched_flash);
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Flash-aware IO scheduler");
@@ -634,9 +634,14 @@ static void nvme_make_request(struct request_queue *q, struct bio *bio)
 	put_nvmeq(nvmeq);
 }
 
-static irqreturn_t nvme_process_cq(struct nvme_queue *nvmeq)
+/*
+ * Reap all completions pending on the queue and return how many there were.
+ * Must be called with the queue lock held.
+ */
+static int __nvme_process_cq(struct nvme_queue *nvmeq)
 {
 	u16 head, phase;
+	int found = 0;
 
 	head = nvmeq->cq_head;
 	phase = nvmeq->cq_phase;
@@ -655,22 +660,27 @@ static irqreturn_t nvme_process_cq(struct nvme_queue *nvmeq)
 
 		ctx = free_cmdid(nvmeq, cqe.command_id, &fn);
 		fn(nvmeq->dev, ctx, &cqe);
+		found++;
 	}
 
 	/* If the controller ignores the cq head doorbell and continuously
 	 * writes to the queue, it is theoretically possible to wrap around
-	 * the queue twice and mistakenly return IRQ_NONE.  Linux only
-	 * requires that 0.1% of your interrupts are handled, so this isn't
-	 * a big problem.
+	 * the queue twice and end up where we started, in which case the
+	 * doorbell is left alone.
 	 */
 	if (head == nvmeq->cq_head && phase == nvmeq->cq_phase)
-		return IRQ_NONE;
+		return found;
 
 	writel(head, nvmeq->q_db + (1 << nvmeq->dev->db_stride));
 	nvmeq->cq_head = head;
 	nvmeq->cq_phase = phase;
 
-	return IRQ_HANDLED;
+	return found;
+}
+
+static irqreturn_t nvme_process_cq(struct nvme_queue *nvmeq)
+{
+	return __nvme_process_cq(nvmeq) ? IRQ_HANDLED : IRQ_NONE;
 }
 
 static irqreturn_t nvme_irq(int irq, void *data)
@@ -692,6 +702,25 @@ static irqreturn_t nvme_irq_check(int irq, void *data)
 	return IRQ_WAKE_THREAD;
 }
 
+/*
+ * Completion polling for synchronous waiters, see blk_poll().  I/O is
+ * submitted on the queue of the submitting CPU, so that is the queue to
+ * poll.
+ */
+static int nvme_poll(struct request_queue *q)
+{
+	struct nvme_ns *ns = q->queuedata;
+	struct nvme_queue *nvmeq = get_nvmeq(ns->dev);
+	int found;
+
+	spin_lock_irq(&nvmeq->q_lock);
+	found = __nvme_process_cq(nvmeq);
+	spin_unlock_irq(&nvmeq->q_lock);
+	put_nvmeq(nvmeq);
+
+	return found;
+}
+
 static void nvme_abort_command(struct nvme_queue *nvmeq, int cmdid)
 {
 	spin_lock_irq(&nvmeq->q_lock);
@@ -1353,6 +1382,7 @@ static struct nvme_ns *nvme_alloc_ns(struct nvme_dev *dev, int nsid,
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, ns->queue);
 /*	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, ns->queue); */
 	blk_queue_make_request(ns->queue, nvme_make_request);
+	blk_queue_poll_fn(ns->queue, nvme_poll);
 	ns->dev = dev;
 	ns->queue->queuedata = ns;
 
@@ -0,0 +1,401 @@
+/*
+ *  drivers/cpufreq/cpufreq_schedutil.c
+ *
+ *  CPUFreq governor driven by scheduler utilization data.
+ *
+ *  Instead of sampling idle time from a timer, the governor is called by
+ *  the fair scheduling class on enqueue and on every tick with the
+ *  utilization of the runqueue (see cpufreq_update_util()).  It picks a
+ *  frequency proportional to that utilization and hands it to a per-policy
+ *  SCHED_FIFO kthread which does the, possibly slow, driver call.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_schedutil.h>
+
+/*
+ * By default, don't change the frequency more often than every ten
+ * transition latencies, so that at most a tenth of the time is spent
+ * switching; and no more often than once a millisecond.
+ */
+#define LATENCY_MULTIPLIER		(10)
+#define MIN_RATE_LIMIT_US		(1000)
+#define TRANSITION_LATENCY_LIMIT	(10 * 1000 * 1000)
+
+struct sugov_policy {
+	struct cpufreq_policy *policy;
+
+	raw_spinlock_t update_lock;	/* protects the fields below */
+	u64 last_freq_update_time;
+	u64 work_request_time;
+	unsigned int next_freq;
+	bool work_in_progress;
+
+	struct irq_work irq_work;
+	struct task_struct *thread;
+	struct mutex work_lock;		/* serializes driver calls */
+};
+
+struct sugov_cpu {
+	struct update_util_data update_util;
+	struct sugov_policy *sg_policy;
+
+	unsigned long util;
+	unsigned long max;
+	u64 last_update;
+};
+
+static DEFINE_PER_CPU(struct sugov_cpu, sugov_cpu);
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event);
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+static
+#endif
+struct cpufreq_governor cpufreq_gov_schedutil = {
+	.name			= "schedutil",
+	.governor		= cpufreq_governor_schedutil,
+	.max_transition_latency	= TRANSITION_LATENCY_LIMIT,
+	.owner			= THIS_MODULE,
+};
+
+static struct sugov_tuners {
+	unsigned int rate_limit_us;
+} sugov_tuners_ins;
+
+static unsigned int sugov_enable;	/* number of policies using us */
+static DEFINE_MUTEX(sugov_mutex);	/* protects sugov_enable */
+
+/************************** sysfs interface ************************/
+
+static ssize_t show_rate_limit_us(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", sugov_tuners_ins.rate_limit_us);
+}
+
+static ssize_t store_rate_limit_us(struct kobject *a, struct attribute *b,
+				   const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+
+	sugov_tuners_ins.rate_limit_us = input;
+	return count;
+}
+
+define_one_global_rw(rate_limit_us);
+
+static struct attribute *sugov_attributes[] = {
+	&rate_limit_us.attr,
+	NULL
+};
+
+static struct attribute_group sugov_attr_group = {
+	.attrs = sugov_attributes,
+	.name = "schedutil",
+};
+
+/************************** sysfs end ************************/
+
+static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
+{
+	unsigned int rate_limit_us = ACCESS_ONCE(sugov_tuners_ins.rate_limit_us);
+	s64 delta_ns;
+
+	/* The kthread will pick up the latest request when it runs */
+	if (sg_policy->work_in_progress)
+		return false;
+
+	delta_ns = time - sg_policy->last_freq_update_time;
+	return delta_ns >= (s64)rate_limit_us * NSEC_PER_USEC;
+}
+
+/*
+ * Pick the frequency at which the busiest cpu of the policy would be about
+ * 80% busy.  The utilization is the busy fraction at the current frequency,
+ * the scheduler doesn't scale it by frequency, so the next frequency is
+ * relative to the current one: next_freq = 1.25 * cur_freq * util / max.
+ * A steady load settles where it keeps the cpu about 80% busy.
+ */
+static unsigned int sugov_next_freq(struct sugov_policy *sg_policy, u64 time,
+				    unsigned long *util_ret,
+				    unsigned long *max_ret)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned long util = 0, max = 1;
+	unsigned int freq;
+	unsigned int j;
+
+	for_each_cpu(j, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+		s64 delta_ns;
+
+		/*
+		 * A cpu which hasn't reported for more than a tick is idle
+		 * with its tick stopped, its utilization is stale.
+		 */
+		delta_ns = time - j_sg_cpu->last_update;
+		if (delta_ns > TICK_NSEC)
+			continue;
+
+		if (j_sg_cpu->util * max > j_sg_cpu->max * util) {
+			util = j_sg_cpu->util;
+			max = j_sg_cpu->max;
+		}
+	}
+
+	freq = div_u64((u64)policy->cur * (util + (util >> 2)), max);
+	*util_ret = util;
+	*max_ret = max;
+
+	return clamp(freq, policy->min, policy->max);
+}
+
+static void sugov_update(struct update_util_data *data, u64 time,
+			 unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(data, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	unsigned long next_util, next_max;
+	unsigned int next_f;
+
+	raw_spin_lock(&sg_policy->update_lock);
+
+	sg_cpu->util = util;
+	sg_cpu->max = max;
+	sg_cpu->last_update = time;
+
+	if (!sugov_should_update_freq(sg_policy, time))
+		goto out;
+
+	next_f = sugov_next_freq(sg_policy, time, &next_util, &next_max);
+	if (next_f == sg_policy->next_freq)
+		goto out;
+
+	sg_policy->next_freq = next_f;
+	sg_policy->last_freq_update_time = time;
+	sg_policy->work_request_time = time;
+	sg_policy->work_in_progress = true;
+	trace_sugov_next_freq(smp_processor_id(), next_util, next_max, next_f);
+
+	/* We hold the rq lock, the kthread can't be woken up from here */
+	irq_work_queue(&sg_policy->irq_work);
+out:
+	raw_spin_unlock(&sg_policy->update_lock);
+}
+
+static void sugov_irq_work(struct irq_work *irq_work)
+{
+	struct sugov_policy *sg_policy = container_of(irq_work,
+						      struct sugov_policy,
+						      irq_work);
+
+	wake_up_process(sg_policy->thread);
+}
+
+static int sugov_thread(void *data)
+{
+	struct sugov_policy *sg_policy = data;
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned int freq, old_freq;
+	unsigned long flags;
+	u64 request_time;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+
+		raw_spin_lock_irqsave(&sg_policy->update_lock, flags);
+		if (!sg_policy->work_in_progress) {
+			raw_spin_unlock_irqrestore(&sg_policy->update_lock,
+						   flags);
+			schedule();
+			continue;
+		}
+		freq = sg_policy->next_freq;
+		request_time = sg_policy->work_request_time;
+		sg_policy->work_in_progress = false;
+		raw_spin_unlock_irqrestore(&sg_policy->update_lock, flags);
+
+		__set_current_state(TASK_RUNNING);
+
+		mutex_lock(&sg_policy->work_lock);
+		old_freq = policy->cur;
+		__cpufreq_driver_target(policy, freq, CPUFREQ_RELATION_L);
+		trace_sugov_freq_applied(policy->cpu, old_freq, policy->cur,
+					 local_clock() - request_time);
+		mutex_unlock(&sg_policy->work_lock);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static struct sugov_policy *sugov_policy_alloc(struct cpufreq_policy *policy)
+{
+	struct sched_param param = { .sched_priority = MAX_USER_RT_PRIO / 2 };
+	struct sugov_policy *sg_policy;
+	struct task_struct *thread;
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy)
+		return ERR_PTR(-ENOMEM);
+
+	sg_policy->policy = policy;
+	sg_policy->next_freq = UINT_MAX;
+	raw_spin_lock_init(&sg_policy->update_lock);
+	init_irq_work(&sg_policy->irq_work, sugov_irq_work);
+	mutex_init(&sg_policy->work_lock);
+
+	thread = kthread_create(sugov_thread, sg_policy, "sugov:%d",
+				policy->cpu);
+	if (IS_ERR(thread)) {
+		kfree(sg_policy);
+		return ERR_CAST(thread);
+	}
+	sched_setscheduler(thread, SCHED_FIFO, &param);
+	set_cpus_allowed_ptr(thread, policy->cpus);
+	sg_policy->thread = thread;
+	wake_up_process(thread);
+
+	return sg_policy;
+}
+
+static void sugov_policy_free(struct sugov_policy *sg_policy)
+{
+	irq_work_sync(&sg_policy->irq_work);
+	kthread_stop(sg_policy->thread);
+	mutex_destroy(&sg_policy->work_lock);
+	kfree(sg_policy);
+}
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event)
+{
+	unsigned int cpu = policy->cpu;
+	struct sugov_policy *sg_policy;
+	unsigned int j;
+	int rc;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if ((!cpu_online(cpu)) || (!policy->cur))
+			return -EINVAL;
+
+		mutex_lock(&sugov_mutex);
+		if (!sugov_enable) {
+			unsigned int latency;
+
+			rc = sysfs_create_group(cpufreq_global_kobject,
+						&sugov_attr_group);
+			if (rc) {
+				mutex_unlock(&sugov_mutex);
+				return rc;
+			}
+
+			/* policy latency is in nS. Convert it to uS first */
+			latency = policy->cpuinfo.transition_latency / 1000;
+			sugov_tuners_ins.rate_limit_us =
+				max_t(unsigned int, MIN_RATE_LIMIT_US,
+				      latency * LATENCY_MULTIPLIER);
+		}
+
+		sg_policy = sugov_policy_alloc(policy);
+		if (IS_ERR(sg_policy)) {
+			if (!sugov_enable)
+				sysfs_remove_group(cpufreq_global_kobject,
+						   &sugov_attr_group);
+			mutex_unlock(&sugov_mutex);
+			return PTR_ERR(sg_policy);
+		}
+		sugov_enable++;
+		mutex_unlock(&sugov_mutex);
+
+		for_each_cpu(j, policy->cpus) {
+			struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+
+			memset(j_sg_cpu, 0, sizeof(*j_sg_cpu));
+			j_sg_cpu->sg_policy = sg_policy;
+			j_sg_cpu->update_util.func = sugov_update;
+			cpufreq_set_update_util_data(j, &j_sg_cpu->update_util);
+		}
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		sg_policy = per_cpu(sugov_cpu, cpu).sg_policy;
+
+		for_each_cpu(j, policy->cpus)
+			cpufreq_set_update_util_data(j, NULL);
+		/* Wait for sugov_update() callers to go away */
+		synchronize_sched();
+
+		sugov_policy_free(sg_policy);
+
+		mutex_lock(&sugov_mutex);
+		sugov_enable--;
+		if (!sugov_enable)
+			sysfs_remove_group(cpufreq_global_kobject,
+					   &sugov_attr_group);
+		mutex_unlock(&sugov_mutex);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		sg_policy = per_cpu(sugov_cpu, cpu).sg_policy;
+
+		mutex_lock(&sg_policy->work_lock);
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy, policy->max,
+						CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy, policy->min,
+						CPUFREQ_RELATION_L);
+		mutex_unlock(&sg_policy->work_lock);
+		break;
+	}
+	return 0;
+}
+
+static int __init cpufreq_gov_schedutil_init(void)
+{
+	return cpufreq_register_governor(&cpufreq_gov_schedutil);
+}
+
+static void __exit cpufreq_gov_schedutil_exit(void)
+{
+	cpufreq_unregister_governor(&cpufreq_gov_schedutil);
+}
+
+MODULE_DESCRIPTION("'cpufreq_schedutil' - A cpufreq governor driven by "
+	"scheduler utilization data");
+MODULE_LICENSE("GPL");
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+fs_initcall(cpufreq_gov_schedutil_init);
+#else
+module_init(cpufreq_gov_schedutil_init);
+#endif
+module_exit(cpufreq_gov_schedutil_exit);
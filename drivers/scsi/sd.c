@@ -559,13 +559,32 @@ static void sd_config_discard(struct scsi_disk *sdkp, unsigned int mode)
 	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, q);
 }
 
+/*
+ * Zero ranges with WRITE SAME only on devices that report a WRITE SAME
+ * limit in the Block Limits VPD page: plenty of USB bridges and cheap
+ * disks do not cope with commands they never advertised.
+ */
+static void sd_config_write_zeroes(struct scsi_disk *sdkp)
+{
+	struct request_queue *q = sdkp->disk->queue;
+	unsigned int logical_block_size = sdkp->device->sector_size;
+	unsigned int max_blocks = 0;
+
+	if (sdkp->max_ws_blocks && !sdkp->no_write_zeroes)
+		max_blocks = min_t(u32, sdkp->max_ws_blocks, 0xffff);
+
+	blk_queue_max_write_zeroes_sectors(q,
+			max_blocks * (logical_block_size >> 9));
+}
+
 /**
  * scsi_setup_discard_cmnd - unmap blocks on thinly provisioned device
  * @sdp: scsi device to operate one
  * @rq: Request to prepare
  *
  * Will issue either UNMAP or WRITE SAME(16) depending on preference
- * indicated by target device.
+ * indicated by target device.  Write zeroes requests always use WRITE SAME
+ * without the UNMAP bit, and a zeroed payload.
  **/
 static int scsi_setup_discard_cmnd(struct scsi_device *sdp, struct request *rq)
 {
@@ -573,6 +592,7 @@ static int scsi_setup_discard_cmnd(struct scsi_device *sdp, struct request *rq)
 	struct bio *bio = rq->bio;
 	sector_t sector = bio->bi_sector;
 	unsigned int nr_sectors = bio_sectors(bio);
+	unsigned int mode = sdkp->provisioning_mode;
 	unsigned int len;
 	int ret;
 	char *buf;
@@ -583,6 +603,10 @@ static int scsi_setup_discard_cmnd(struct scsi_device *sdp, struct request *rq)
 		nr_sectors >>= 3;
 	}
 
+	if (rq->cmd_flags & REQ_WRITE_ZEROES)
+		mode = sector + nr_sectors > 0xffffffff ?
+			SD_LBP_WS16 : SD_LBP_ZERO;
+
 	rq->timeout = SD_TIMEOUT;
 
 	memset(rq->cmd, 0, rq->cmd_len);
@@ -591,7 +615,7 @@ static int scsi_setup_discard_cmnd(struct scsi_device *sdp, struct request *rq)
 	if (!page)
 		return BLKPREP_DEFER;
 
-	switch (sdkp->provisioning_mode) {
+	switch (mode) {
 	case SD_LBP_UNMAP:
 		buf = page_address(page);
 
@@ -610,7 +634,8 @@ static int scsi_setup_discard_cmnd(struct scsi_device *sdp, struct request *rq)
 	case SD_LBP_WS16:
 		rq->cmd_len = 16;
 		rq->cmd[0] = WRITE_SAME_16;
-		rq->cmd[1] = 0x8; /* UNMAP */
+		if (!(rq->cmd_flags & REQ_WRITE_ZEROES))
+			rq->cmd[1] = 0x8; /* UNMAP */
 		put_unaligned_be64(sector, &rq->cmd[2]);
 		put_unaligned_be32(nr_sectors, &rq->cmd[10]);
 
@@ -621,7 +646,7 @@ static int scsi_setup_discard_cmnd(struct scsi_device *sdp, struct request *rq)
 	case SD_LBP_ZERO:
 		rq->cmd_len = 10;
 		rq->cmd[0] = WRITE_SAME;
-		if (sdkp->provisioning_mode == SD_LBP_WS10)
+		if (mode == SD_LBP_WS10)
 			rq->cmd[1] = 0x8; /* UNMAP */
 		put_unaligned_be32(sector, &rq->cmd[2]);
 		put_unaligned_be16(nr_sectors, &rq->cmd[7]);
@@ -1515,8 +1540,13 @@ static int sd_done(struct scsi_cmnd *SCpnt)
 			good_bytes = sd_completed_bytes(SCpnt);
 		/* INVALID COMMAND OPCODE or INVALID FIELD IN CDB */
 		if ((sshdr.asc == 0x20 || sshdr.asc == 0x24) &&
-		    (op == UNMAP || op == WRITE_SAME_16 || op == WRITE_SAME))
-			sd_config_discard(sdkp, SD_LBP_DISABLE);
+		    (op == UNMAP || op == WRITE_SAME_16 || op == WRITE_SAME)) {
+			if (SCpnt->request->cmd_flags & REQ_WRITE_ZEROES) {
+				sdkp->no_write_zeroes = 1;
+				sd_config_write_zeroes(sdkp);
+			} else
+				sd_config_discard(sdkp, SD_LBP_DISABLE);
+		}
 		break;
 	default:
 		break;
@@ -2492,6 +2522,8 @@ static int sd_revalidate_disk(struct gendisk *disk)
 			sd_read_block_characteristics(sdkp);
 		}
 
+		sd_config_write_zeroes(sdkp);
+
 		sd_read_write_protect_flag(sdkp, buffer);
 		sd_read_cache_type(sdkp, buffer);
 		sd_read_app_tag_own(sdkp, buffer);
@@ -77,6 +77,7 @@ struct scsi_disk {
 	unsigned	lbpws : 1;
 	unsigned	lbpws10 : 1;
 	unsigned	lbpvpd : 1;
+	unsigned	no_write_zeroes : 1;	/* WRITE SAME zeroing failed */
 };
 #define to_scsi_disk(obj) container_of(obj,struct scsi_disk,dev)
 
@@ -0,0 +1,653 @@
+/*
+ * zswap.c - compressed cache for swap pages
+ *
+ * Zswap is a frontswap backend that compresses pages as they are swapped
+ * out and keeps them in a zsmalloc pool instead of writing them to the swap
+ * device.  Swapping them back in only costs a decompression.
+ *
+ * The pool is bounded by max_pool_percent of RAM.  When a store finds the
+ * pool full, the least recently stored or loaded entries of that swap
+ * device are decompressed into the swap cache and written out to the swap
+ * device, making room for the new page.  If that does not help, the store
+ * is rejected and the page goes to the swap device as usual.
+ *
+ * Zswap is disabled unless "zswap.enabled=1" is given on the kernel
+ * command line.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#define pr_fmt(fmt) "zswap: " fmt
+
+#include <linux/module.h>
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/lzo.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/pagemap.h>
+#include <linux/writeback.h>
+#include <linux/frontswap.h>
+#include <linux/debugfs.h>
+
+#include "../zsmalloc/zsmalloc.h"
+
+/*
+ * Pages that compress worse than this are not worth keeping in memory.
+ */
+#define ZSWAP_MAX_COMPRESSED	(PAGE_SIZE * 3 / 4)
+
+/*
+ * Entries written back per store that finds the pool full.  Freeing
+ * compressed objects does not always free whole pool pages, so a few may
+ * be needed before the pool shrinks.
+ */
+#define ZSWAP_WRITEBACK_BATCH	16
+
+static bool zswap_enabled;
+module_param_named(enabled, zswap_enabled, bool, 0444);
+
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/*
+ * Statistics, exported in debugfs.  They are only updated, never used for
+ * decisions, so no locking.
+ */
+static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
+static u64 zswap_pool_limit_hit;
+static u64 zswap_written_back_pages;
+static u64 zswap_writeback_fail;
+static u64 zswap_reject_compress_poor;
+static u64 zswap_reject_alloc_fail;
+static u64 zswap_reject_kmemcache_fail;
+static u64 zswap_duplicate_entry;
+
+/*
+ * One entry per compressed page.  The tree holds a reference for as long
+ * as the entry is in its rbtree; writeback holds another while it works
+ * on the entry outside the tree lock.
+ */
+struct zswap_entry {
+	struct rb_node		rbnode;
+	struct list_head	lru;
+	pgoff_t			offset;
+	int			refcount;
+	unsigned int		length;
+	unsigned long		handle;
+};
+
+/*
+ * One tree per swap device.  The lock protects the rbtree, the LRU list
+ * and entry refcounts.  The LRU list runs from least to most recently
+ * used; entries being written back are off the list.
+ */
+struct zswap_tree {
+	struct rb_root		rbroot;
+	struct list_head	lru;
+	spinlock_t		lock;
+	unsigned int		type;
+};
+
+static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
+static struct zs_pool *zswap_pool;
+static struct kmem_cache *zswap_entry_cache;
+
+static DEFINE_PER_CPU(unsigned char *, zswap_dstmem);
+static DEFINE_PER_CPU(void *, zswap_workmem);
+
+static bool zswap_is_full(void)
+{
+	u64 pool_pages = zs_get_total_size_bytes(zswap_pool) >> PAGE_SHIFT;
+
+	return pool_pages > totalram_pages * zswap_max_pool_percent / 100;
+}
+
+/*********************************
+* rbtree functions
+**********************************/
+static struct zswap_entry *zswap_rb_search(struct rb_root *root, pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (entry->offset > offset)
+			node = node->rb_left;
+		else if (entry->offset < offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Returns the entry already in the tree for the same offset, if any, in
+ * which case @entry is not inserted.
+ */
+static struct zswap_entry *zswap_rb_insert(struct rb_root *root,
+					   struct zswap_entry *entry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *myentry;
+
+	while (*link) {
+		parent = *link;
+		myentry = rb_entry(parent, struct zswap_entry, rbnode);
+		if (myentry->offset > entry->offset)
+			link = &(*link)->rb_left;
+		else if (myentry->offset < entry->offset)
+			link = &(*link)->rb_right;
+		else
+			return myentry;
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+	return NULL;
+}
+
+/*********************************
+* entry functions
+**********************************/
+static struct zswap_entry *zswap_entry_alloc(gfp_t gfp)
+{
+	struct zswap_entry *entry;
+
+	entry = kmem_cache_alloc(zswap_entry_cache, gfp);
+	if (!entry)
+		return NULL;
+	entry->refcount = 1;
+	INIT_LIST_HEAD(&entry->lru);
+	return entry;
+}
+
+/* Drop a reference, freeing the entry with the last one.  Tree lock held. */
+static void zswap_entry_put(struct zswap_entry *entry)
+{
+	if (--entry->refcount)
+		return;
+
+	zs_free(zswap_pool, entry->handle);
+	atomic_dec(&zswap_stored_pages);
+	kmem_cache_free(zswap_entry_cache, entry);
+}
+
+/* Take @entry out of the tree and drop the tree's reference.  Tree lock held. */
+static void zswap_entry_erase(struct zswap_tree *tree, struct zswap_entry *entry)
+{
+	rb_erase(&entry->rbnode, &tree->rbroot);
+	list_del_init(&entry->lru);
+	zswap_entry_put(entry);
+}
+
+/*********************************
+* compression
+**********************************/
+static int zswap_compress(struct page *page, unsigned char *dst, size_t *dlen)
+{
+	unsigned char *src;
+	int ret;
+
+	src = kmap_atomic(page);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, dlen,
+			       __get_cpu_var(zswap_workmem));
+	kunmap_atomic(src);
+
+	return ret == LZO_E_OK ? 0 : -EINVAL;
+}
+
+static int zswap_decompress(struct zswap_entry *entry, struct page *page)
+{
+	unsigned char *src, *dst;
+	size_t dlen = PAGE_SIZE;
+	int ret;
+
+	src = zs_map_object(zswap_pool, entry->handle, ZS_MM_RO);
+	dst = kmap_atomic(page);
+	ret = lzo1x_decompress_safe(src, entry->length, dst, &dlen);
+	kunmap_atomic(dst);
+	zs_unmap_object(zswap_pool, entry->handle);
+
+	if (ret != LZO_E_OK || dlen != PAGE_SIZE)
+		return -EINVAL;
+	return 0;
+}
+
+/*********************************
+* writeback
+**********************************/
+
+/*
+ * Decompress @entry into a new swap cache page and start writing it to the
+ * swap device.  Returns -EEXIST if the page is already in the swap cache,
+ * in which case it is going to be written or freed from there anyway.
+ */
+static int zswap_writeback_entry(struct zswap_tree *tree,
+				 struct zswap_entry *entry)
+{
+	swp_entry_t swpentry = swp_entry(tree->type, entry->offset);
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+	};
+	bool page_was_allocated;
+	struct page *page;
+	int ret;
+
+	page = __read_swap_cache_async(swpentry, GFP_KERNEL, NULL, 0,
+				       &page_was_allocated);
+	if (!page)
+		/* out of memory, or the swap entry was freed meanwhile */
+		return -ENOMEM;
+
+	if (!page_was_allocated) {
+		page_cache_release(page);
+		return -EEXIST;
+	}
+
+	ret = zswap_decompress(entry, page);
+	if (WARN_ON_ONCE(ret)) {
+		/* leave the entry where it is */
+		delete_from_swap_cache(page);
+		unlock_page(page);
+		page_cache_release(page);
+		return ret;
+	}
+	SetPageUptodate(page);
+
+	/* move it to the tail of the inactive list after end_writeback */
+	SetPageReclaim(page);
+
+	__swap_writepage(page, &wbc);
+	page_cache_release(page);
+
+	return 0;
+}
+
+/*
+ * Write back the least recently used entry of @tree.
+ */
+static int zswap_writeback_one(struct zswap_tree *tree)
+{
+	struct zswap_entry *entry;
+	int ret;
+
+	spin_lock(&tree->lock);
+	if (list_empty(&tree->lru)) {
+		spin_unlock(&tree->lock);
+		return -ENOENT;
+	}
+	entry = list_first_entry(&tree->lru, struct zswap_entry, lru);
+	list_del_init(&entry->lru);
+	entry->refcount++;
+	spin_unlock(&tree->lock);
+
+	ret = zswap_writeback_entry(tree, entry);
+
+	spin_lock(&tree->lock);
+	/* unless it was invalidated meanwhile */
+	if (zswap_rb_search(&tree->rbroot, entry->offset) == entry) {
+		if (!ret)
+			zswap_entry_erase(tree, entry);
+		else
+			/* retry it last */
+			list_add_tail(&entry->lru, &tree->lru);
+	}
+	zswap_entry_put(entry);
+	spin_unlock(&tree->lock);
+
+	if (ret)
+		zswap_writeback_fail++;
+	else
+		zswap_written_back_pages++;
+
+	return ret;
+}
+
+/*********************************
+* frontswap hooks
+**********************************/
+static int zswap_frontswap_store(unsigned type, pgoff_t offset,
+				 struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry, *dupentry;
+	unsigned char *dst, *buf;
+	size_t dlen;
+	unsigned long handle;
+	int i, ret;
+
+	if (!tree)
+		return -ENODEV;
+
+	if (zswap_is_full()) {
+		zswap_pool_limit_hit++;
+		for (i = 0; i < ZSWAP_WRITEBACK_BATCH && zswap_is_full(); i++)
+			if (zswap_writeback_one(tree) == -ENOENT)
+				break;
+		if (zswap_is_full()) {
+			ret = -ENOMEM;
+			goto reject;
+		}
+	}
+
+	entry = zswap_entry_alloc(GFP_KERNEL);
+	if (!entry) {
+		zswap_reject_kmemcache_fail++;
+		ret = -ENOMEM;
+		goto reject;
+	}
+
+	/*
+	 * The per-cpu buffers are used with preemption disabled, so the pool
+	 * allocation below must not sleep.
+	 */
+	dst = get_cpu_var(zswap_dstmem);
+	ret = zswap_compress(page, dst, &dlen);
+	if (ret)
+		goto put_dstmem;
+
+	if (dlen > ZSWAP_MAX_COMPRESSED) {
+		zswap_reject_compress_poor++;
+		ret = -E2BIG;
+		goto put_dstmem;
+	}
+
+	handle = zs_malloc(zswap_pool, dlen);
+	if (!handle) {
+		zswap_reject_alloc_fail++;
+		ret = -ENOMEM;
+		goto put_dstmem;
+	}
+
+	buf = zs_map_object(zswap_pool, handle, ZS_MM_WO);
+	memcpy(buf, dst, dlen);
+	zs_unmap_object(zswap_pool, handle);
+	put_cpu_var(zswap_dstmem);
+
+	entry->offset = offset;
+	entry->handle = handle;
+	entry->length = dlen;
+	atomic_inc(&zswap_stored_pages);
+
+	spin_lock(&tree->lock);
+	while ((dupentry = zswap_rb_insert(&tree->rbroot, entry))) {
+		zswap_duplicate_entry++;
+		zswap_entry_erase(tree, dupentry);
+	}
+	list_add_tail(&entry->lru, &tree->lru);
+	spin_unlock(&tree->lock);
+
+	return 0;
+
+put_dstmem:
+	put_cpu_var(zswap_dstmem);
+	kmem_cache_free(zswap_entry_cache, entry);
+reject:
+	/*
+	 * The page goes to disk now.  Drop an older copy of it, or writeback
+	 * could later write that over the newer data on disk.
+	 */
+	spin_lock(&tree->lock);
+	dupentry = zswap_rb_search(&tree->rbroot, offset);
+	if (dupentry)
+		zswap_entry_erase(tree, dupentry);
+	spin_unlock(&tree->lock);
+	return ret;
+}
+
+static int zswap_frontswap_load(unsigned type, pgoff_t offset,
+				struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	int ret;
+
+	if (!tree)
+		return -ENODEV;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (!entry) {
+		/* written back, or never stored */
+		spin_unlock(&tree->lock);
+		return -ENOENT;
+	}
+	entry->refcount++;
+	spin_unlock(&tree->lock);
+
+	ret = zswap_decompress(entry, page);
+	WARN_ON_ONCE(ret);
+
+	spin_lock(&tree->lock);
+	/* recently used; unless writeback has taken it off the list */
+	if (!list_empty(&entry->lru))
+		list_move_tail(&entry->lru, &tree->lru);
+	zswap_entry_put(entry);
+	spin_unlock(&tree->lock);
+
+	return ret;
+}
+
+static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (entry)
+		zswap_entry_erase(tree, entry);
+	spin_unlock(&tree->lock);
+}
+
+static void zswap_frontswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct rb_node *node;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot)))
+		zswap_entry_erase(tree,
+				  rb_entry(node, struct zswap_entry, rbnode));
+	spin_unlock(&tree->lock);
+}
+
+static void zswap_frontswap_init(unsigned type)
+{
+	struct zswap_tree *tree;
+
+	if (zswap_trees[type])
+		return;
+
+	tree = kzalloc(sizeof(*tree), GFP_KERNEL);
+	if (!tree) {
+		pr_err("alloc failed, zswap disabled for swap type %d\n", type);
+		return;
+	}
+	tree->rbroot = RB_ROOT;
+	INIT_LIST_HEAD(&tree->lru);
+	spin_lock_init(&tree->lock);
+	tree->type = type;
+	zswap_trees[type] = tree;
+}
+
+static struct frontswap_ops zswap_frontswap_ops = {
+	.store = zswap_frontswap_store,
+	.load = zswap_frontswap_load,
+	.invalidate_page = zswap_frontswap_invalidate_page,
+	.invalidate_area = zswap_frontswap_invalidate_area,
+	.init = zswap_frontswap_init
+};
+
+/*********************************
+* debugfs functions
+**********************************/
+#ifdef CONFIG_DEBUG_FS
+
+static struct dentry *zswap_debugfs_root;
+
+static int zswap_pool_size_get(void *data, u64 *val)
+{
+	*val = zs_get_total_size_bytes(zswap_pool);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_pool_size_fops, zswap_pool_size_get,
+			NULL, "%llu\n");
+
+static int zswap_stored_pages_get(void *data, u64 *val)
+{
+	*val = atomic_read(&zswap_stored_pages);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_stored_pages_fops, zswap_stored_pages_get,
+			NULL, "%llu\n");
+
+/* Uncompressed size of the stored pages as a percentage of the pool size */
+static int zswap_compression_ratio_get(void *data, u64 *val)
+{
+	u64 pool = zs_get_total_size_bytes(zswap_pool);
+	u64 stored = (u64)atomic_read(&zswap_stored_pages) << PAGE_SHIFT;
+
+	*val = pool ? div64_u64(stored * 100, pool) : 0;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_compression_ratio_fops,
+			zswap_compression_ratio_get, NULL, "%llu\n");
+
+static int __init zswap_debugfs_init(void)
+{
+	if (!debugfs_initialized())
+		return -ENODEV;
+
+	zswap_debugfs_root = debugfs_create_dir("zswap", NULL);
+	if (!zswap_debugfs_root)
+		return -ENOMEM;
+
+	debugfs_create_file("pool_total_size", S_IRUGO,
+			zswap_debugfs_root, NULL, &zswap_pool_size_fops);
+	debugfs_create_file("compression_ratio", S_IRUGO,
+			zswap_debugfs_root, NULL,
+			&zswap_compression_ratio_fops);
+	debugfs_create_file("stored_pages", S_IRUGO,
+			zswap_debugfs_root, NULL, &zswap_stored_pages_fops);
+	debugfs_create_u64("pool_limit_hit", S_IRUGO,
+			zswap_debugfs_root, &zswap_pool_limit_hit);
+	debugfs_create_u64("written_back_pages", S_IRUGO,
+			zswap_debugfs_root, &zswap_written_back_pages);
+	debugfs_create_u64("writeback_fail", S_IRUGO,
+			zswap_debugfs_root, &zswap_writeback_fail);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_alloc_fail);
+	debugfs_create_u64("reject_kmemcache_fail", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_kmemcache_fail);
+	debugfs_create_u64("duplicate_entry", S_IRUGO,
+			zswap_debugfs_root, &zswap_duplicate_entry);
+
+	return 0;
+}
+#else
+static int __init zswap_debugfs_init(void)
+{
+	return 0;
+}
+#endif
+
+/*********************************
+* module init
+**********************************/
+static int __init zswap_percpu_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		unsigned char *dst;
+		void *workmem;
+
+		dst = kmalloc_node(2 * PAGE_SIZE, GFP_KERNEL, cpu_to_node(cpu));
+		workmem = kmalloc_node(LZO1X_MEM_COMPRESS, GFP_KERNEL,
+				       cpu_to_node(cpu));
+		per_cpu(zswap_dstmem, cpu) = dst;
+		per_cpu(zswap_workmem, cpu) = workmem;
+		if (!dst || !workmem)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static void zswap_percpu_free(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zswap_dstmem, cpu));
+		kfree(per_cpu(zswap_workmem, cpu));
+		per_cpu(zswap_dstmem, cpu) = NULL;
+		per_cpu(zswap_workmem, cpu) = NULL;
+	}
+}
+
+static int __init zswap_init(void)
+{
+	struct frontswap_ops old_ops;
+
+	if (!zswap_enabled)
+		return 0;
+
+	pr_info("loading zswap\n");
+
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	if (!zswap_entry_cache)
+		goto error;
+
+	zswap_pool = zs_create_pool("zswap",
+			__GFP_NORETRY | __GFP_NOWARN | __GFP_HIGHMEM);
+	if (!zswap_pool)
+		goto pool_fail;
+
+	if (zswap_percpu_init())
+		goto percpu_fail;
+
+	old_ops = frontswap_register_ops(&zswap_frontswap_ops);
+	if (old_ops.init != NULL)
+		pr_warning("frontswap_ops overridden\n");
+
+	if (zswap_debugfs_init())
+		pr_warning("debugfs initialization failed\n");
+
+	return 0;
+
+percpu_fail:
+	zswap_percpu_free();
+	zs_destroy_pool(zswap_pool);
+pool_fail:
+	kmem_cache_destroy(zswap_entry_cache);
+error:
+	pr_err("initialization failed, zswap disabled\n");
+	zswap_enabled = false;
+	return -ENOMEM;
+}
+/* must be late so that zsmalloc is set up */
+late_initcall(zswap_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed cache for swap pages");
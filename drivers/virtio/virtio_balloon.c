@@ -27,6 +27,7 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/page_reporting.h>
 
 /*
  * Balloon device works in 4K page units.  So each page is pointed to by
@@ -38,7 +39,7 @@
 struct virtio_balloon
 {
 	struct virtio_device *vdev;
-	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq;
+	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq, *reporting_vq;
 
 	/* Where the ballooning thread waits for config to change. */
 	wait_queue_head_t config_change;
@@ -65,6 +66,9 @@ struct virtio_balloon
 	/* Memory statistics */
 	int need_stats_update;
 	struct virtio_balloon_stat stats[VIRTIO_BALLOON_S_NR];
+
+	/* Free page reporting, with VIRTIO_BALLOON_F_REPORTING */
+	struct page_reporting_dev_info pr_dev_info;
 };
 
 static struct virtio_device_id id_table[] = {
@@ -110,6 +114,29 @@ static void tell_host(struct virtio_balloon *vb, struct virtqueue *vq)
 	wait_event(vb->acked, virtqueue_get_buf(vq, &len));
 }
 
+/*
+ * Tell the host about free blocks of guest memory it may reclaim.  The
+ * blocks are passed as buffers for the host to "write": it only uses their
+ * addresses, and is done with them once it returns the buffer.
+ */
+static int virtballoon_free_page_report(struct page_reporting_dev_info *pr,
+					struct scatterlist *sg,
+					unsigned int nents)
+{
+	struct virtio_balloon *vb =
+		container_of(pr, struct virtio_balloon, pr_dev_info);
+	struct virtqueue *vq = vb->reporting_vq;
+	unsigned int len;
+
+	if (virtqueue_add_buf(vq, sg, 0, nents, vb, GFP_KERNEL) < 0)
+		return -ENOSPC;
+	virtqueue_kick(vq);
+
+	/* When host has read buffer, this completes via balloon_ack */
+	wait_event(vb->acked, virtqueue_get_buf(vq, &len));
+	return 0;
+}
+
 static void set_page_pfns(u32 pfns[], struct page *page)
 {
 	unsigned int i;
@@ -306,25 +333,35 @@ static int balloon(void *_vballoon)
 
 static int init_vqs(struct virtio_balloon *vb)
 {
-	struct virtqueue *vqs[3];
-	vq_callback_t *callbacks[] = { balloon_ack, balloon_ack, stats_request };
-	const char *names[] = { "inflate", "deflate", "stats" };
-	int err, nvqs;
+	struct virtqueue *vqs[4];
+	vq_callback_t *callbacks[4] = { balloon_ack, balloon_ack };
+	const char *names[4] = { "inflate", "deflate" };
+	int err, nvqs = 2, stats = -1, reporting = -1;
 
 	/*
 	 * We expect two virtqueues: inflate and deflate, and
-	 * optionally stat.
+	 * optionally stat and page reporting, in that order.
 	 */
-	nvqs = virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ) ? 3 : 2;
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+		stats = nvqs++;
+		callbacks[stats] = stats_request;
+		names[stats] = "stats";
+	}
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING)) {
+		reporting = nvqs++;
+		callbacks[reporting] = balloon_ack;
+		names[reporting] = "reporting";
+	}
 	err = vb->vdev->config->find_vqs(vb->vdev, nvqs, vqs, callbacks, names);
 	if (err)
 		return err;
 
 	vb->inflate_vq = vqs[0];
 	vb->deflate_vq = vqs[1];
-	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+	vb->reporting_vq = reporting < 0 ? NULL : vqs[reporting];
+	if (stats >= 0) {
 		struct scatterlist sg;
-		vb->stats_vq = vqs[2];
+		vb->stats_vq = vqs[stats];
 
 		/*
 		 * Prime this virtqueue with one buffer so the hypervisor can
@@ -339,6 +376,15 @@ static int init_vqs(struct virtio_balloon *vb)
 	return 0;
 }
 
+/* Only one balloon can report free pages: others just balloon */
+static void start_reporting(struct virtio_balloon *vb)
+{
+	if (vb->reporting_vq && page_reporting_register(&vb->pr_dev_info)) {
+		dev_info(&vb->vdev->dev, "free page reporting already in use\n");
+		vb->reporting_vq = NULL;
+	}
+}
+
 static int virtballoon_probe(struct virtio_device *vdev)
 {
 	struct virtio_balloon *vb;
@@ -357,6 +403,8 @@ static int virtballoon_probe(struct virtio_device *vdev)
 	vb->vdev = vdev;
 	vb->need_stats_update = 0;
 
+	vb->pr_dev_info.report = virtballoon_free_page_report;
+
 	err = init_vqs(vb);
 	if (err)
 		goto out_free_vb;
@@ -367,6 +415,7 @@ static int virtballoon_probe(struct virtio_device *vdev)
 		goto out_del_vqs;
 	}
 
+	start_reporting(vb);
 	return 0;
 
 out_del_vqs:
@@ -379,6 +428,9 @@ out:
 
 static void remove_common(struct virtio_balloon *vb)
 {
+	if (vb->reporting_vq)
+		page_reporting_unregister(&vb->pr_dev_info);
+
 	/* There might be pages left in the balloon: free them. */
 	while (vb->num_pages)
 		leak_balloon(vb, vb->num_pages);
@@ -422,6 +474,8 @@ static int virtballoon_restore(struct virtio_device *vdev)
 	if (ret)
 		return ret;
 
+	start_reporting(vb);
+
 	fill_balloon(vb, towards_target(vb));
 	update_balloon_size(vb);
 	return 0;
@@ -431,6 +485,7 @@ static int virtballoon_restore(struct virtio_device *vdev)
 static unsigned int features[] = {
 	VIRTIO_BALLOON_F_MUST_TELL_HOST,
 	VIRTIO_BALLOON_F_STATS_VQ,
+	VIRTIO_BALLOON_F_REPORTING,
 };
 
 static struct virtio_driver virtio_balloon_driver = {
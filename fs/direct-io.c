@@ -130,6 +130,8 @@ struct dio {
 	unsigned long refcount;		/* direct_io_worker() and bios */
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
+	struct request_queue *poll_queue; /* queue to poll for completions */
+	struct task_struct *poller;	/* task polling poll_queue */
 
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
@@ -306,6 +308,10 @@ static void dio_bio_end_io(struct bio *bio, int error)
 	struct dio *dio = bio->bi_private;
 	unsigned long flags;
 
+	if (dio->poll_queue)
+		blk_poll_account(dio->poll_queue,
+				 current == dio->poller && !in_interrupt());
+
 	spin_lock_irqsave(&dio->bio_lock, flags);
 	bio->bi_private = dio->bio_list;
 	dio->bio_list = bio;
@@ -417,8 +423,19 @@ static struct bio *dio_await_one(struct dio *dio)
 	 * completion drops the count, maybe adds to the list, and wakes while
 	 * holding the bio_lock so we don't need set_current_state()'s barrier
 	 * and can call it after testing our condition.
+	 *
+	 * If the queue supports it, reap completions ourselves rather than
+	 * waiting for the interrupt and the wakeup, for as long as nobody
+	 * else needs the CPU.
 	 */
 	while (dio->refcount > 1 && dio->bio_list == NULL) {
+		if (dio->poll_queue && !need_resched()) {
+			spin_unlock_irqrestore(&dio->bio_lock, flags);
+			if (!blk_poll(dio->poll_queue))
+				cpu_relax();
+			spin_lock_irqsave(&dio->bio_lock, flags);
+			continue;
+		}
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
@@ -1164,6 +1181,11 @@ do_blockdev_direct_IO(int rw, struct kiocb *iocb, struct inode *inode,
 	spin_lock_init(&dio->bio_lock);
 	dio->refcount = 1;
 
+	if (bdev && !dio->is_async && blk_queue_poll(bdev_get_queue(bdev))) {
+		dio->poll_queue = bdev_get_queue(bdev);
+		dio->poller = current;
+	}
+
 	/*
 	 * In case of non-aligned buffers, we may need 2 more
 	 * pages since we need to zero out first and last block.
@@ -38,6 +38,7 @@
 #include <asm/io.h>
 #include <asm/mman.h>
 #include <linux/atomic.h>
+#include <linux/llist.h>
 
 /*
  * LOCKING:
@@ -48,11 +49,12 @@
  * 3) ep->lock (spinlock)
  *
  * The acquire order is the one listed above, from 1 to 3.
- * We need a spinlock (ep->lock) because we manipulate objects
- * from inside the poll callback, that might be triggered from
- * a wake_up() that in turn might be called from IRQ context.
- * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
+ * The poll callback, that might be triggered from a wake_up() that in
+ * turn might be called from IRQ context, takes none of them: it hands
+ * ready items over through the lock-less ep->pending list, and those
+ * are moved onto the ready list by whoever holds "mtx" next. The
+ * spinlock (ep->lock) still guards the ready list itself, but it is
+ * never taken from IRQ context. During the event transfer loop (from kernel to
  * user space) we could end up sleeping due a copy_to_user(), so
  * we need a lock that will allow us to sleep. This lock is a
  * mutex (ep->mtx). It is acquired during the event transfer loop,
@@ -88,15 +90,18 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+#define EPOLLINOUT_BITS (POLLIN | POLLOUT)
+
+#define EPOLLEXCLUSIVE_OK_BITS (EPOLLINOUT_BITS | POLLERR | POLLHUP | \
+				EPOLLWAKEUP | EPOLLET | EPOLLEXCLUSIVE)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
 
 #define EP_MAX_EVENTS (INT_MAX / sizeof(struct epoll_event))
 
-#define EP_UNACTIVE_PTR ((void *) -1L)
-
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
 struct epoll_filefd {
@@ -134,11 +139,9 @@ struct epitem {
 	/* List header used to link this structure to the eventpoll ready list */
 	struct list_head rdllink;
 
-	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
-	 * single linked chain of items.
-	 */
-	struct epitem *next;
+	/* Link in "struct eventpoll"->pending, while pending_queued is set */
+	struct llist_node pending_link;
+	int pending_queued;
 
 	/* The file descriptor information this item refers to */
 	struct epoll_filefd ffd;
@@ -192,11 +195,10 @@ struct eventpoll {
 	struct rb_root rbr;
 
 	/*
-	 * This is a single linked list that chains all the "struct epitem" that
-	 * happened while transferring ready events to userspace w/out
-	 * holding ->lock.
+	 * Lock-less list the poll callback pushes the "struct epitem"s that
+	 * became ready to. Drained into ->rdllist under "mtx".
 	 */
-	struct epitem *ovflist;
+	struct llist_head pending;
 
 	/* wakeup_source used when ep_scan_ready_list is running */
 	struct wakeup_source *ws;
@@ -366,7 +368,46 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	return !list_empty(&ep->rdllist) || !llist_empty(&ep->pending);
+}
+
+/*
+ * Move the items queued by ep_poll_callback() onto the ready list, oldest
+ * first, skipping those already on it or on a list being transferred to
+ * user space. Must be called with "mtx" and "ep->lock" held.
+ */
+static void ep_flush_pending(struct eventpoll *ep)
+{
+	struct llist_node *node;
+	struct epitem *epi;
+
+	node = llist_reverse_order(llist_del_all(&ep->pending));
+	while (node) {
+		epi = llist_entry(node, struct epitem, pending_link);
+		node = llist_next(node);
+
+		/* From here on the callback may queue it again */
+		xchg(&epi->pending_queued, 0);
+
+		if (!ep_is_linked(&epi->rdllink)) {
+			list_add_tail(&epi->rdllink, &ep->rdllist);
+			__pm_stay_awake(epi->ws);
+		}
+	}
+}
+
+/*
+ * Wake up a task sleeping in ep_poll() after adding to the ready list.
+ * Those tasks queue themselves on ep->wq without "ep->lock", so the barrier
+ * pairs with their set_current_state(). Returns whether ep->poll_wait needs
+ * a wakeup too, which has to be done with no locks held.
+ */
+static inline int ep_wake_up_waiters(struct eventpoll *ep)
+{
+	smp_mb();
+	if (waitqueue_active(&ep->wq))
+		wake_up(&ep->wq);
+	return waitqueue_active(&ep->poll_wait);
 }
 
 /**
@@ -553,8 +594,6 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 			      int depth)
 {
 	int error, pwake = 0;
-	unsigned long flags;
-	struct epitem *epi, *nepi;
 	LIST_HEAD(txlist);
 
 	/*
@@ -565,47 +604,29 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 
 	/*
 	 * Steal the ready list, and re-init the original one to the
-	 * empty list. Also, set ep->ovflist to NULL so that events
-	 * happening while looping w/out locks, are not lost. We cannot
-	 * have the poll callback to queue directly on ep->rdllist,
-	 * because we want the "sproc" callback to be able to do it
-	 * in a lockless way.
+	 * empty list. The poll callback never touches ep->rdllist, it
+	 * queues on ep->pending, so events happening while looping
+	 * w/out locks are not lost and the "sproc" callback is able to
+	 * walk the stolen list in a lockless way.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	spin_lock(&ep->lock);
+	ep_flush_pending(ep);
 	list_splice_init(&ep->rdllist, &txlist);
-	ep->ovflist = NULL;
-	spin_unlock_irqrestore(&ep->lock, flags);
+	spin_unlock(&ep->lock);
 
 	/*
 	 * Now call the callback function.
 	 */
 	error = (*sproc)(ep, &txlist, priv);
 
-	spin_lock_irqsave(&ep->lock, flags);
+	spin_lock(&ep->lock);
 	/*
 	 * During the time we spent inside the "sproc" callback, some
 	 * other events might have been queued by the poll callback.
-	 * We re-insert them inside the main ready-list here.
-	 */
-	for (nepi = ep->ovflist; (epi = nepi) != NULL;
-	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
-		/*
-		 * We need to check if the item is already in the list.
-		 * During the "sproc" callback execution time, items are
-		 * queued into ->ovflist but the "txlist" might already
-		 * contain them, and the list_splice() below takes care of them.
-		 */
-		if (!ep_is_linked(&epi->rdllink)) {
-			list_add_tail(&epi->rdllink, &ep->rdllist);
-			__pm_stay_awake(epi->ws);
-		}
-	}
-	/*
-	 * We need to set back ep->ovflist to EP_UNACTIVE_PTR, so that after
-	 * releasing the lock, events will be queued in the normal way inside
-	 * ep->rdllist.
+	 * We re-insert them inside the main ready-list here. Those that
+	 * "txlist" still contains are left to the list_splice() below.
 	 */
-	ep->ovflist = EP_UNACTIVE_PTR;
+	ep_flush_pending(ep);
 
 	/*
 	 * Quickly re-inject items left on "txlist".
@@ -613,17 +634,13 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	list_splice(&txlist, &ep->rdllist);
 	__pm_relax(ep->ws);
 
-	if (!list_empty(&ep->rdllist)) {
-		/*
-		 * Wake up (if active) both the eventpoll wait list and
-		 * the ->poll() wait list (delayed after we release the lock).
-		 */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
-		if (waitqueue_active(&ep->poll_wait))
-			pwake++;
-	}
-	spin_unlock_irqrestore(&ep->lock, flags);
+	/*
+	 * Wake up (if active) both the eventpoll wait list and
+	 * the ->poll() wait list (delayed after we release the lock).
+	 */
+	if (!list_empty(&ep->rdllist))
+		pwake = ep_wake_up_waiters(ep);
+	spin_unlock(&ep->lock);
 
 	mutex_unlock(&ep->mtx);
 
@@ -640,16 +657,12 @@ static int ep_scan_ready_list(struct eventpoll *ep,
  */
 static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 {
-	unsigned long flags;
 	struct file *file = epi->ffd.file;
 
 	/*
-	 * Removes poll wait queue hooks. We _have_ to do this without holding
-	 * the "ep->lock" otherwise a deadlock might occur. This because of the
-	 * sequence of the lock acquisition. Here we do "ep->lock" then the wait
-	 * queue head lock when unregistering the wait queue. The wakeup callback
-	 * will run by holding the wait queue head lock and will call our callback
-	 * that will try to get "ep->lock".
+	 * Removes poll wait queue hooks. Once this returns the poll callback
+	 * can no longer run for this item, so it cannot queue it again on
+	 * ep->pending behind our back.
 	 */
 	ep_unregister_pollwait(ep, epi);
 
@@ -661,10 +674,12 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase(&epi->rbn, &ep->rbr);
 
-	spin_lock_irqsave(&ep->lock, flags);
+	/* The item may still sit on ep->pending, flush it out first */
+	spin_lock(&ep->lock);
+	ep_flush_pending(ep);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	spin_unlock(&ep->lock);
 
 	wakeup_source_unregister(epi->ws);
 
@@ -846,8 +861,8 @@ static int ep_alloc(struct eventpoll **pep)
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
 	INIT_LIST_HEAD(&ep->rdllist);
+	init_llist_head(&ep->pending);
 	ep->rbr = RB_ROOT;
-	ep->ovflist = EP_UNACTIVE_PTR;
 	ep->user = user;
 
 	*pep = ep;
@@ -892,11 +907,15 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  * This is the callback that is passed to the wait queue wakeup
  * mechanism. It is called by the stored file descriptors when they
  * have events to report.
+ *
+ * For an EPOLLEXCLUSIVE item, which sits on the target's wait queue as an
+ * exclusive entry, return 0 unless a waiter on this epoll instance was
+ * actually woken, so that the wakeup moves on to the next instance.
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
 	int pwake = 0;
-	unsigned long flags;
+	int ewake = 0;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 
@@ -911,8 +930,6 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 		list_del_init(&wait->task_list);
 	}
 
-	spin_lock_irqsave(&ep->lock, flags);
-
 	/*
 	 * If the event mask does not contain any poll(2) event, we consider the
 	 * descriptor to be disabled. This condition is likely the effect of the
@@ -920,7 +937,7 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * until the next EPOLL_CTL_MOD will be issued.
 	 */
 	if (!(epi->event.events & ~EP_PRIVATE_BITS))
-		goto out_unlock;
+		goto out;
 
 	/*
 	 * Check the events coming with the callback. At this stage, not
@@ -929,53 +946,54 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * test for "key" != NULL before the event match test.
 	 */
 	if (key && !((unsigned long) key & epi->event.events))
-		goto out_unlock;
+		goto out;
 
 	/*
-	 * If we are transferring events to userspace, we can hold no locks
-	 * (because we're accessing user memory, and because of linux f_op->poll()
-	 * semantics). All the events that happen during that period of time are
-	 * chained in ep->ovflist and requeued later on.
+	 * Hand the item over without taking any lock: whoever holds "mtx"
+	 * next moves it from ep->pending to the ready list. This also covers
+	 * events happening while ready events are being transferred to
+	 * userspace. If the item is already queued we exit soon.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
-			if (epi->ws) {
-				/*
-				 * Activate ep->ws since epi->ws may get
-				 * deactivated at any time.
-				 */
-				__pm_stay_awake(ep->ws);
-			}
-
-		}
-		goto out_unlock;
-	}
-
-	/* If this file is already in the ready list we exit soon */
-	if (!ep_is_linked(&epi->rdllink)) {
-		list_add_tail(&epi->rdllink, &ep->rdllist);
+	if (!cmpxchg(&epi->pending_queued, 0, 1)) {
 		__pm_stay_awake(epi->ws);
+		llist_add(&epi->pending_link, &ep->pending);
 	}
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
-	 * wait list.
+	 * wait list. The barrier pairs with set_current_state() in ep_poll().
 	 */
-	if (waitqueue_active(&ep->wq))
-		wake_up_locked(&ep->wq);
+	smp_mb();
+	if (waitqueue_active(&ep->wq)) {
+		if ((epi->event.events & EPOLLEXCLUSIVE) &&
+		    !((unsigned long)key & POLLFREE)) {
+			switch ((unsigned long)key & EPOLLINOUT_BITS) {
+			case POLLIN:
+				if (epi->event.events & POLLIN)
+					ewake = 1;
+				break;
+			case POLLOUT:
+				if (epi->event.events & POLLOUT)
+					ewake = 1;
+				break;
+			case 0:
+				ewake = 1;
+				break;
+			}
+		}
+		wake_up(&ep->wq);
+	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
-out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
-
-	/* We have to call this outside the lock */
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	return 1;
+out:
+	if (!(epi->event.events & EPOLLEXCLUSIVE))
+		ewake = 1;
+
+	return ewake;
 }
 
 /*
@@ -992,7 +1010,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -1146,7 +1167,6 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		     struct file *tfile, int fd)
 {
 	int error, revents, pwake = 0;
-	unsigned long flags;
 	long user_watches;
 	struct epitem *epi;
 	struct ep_pqueue epq;
@@ -1165,7 +1185,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	ep_set_ffd(&epi->ffd, tfile, fd);
 	epi->event = *event;
 	epi->nwait = 0;
-	epi->next = EP_UNACTIVE_PTR;
+	epi->pending_queued = 0;
 	if (epi->event.events & EPOLLWAKEUP) {
 		error = ep_create_wakeup_source(epi);
 		if (error)
@@ -1214,7 +1234,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		goto error_remove_epi;
 
 	/* We have to drop the new item inside our item list to keep track of it */
-	spin_lock_irqsave(&ep->lock, flags);
+	spin_lock(&ep->lock);
 
 	/* If the file is already "ready" we drop it inside the ready list */
 	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
@@ -1222,13 +1242,10 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		__pm_stay_awake(epi->ws);
 
 		/* Notify waiting tasks that events are available */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
-		if (waitqueue_active(&ep->poll_wait))
-			pwake++;
+		pwake = ep_wake_up_waiters(ep);
 	}
 
-	spin_unlock_irqrestore(&ep->lock, flags);
+	spin_unlock(&ep->lock);
 
 	atomic_long_inc(&ep->user->epoll_watches);
 
@@ -1251,14 +1268,13 @@ error_unregister:
 
 	/*
 	 * We need to do this because an event could have been arrived on some
-	 * allocated wait queue. Note that we don't care about the ep->ovflist
-	 * list, since that is used/cleaned only inside a section bound by "mtx".
-	 * And ep_insert() is called with "mtx" held.
+	 * allocated wait queue, and the item queued on ep->pending.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	spin_lock(&ep->lock);
+	ep_flush_pending(ep);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	spin_unlock(&ep->lock);
 
 	wakeup_source_unregister(epi->ws);
 
@@ -1306,18 +1322,15 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * list, push it inside.
 	 */
 	if (revents & event->events) {
-		spin_lock_irq(&ep->lock);
+		spin_lock(&ep->lock);
 		if (!ep_is_linked(&epi->rdllink)) {
 			list_add_tail(&epi->rdllink, &ep->rdllist);
 			__pm_stay_awake(epi->ws);
 
 			/* Notify waiting tasks that events are available */
-			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
-			if (waitqueue_active(&ep->poll_wait))
-				pwake++;
+			pwake = ep_wake_up_waiters(ep);
 		}
-		spin_unlock_irq(&ep->lock);
+		spin_unlock(&ep->lock);
 	}
 
 	/* We have to call this outside the lock */
@@ -1393,7 +1406,7 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 				 * into ep->rdllist besides us. The epoll_ctl()
 				 * callers are locked out by
 				 * ep_scan_ready_list() holding "mtx" and the
-				 * poll callback will queue them in ep->ovflist.
+				 * poll callback will queue them in ep->pending.
 				 */
 				list_add_tail(&epi->rdllink, &ep->rdllist);
 				__pm_stay_awake(epi->ws);
@@ -1447,7 +1460,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		   int maxevents, long timeout)
 {
 	int res = 0, eavail, timed_out = 0;
-	unsigned long flags;
 	long slack = 0;
 	wait_queue_t wait;
 	ktime_t expires, *to = NULL;
@@ -1464,13 +1476,10 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * caller specified a non blocking operation.
 		 */
 		timed_out = 1;
-		spin_lock_irqsave(&ep->lock, flags);
 		goto check_events;
 	}
 
 fetch_events:
-	spin_lock_irqsave(&ep->lock, flags);
-
 	if (!ep_events_available(ep)) {
 		/*
 		 * We don't have any available event to return to the caller.
@@ -1478,7 +1487,7 @@ fetch_events:
 		 * ep_poll_callback() when events will become available.
 		 */
 		init_waitqueue_entry(&wait, current);
-		__add_wait_queue_exclusive(&ep->wq, &wait);
+		add_wait_queue_exclusive(&ep->wq, &wait);
 
 		for (;;) {
 			/*
@@ -1494,13 +1503,10 @@ fetch_events:
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
 			if (!schedule_hrtimeout_range(to, slack, HRTIMER_MODE_ABS))
 				timed_out = 1;
-
-			spin_lock_irqsave(&ep->lock, flags);
 		}
-		__remove_wait_queue(&ep->wq, &wait);
+		remove_wait_queue(&ep->wq, &wait);
 
 		set_current_state(TASK_RUNNING);
 	}
@@ -1508,8 +1514,6 @@ check_events:
 	/* Is it worth to try to dig for events ? */
 	eavail = ep_events_available(ep);
 
-	spin_unlock_irqrestore(&ep->lock, flags);
-
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
 	 * there's still timeout left over, we go trying again in search of
@@ -1674,35 +1678,23 @@ SYSCALL_DEFINE1(epoll_create, int, size)
 }
 
 /*
- * The following function implements the controller interface for
- * the eventpoll file that enables the insertion/removal/change of
- * file descriptors inside the interest set.
+ * Apply one insertion/removal/change to the interest set of the eventpoll
+ * file @file, which the caller holds a reference to. @epds is only looked
+ * at for the operations that carry an event.
  */
-SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
-		struct epoll_event __user *, event)
+static int ep_ctl(struct file *file, int op, int fd, struct epoll_event *epds)
 {
 	int error;
 	int did_lock_epmutex = 0;
-	struct file *file, *tfile;
+	struct file *tfile;
 	struct eventpoll *ep;
 	struct epitem *epi;
-	struct epoll_event epds;
-
-	error = -EFAULT;
-	if (ep_op_has_event(op) &&
-	    copy_from_user(&epds, event, sizeof(struct epoll_event)))
-		goto error_return;
-
-	/* Get the "struct file *" for the eventpoll file */
-	error = -EBADF;
-	file = fget(epfd);
-	if (!file)
-		goto error_return;
 
 	/* Get the "struct file *" for the target file */
+	error = -EBADF;
 	tfile = fget(fd);
 	if (!tfile)
-		goto error_fput;
+		goto error_return;
 
 	/* The target file descriptor must support poll */
 	error = -EPERM;
@@ -1710,8 +1702,8 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		goto error_tgt_fput;
 
 	/* Check if EPOLLWAKEUP is allowed */
-	if ((epds.events & EPOLLWAKEUP) && !capable(CAP_BLOCK_SUSPEND))
-		epds.events &= ~EPOLLWAKEUP;
+	if ((epds->events & EPOLLWAKEUP) && !capable(CAP_BLOCK_SUSPEND))
+		epds->events &= ~EPOLLWAKEUP;
 
 	/*
 	 * We have to check that the file structure underneath the file descriptor
@@ -1722,6 +1714,19 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (file == tfile || !is_file_epoll(file))
 		goto error_tgt_fput;
 
+	/*
+	 * epoll adds to the wakeup queue at EPOLL_CTL_ADD time only,
+	 * so EPOLLEXCLUSIVE is not allowed for a EPOLL_CTL_MOD operation.
+	 * Also, we do not currently support nested exclusive wakeups.
+	 */
+	if (ep_op_has_event(op) && (epds->events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD)
+			goto error_tgt_fput;
+		if (op == EPOLL_CTL_ADD && (is_file_epoll(tfile) ||
+				(epds->events & ~EPOLLEXCLUSIVE_OK_BITS)))
+			goto error_tgt_fput;
+	}
+
 	/*
 	 * At this point it is safe to assume that the "private_data" contains
 	 * our own data structure.
@@ -1768,8 +1773,8 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	switch (op) {
 	case EPOLL_CTL_ADD:
 		if (!epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_insert(ep, &epds, tfile, fd);
+			epds->events |= POLLERR | POLLHUP;
+			error = ep_insert(ep, epds, tfile, fd);
 		} else
 			error = -EEXIST;
 		clear_tfile_check_list();
@@ -1782,8 +1787,10 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds->events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
@@ -1795,13 +1802,93 @@ error_tgt_fput:
 		mutex_unlock(&epmutex);
 
 	fput(tfile);
-error_fput:
+error_return:
+
+	return error;
+}
+
+/*
+ * The following function implements the controller interface for
+ * the eventpoll file that enables the insertion/removal/change of
+ * file descriptors inside the interest set.
+ */
+SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
+		struct epoll_event __user *, event)
+{
+	int error;
+	struct file *file;
+	struct epoll_event epds;
+
+	error = -EFAULT;
+	if (ep_op_has_event(op) &&
+	    copy_from_user(&epds, event, sizeof(struct epoll_event)))
+		goto error_return;
+
+	/* Get the "struct file *" for the eventpoll file */
+	error = -EBADF;
+	file = fget(epfd);
+	if (!file)
+		goto error_return;
+
+	error = ep_ctl(file, op, fd, &epds);
+
 	fput(file);
 error_return:
 
 	return error;
 }
 
+/*
+ * Vectored epoll_ctl(): apply @ncmds commands to the eventpoll file in
+ * one call, so that re-arming many EPOLLONESHOT descriptors after each
+ * epoll_wait() costs a single system call. The commands are applied in
+ * order and each one's outcome is stored in its result field. We stop at
+ * the first failure and return the number of commands that were applied,
+ * even if storing the last one's result faulted, or the error of the first
+ * command if that one failed.
+ */
+SYSCALL_DEFINE4(epoll_ctl_batch, int, epfd, int, flags, int, ncmds,
+		struct epoll_ctl_cmd __user *, cmds)
+{
+	int i, applied = 0, error = 0;
+	struct file *file;
+	struct epoll_ctl_cmd cmd;
+	struct epoll_event epds;
+
+	if (flags || ncmds < 0)
+		return -EINVAL;
+
+	/* Get the "struct file *" for the eventpoll file */
+	file = fget(epfd);
+	if (!file)
+		return -EBADF;
+
+	for (i = 0; i < ncmds; i++) {
+		if (fatal_signal_pending(current)) {
+			error = -EINTR;
+			break;
+		}
+		if (copy_from_user(&cmd, &cmds[i], sizeof(cmd))) {
+			error = -EFAULT;
+			break;
+		}
+		epds.events = cmd.events;
+		epds.data = cmd.data;
+
+		error = ep_ctl(file, cmd.op, cmd.fd, &epds);
+		if (!error)
+			applied++;
+		if (put_user(error, &cmds[i].result))
+			error = -EFAULT;
+		if (error)
+			break;
+	}
+
+	fput(file);
+
+	return applied ? applied : error;
+}
+
 /*
  * Implement the event wait interface for the eventpoll file. It is the kernel
  * part of the user space epoll_wait(2).
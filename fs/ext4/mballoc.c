@@ -4837,6 +4837,49 @@ error_return:
 	return err;
 }
 
+/*
+ * Free extents of one group whose discards are in flight.  The extents stay
+ * marked used in the buddy bitmap until ext4_trim_batch_flush() has waited
+ * for the discards.
+ */
+#define EXT4_TRIM_BATCH		64
+
+struct ext4_trim_batch {
+	struct blk_discard_batch	discard;
+	int				nr;
+	struct {
+		ext4_grpblk_t		start;
+		ext4_grpblk_t		count;
+	} extents[EXT4_TRIM_BATCH];
+};
+
+/*
+ * Wait for the batched discards and give their extents back to the group.
+ * The extents are freed even if a discard failed.  Returns the first
+ * discard error.  Must be called under the group lock.
+ */
+static int ext4_trim_batch_flush(struct super_block *sb, ext4_group_t group,
+				 struct ext4_buddy *e4b,
+				 struct ext4_trim_batch *tb)
+{
+	int i, ret;
+
+	if (!tb->nr)
+		return 0;
+
+	ext4_unlock_group(sb, group);
+	ret = blk_discard_batch_finish(&tb->discard);
+	ext4_lock_group(sb, group);
+
+	for (i = 0; i < tb->nr; i++)
+		mb_free_blocks(NULL, e4b, tb->extents[i].start,
+			       tb->extents[i].count);
+	tb->nr = 0;
+	blk_discard_batch_init(&tb->discard, sb->s_bdev, GFP_NOFS, 0);
+
+	return ret;
+}
+
 /**
  * ext4_trim_extent -- function to TRIM one single free extent in the group
  * @sb:		super block for the file system
@@ -4844,15 +4887,20 @@ error_return:
  * @count:	number of blocks to TRIM
  * @group:	alloc. group we are working with
  * @e4b:	ext4 buddy for the group
+ * @tb:		batch the discard is queued on
  *
  * Trim "count" blocks starting at "start" in the "group". To assure that no
- * one will allocate those blocks, mark it as used in buddy bitmap. This must
- * be called with under the group lock.
+ * one will allocate those blocks, mark it as used in buddy bitmap until the
+ * batch is flushed. This must be called with under the group lock.
+ * Returns 0 or the first discard error of the batch.
  */
-static void ext4_trim_extent(struct super_block *sb, int start, int count,
-			     ext4_group_t group, struct ext4_buddy *e4b)
+static int ext4_trim_extent(struct super_block *sb, int start, int count,
+			     ext4_group_t group, struct ext4_buddy *e4b,
+			     struct ext4_trim_batch *tb)
 {
 	struct ext4_free_extent ex;
+	ext4_fsblk_t discard_block;
+	int ret;
 
 	trace_ext4_trim_extent(sb, group, start, count);
 
@@ -4867,10 +4915,25 @@ static void ext4_trim_extent(struct super_block *sb, int start, int count,
 	 * being trimmed.
 	 */
 	mb_mark_used(e4b, &ex);
+	tb->extents[tb->nr].start = start;
+	tb->extents[tb->nr].count = ex.fe_len;
+	tb->nr++;
+
+	discard_block = (EXT4_C2B(EXT4_SB(sb), start) +
+			 ext4_group_first_block_no(sb, group));
+	count = EXT4_C2B(EXT4_SB(sb), count);
+	trace_ext4_discard_blocks(sb,
+			(unsigned long long) discard_block, count);
+
 	ext4_unlock_group(sb, group);
-	ext4_issue_discard(sb, group, start, count);
+	ret = blk_discard_batch_add(&tb->discard,
+			discard_block << (sb->s_blocksize_bits - 9),
+			(sector_t)count << (sb->s_blocksize_bits - 9));
 	ext4_lock_group(sb, group);
-	mb_free_blocks(NULL, e4b, start, ex.fe_len);
+
+	if (!ret && tb->nr == EXT4_TRIM_BATCH)
+		ret = ext4_trim_batch_flush(sb, group, e4b, tb);
+	return ret;
 }
 
 /**
@@ -4880,6 +4943,7 @@ static void ext4_trim_extent(struct super_block *sb, int start, int count,
  * @start:		first group block to examine
  * @max:		last group block to examine
  * @minblocks:		minimum extent block count
+ * @tb:			discard batch to use
  *
  * ext4_trim_all_free walks through group's buddy bitmap searching for free
  * extents. When the free block is found, ext4_trim_extent is called to TRIM
@@ -4888,18 +4952,20 @@ static void ext4_trim_extent(struct super_block *sb, int start, int count,
  *
  * ext4_trim_all_free walks through group's block bitmap searching for free
  * extents. When the free extent is found, mark it as used in group buddy
- * bitmap. Then issue a TRIM command on this extent and free the extent in
- * the group buddy bitmap. This is done until whole group is scanned.
+ * bitmap. Then queue a TRIM command on this extent. The TRIM commands are
+ * issued without waiting for each other, and the extents are freed in the
+ * group buddy bitmap once a batch of them has completed. This is done until
+ * whole group is scanned.
  */
 static ext4_grpblk_t
 ext4_trim_all_free(struct super_block *sb, ext4_group_t group,
 		   ext4_grpblk_t start, ext4_grpblk_t max,
-		   ext4_grpblk_t minblocks)
+		   ext4_grpblk_t minblocks, struct ext4_trim_batch *tb)
 {
 	void *bitmap;
-	ext4_grpblk_t next, count = 0, free_count = 0;
+	ext4_grpblk_t next, count = 0;
 	struct ext4_buddy e4b;
-	int ret;
+	int ret, err;
 
 	trace_ext4_trim_all_free(sb, group, start, max);
 
@@ -4926,15 +4992,16 @@ ext4_trim_all_free(struct super_block *sb, ext4_group_t group,
 		next = mb_find_next_bit(bitmap, max + 1, start);
 
 		if ((next - start) >= minblocks) {
-			ext4_trim_extent(sb, start,
-					 next - start, group, &e4b);
+			ret = ext4_trim_extent(sb, start,
+					       next - start, group, &e4b, tb);
+			if (ret)
+				break;
 			count += next - start;
 		}
-		free_count += next - start;
 		start = next + 1;
 
 		if (fatal_signal_pending(current)) {
-			count = -ERESTARTSYS;
+			ret = -ERESTARTSYS;
 			break;
 		}
 
@@ -4944,10 +5011,18 @@ ext4_trim_all_free(struct super_block *sb, ext4_group_t group,
 			ext4_lock_group(sb, group);
 		}
 
-		if ((e4b.bd_info->bb_free - free_count) < minblocks)
+		/*
+		 * Extents still waiting in the batch are already out of
+		 * bb_free, so this is what is left to look at.
+		 */
+		if (e4b.bd_info->bb_free < minblocks)
 			break;
 	}
 
+	err = ext4_trim_batch_flush(sb, group, &e4b, tb);
+	if (!ret)
+		ret = err;
+
 	if (!ret)
 		EXT4_MB_GRP_SET_TRIMMED(e4b.bd_info);
 out:
@@ -4957,7 +5032,7 @@ out:
 	ext4_debug("trimmed %d blocks in the group %d\n",
 		count, group);
 
-	return count;
+	return ret ? ret : count;
 }
 
 /**
@@ -4981,6 +5056,7 @@ int ext4_trim_fs(struct super_block *sb, struct fstrim_range *range)
 	ext4_fsblk_t first_data_blk =
 			le32_to_cpu(EXT4_SB(sb)->s_es->s_first_data_block);
 	ext4_fsblk_t max_blks = ext4_blocks_count(EXT4_SB(sb)->s_es);
+	struct ext4_trim_batch *tb;
 	int ret = 0;
 
 	start = range->start >> sb->s_blocksize_bits;
@@ -5007,6 +5083,12 @@ int ext4_trim_fs(struct super_block *sb, struct fstrim_range *range)
 	/* end now represents the last cluster to discard in this group */
 	end = EXT4_CLUSTERS_PER_GROUP(sb) - 1;
 
+	tb = kmalloc(sizeof(*tb), GFP_NOFS);
+	if (!tb)
+		return -ENOMEM;
+	tb->nr = 0;
+	blk_discard_batch_init(&tb->discard, sb->s_bdev, GFP_NOFS, 0);
+
 	for (group = first_group; group <= last_group; group++) {
 		grp = ext4_get_group_info(sb, group);
 		/* We only do this if the grp has never been initialized */
@@ -5027,7 +5109,7 @@ int ext4_trim_fs(struct super_block *sb, struct fstrim_range *range)
 
 		if (grp->bb_free >= minlen) {
 			cnt = ext4_trim_all_free(sb, group, first_cluster,
-						end, minlen);
+						end, minlen, tb);
 			if (cnt < 0) {
 				ret = cnt;
 				break;
@@ -5041,6 +5123,7 @@ int ext4_trim_fs(struct super_block *sb, struct fstrim_range *range)
 		 */
 		first_cluster = 0;
 	}
+	kfree(tb);
 
 	if (!ret)
 		atomic_set(&EXT4_SB(sb)->s_last_trim_minblks, minlen);
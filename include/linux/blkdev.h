@@ -231,6 +231,7 @@ typedef int (merge_bvec_fn) (struct request_queue *, struct bvec_merge_data *,
 typedef void (softirq_done_fn)(struct request *);
 typedef int (dma_drain_needed_fn)(struct request *);
 typedef int (lld_busy_fn) (struct request_queue *q);
+typedef int (poll_q_fn) (struct request_queue *q);
 typedef int (bsg_job_fn) (struct bsg_job *);
 
 enum blk_eh_timer_return {
@@ -270,6 +271,7 @@ struct queue_limits {
 	unsigned int		io_min;
 	unsigned int		io_opt;
 	unsigned int		max_discard_sectors;
+	unsigned int		max_write_zeroes_sectors;
 	unsigned int		discard_granularity;
 	unsigned int		discard_alignment;
 
@@ -283,6 +285,26 @@ struct queue_limits {
 	unsigned char		discard_zeroes_data;
 };
 
+/*
+ * Per-cpu counters for completion polling, see blk_poll()
+ */
+struct blk_poll_stat {
+	unsigned long		invoked;	/* calls into ->poll_fn */
+	unsigned long		success;	/* calls that reaped completions */
+	unsigned long		polled;		/* waited-on I/O reaped by polling */
+	unsigned long		interrupt;	/* waited-on I/O completed by irq */
+};
+
+/*
+ * Dispatch hold window counters, see blk_queue_hold().  Protected by the
+ * queue lock.
+ */
+struct blk_hold_stat {
+	unsigned long		held;		/* requests whose dispatch waited */
+	unsigned long		windows;	/* hold windows opened */
+	unsigned long		merged;		/* merges while a window was open */
+};
+
 struct request_queue {
 	/*
 	 * Together with queue_head for cacheline sharing
@@ -310,6 +332,7 @@ struct request_queue {
 	rq_timed_out_fn		*rq_timed_out_fn;
 	dma_drain_needed_fn	*dma_drain_needed;
 	lld_busy_fn		*lld_busy_fn;
+	poll_q_fn		*poll_fn;
 
 	/*
 	 * Dispatch queue sorting
@@ -322,6 +345,13 @@ struct request_queue {
 	 */
 	struct delayed_work	delay_work;
 
+	/*
+	 * Dispatch hold window for cross-submitter merging
+	 */
+	unsigned int		hold_usecs;
+	struct hrtimer		hold_timer;
+	struct blk_hold_stat	hold_stat;
+
 	struct backing_dev_info	backing_dev_info;
 
 	/*
@@ -417,6 +447,8 @@ struct request_queue {
 
 	int			bypass_depth;
 
+	struct blk_poll_stat __percpu *poll_stat;
+
 #if defined(CONFIG_BLK_DEV_BSG)
 	bsg_job_fn		*bsg_job_fn;
 	int			bsg_job_size;
@@ -451,6 +483,7 @@ struct request_queue {
 #define QUEUE_FLAG_ADD_RANDOM  16	/* Contributes to random pool */
 #define QUEUE_FLAG_SECDISCARD  17	/* supports SECDISCARD */
 #define QUEUE_FLAG_SAME_FORCE  18	/* force complete on same CPU */
+#define QUEUE_FLAG_POLL        19	/* sync waiters poll for completions */
 
 #define QUEUE_FLAG_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
 				 (1 << QUEUE_FLAG_STACKABLE)	|	\
@@ -528,6 +561,7 @@ static inline void queue_flag_clear(unsigned int flag, struct request_queue *q)
 #define blk_queue_nonrot(q)	test_bit(QUEUE_FLAG_NONROT, &(q)->queue_flags)
 #define blk_queue_io_stat(q)	test_bit(QUEUE_FLAG_IO_STAT, &(q)->queue_flags)
 #define blk_queue_add_random(q)	test_bit(QUEUE_FLAG_ADD_RANDOM, &(q)->queue_flags)
+#define blk_queue_poll(q)	test_bit(QUEUE_FLAG_POLL, &(q)->queue_flags)
 #define blk_queue_stackable(q)	\
 	test_bit(QUEUE_FLAG_STACKABLE, &(q)->queue_flags)
 #define blk_queue_discard(q)	test_bit(QUEUE_FLAG_DISCARD, &(q)->queue_flags)
@@ -704,6 +738,8 @@ extern void blk_add_request_payload(struct request *rq, struct page *page,
 		unsigned int len);
 extern int blk_rq_check_limits(struct request_queue *q, struct request *rq);
 extern int blk_lld_busy(struct request_queue *q);
+extern bool blk_poll(struct request_queue *q);
+extern void blk_poll_account(struct request_queue *q, bool polled);
 extern int blk_rq_prep_clone(struct request *rq, struct request *rq_src,
 			     struct bio_set *bs, gfp_t gfp_mask,
 			     int (*bio_ctr)(struct bio *, struct bio *, void *),
@@ -857,6 +893,8 @@ extern void blk_queue_max_segments(struct request_queue *, unsigned short);
 extern void blk_queue_max_segment_size(struct request_queue *, unsigned int);
 extern void blk_queue_max_discard_sectors(struct request_queue *q,
 		unsigned int max_discard_sectors);
+extern void blk_queue_max_write_zeroes_sectors(struct request_queue *q,
+		unsigned int max_write_zeroes_sectors);
 extern void blk_queue_logical_block_size(struct request_queue *, unsigned short);
 extern void blk_queue_physical_block_size(struct request_queue *, unsigned int);
 extern void blk_queue_alignment_offset(struct request_queue *q,
@@ -880,6 +918,7 @@ extern int blk_queue_dma_drain(struct request_queue *q,
 			       dma_drain_needed_fn *dma_drain_needed,
 			       void *buf, unsigned int size);
 extern void blk_queue_lld_busy(struct request_queue *q, lld_busy_fn *fn);
+extern void blk_queue_poll_fn(struct request_queue *q, poll_q_fn *fn);
 extern void blk_queue_segment_boundary(struct request_queue *, unsigned long);
 extern void blk_queue_prep_rq(struct request_queue *, prep_rq_fn *pfn);
 extern void blk_queue_unprep_rq(struct request_queue *, unprep_rq_fn *ufn);
@@ -984,9 +1023,39 @@ static inline struct request *blk_map_queue_find_tag(struct blk_queue_tag *bqt,
 
 #define BLKDEV_DISCARD_SECURE  0x01    /* secure discard */
 
+/*
+ * Completion tracking for a set of bios issued together, see blk-lib.c.
+ */
+struct bio_batch {
+	atomic_t		done;
+	unsigned long		flags;
+	struct completion	*wait;
+};
+
+/*
+ * Discards queued with blk_discard_batch_add() are issued without waiting,
+ * and adjacent ranges are merged first.  blk_discard_batch_finish() waits
+ * for all of them.
+ */
+struct blk_discard_batch {
+	struct block_device	*bdev;
+	gfp_t			gfp_mask;
+	unsigned long		flags;		/* BLKDEV_DISCARD_* */
+	sector_t		sector;		/* range not yet issued */
+	sector_t		nr_sects;
+	int			error;
+	struct bio_batch	bb;
+	struct completion	wait;
+};
+
 extern int blkdev_issue_flush(struct block_device *, gfp_t, sector_t *);
 extern int blkdev_issue_discard(struct block_device *bdev, sector_t sector,
 		sector_t nr_sects, gfp_t gfp_mask, unsigned long flags);
+extern void blk_discard_batch_init(struct blk_discard_batch *batch,
+		struct block_device *bdev, gfp_t gfp_mask, unsigned long flags);
+extern int blk_discard_batch_add(struct blk_discard_batch *batch,
+		sector_t sector, sector_t nr_sects);
+extern int blk_discard_batch_finish(struct blk_discard_batch *batch);
 extern int blkdev_issue_zeroout(struct block_device *bdev, sector_t sector,
 			sector_t nr_sects, gfp_t gfp_mask);
 static inline int sb_issue_discard(struct super_block *sb, sector_t block,
@@ -1164,6 +1233,16 @@ static inline unsigned int bdev_discard_zeroes_data(struct block_device *bdev)
 	return queue_discard_zeroes_data(bdev_get_queue(bdev));
 }
 
+static inline unsigned int bdev_write_zeroes_sectors(struct block_device *bdev)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+
+	if (q)
+		return q->limits.max_write_zeroes_sectors;
+
+	return 0;
+}
+
 static inline int queue_dma_alignment(struct request_queue *q)
 {
 	return q ? q->dma_alignment : 511;
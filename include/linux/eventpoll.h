@@ -26,6 +26,13 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Set exclusive wakeup mode for the target file descriptor: when several
+ * epoll instances attached to the same target have waiters, an event wakes
+ * up only one of them.  Only valid for EPOLL_CTL_ADD.
+ */
+#define EPOLLEXCLUSIVE (1 << 28)
+
 /*
  * Request the handling of system wakeup events so as to prevent system suspends
  * from happening while those events are being processed.
@@ -61,6 +68,19 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/* One command of epoll_ctl_batch() */
+struct epoll_ctl_cmd {
+	/* EPOLL_CTL_ADD, EPOLL_CTL_DEL or EPOLL_CTL_MOD */
+	int op;
+	/* The target file descriptor */
+	int fd;
+	/* As the events and data fields of struct epoll_event */
+	__u32 events;
+	/* Filled in by the kernel: zero, or a negative error code */
+	int result;
+	__u64 data;
+};
+
 #ifdef __KERNEL__
 
 /* Forward declarations to avoid compiler errors */
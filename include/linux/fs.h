@@ -1004,6 +1004,9 @@ struct file_ra_state {
 
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
+	pgoff_t mmap_prev;		/* Index of the last mmap fault */
+	long mmap_stride;		/* Distance between the last two faults */
+	unsigned int mmap_stride_hits;	/* Times in a row it repeated */
 	loff_t prev_pos;		/* Cache last read() position */
 };
 
@@ -709,6 +709,10 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;	/* Protected by lock_memory_hotplug() */
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	struct task_struct *kcompactd;	/* Protected by lock_memory_hotplug() */
+	unsigned int proactive_defer;	/* proactive compaction checks to skip */
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -228,9 +228,19 @@ PAGEFLAG(OwnerPriv1, owner_priv_1) TESTCLEARFLAG(OwnerPriv1, owner_priv_1)
 TESTPAGEFLAG(Writeback, writeback) TESTSCFLAG(Writeback, writeback)
 PAGEFLAG(MappedToDisk, mappedtodisk)
 
-/* PG_readahead is only used for file reads; PG_reclaim is only for writes */
+/*
+ * PG_readahead is only used for file and swap reads; PG_reclaim is only
+ * for writes
+ */
 PAGEFLAG(Reclaim, reclaim) TESTCLEARFLAG(Reclaim, reclaim)
-PAGEFLAG(Readahead, reclaim)		/* Reminder to do async read-ahead */
+PAGEFLAG(Readahead, reclaim) TESTCLEARFLAG(Readahead, reclaim)
+					/* Reminder to do async read-ahead */
+
+/*
+ * PG_uptodate is only used on allocated pages: free page reporting uses it
+ * to mark free blocks in the buddy allocator that it already reported.
+ */
+__PAGEFLAG(Reported, uptodate)
 
 #ifdef CONFIG_HIGHMEM
 /*
@@ -0,0 +1,31 @@
+#ifndef _LINUX_PAGE_REPORTING_H
+#define _LINUX_PAGE_REPORTING_H
+
+#include <linux/mmzone.h>
+#include <linux/scatterlist.h>
+
+/* Smallest free blocks that are reported */
+#define PAGE_REPORTING_MIN_ORDER	pageblock_order
+
+/* Most free blocks handed to a consumer at once */
+#define PAGE_REPORTING_CAPACITY		32
+
+/**
+ * struct page_reporting_dev_info - consumer of free page reports
+ * @report: called with @nents free blocks of at least
+ *	PAGE_REPORTING_MIN_ORDER pages in @sg, which the consumer may discard
+ *	the contents of; they are not handed out by the page allocator until
+ *	@report returns.  May sleep.  A nonzero return means the blocks were
+ *	not reported, and they will be offered again later.
+ */
+struct page_reporting_dev_info {
+	int (*report)(struct page_reporting_dev_info *prdev,
+		      struct scatterlist *sg, unsigned int nents);
+};
+
+#ifdef CONFIG_PAGE_REPORTING
+extern int page_reporting_register(struct page_reporting_dev_info *prdev);
+extern void page_reporting_unregister(struct page_reporting_dev_info *prdev);
+#endif
+
+#endif /* _LINUX_PAGE_REPORTING_H */
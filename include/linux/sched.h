@@ -1188,6 +1188,10 @@ struct sched_entity {
 
 	u64			nr_migrations;
 
+	/* decayed fraction of time runnable, see update_task_util() */
+	u64			util_stamp;
+	unsigned long		util_avg;
+
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_statistics statistics;
 #endif
@@ -2010,6 +2014,27 @@ extern void wake_up_idle_cpu(int cpu);
 static inline void wake_up_idle_cpu(int cpu) { }
 #endif
 
+#ifdef CONFIG_NO_HZ_FULL
+extern bool sched_can_stop_tick(void);
+#else
+static inline bool sched_can_stop_tick(void) { return false; }
+#endif
+
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Hook for cpufreq governors which want to be told about utilization
+ * changes by the scheduler.  ->func() is called with the runqueue lock
+ * held and interrupts disabled, it must not sleep or wake up tasks.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time,
+		     unsigned long util, unsigned long max);
+};
+
+extern void cpufreq_set_update_util_data(int cpu,
+					 struct update_util_data *data);
+#endif
+
 extern unsigned int sysctl_sched_latency;
 extern unsigned int sysctl_sched_min_granularity;
 extern unsigned int sysctl_sched_wakeup_granularity;
@@ -41,13 +41,29 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	ALLOC_ARRAY,		/* Allocation from cpu object array */
+	FREE_ARRAY,		/* Free to cpu object array */
+	CPU_ARRAY_FLUSH,	/* Full cpu object array flushed to slabs */
 	NR_SLUB_STAT_ITEMS };
 
+/*
+ * Optional per cpu array of free objects in front of the slab freelists.
+ * It takes objects that do not belong to the cpu slab, so that they do
+ * not have to go through the slow path. Only accessed with interrupts
+ * disabled on the owning cpu.
+ */
+struct kmem_cache_array {
+	unsigned int size;	/* Capacity */
+	unsigned int count;	/* Objects in the array */
+	void *objects[];
+};
+
 struct kmem_cache_cpu {
 	void **freelist;	/* Pointer to next available object */
 	unsigned long tid;	/* Globally unique transaction id */
 	struct page *page;	/* The slab from which we are allocating */
 	struct page *partial;	/* Partially allocated frozen slabs */
+	struct kmem_cache_array *array;	/* Cached free objects or NULL */
 #ifdef CONFIG_SLUB_STATS
 	unsigned stat[NR_SLUB_STAT_ITEMS];
 #endif
@@ -85,6 +101,7 @@ struct kmem_cache {
 	int object_size;	/* The size of an object without meta data */
 	int offset;		/* Free pointer offset. */
 	int cpu_partial;	/* Number of per cpu partial objects to keep around */
+	int cpu_array;		/* Size of the per cpu object arrays, 0 if none */
 	struct kmem_cache_order_objects oo;
 
 	/* Allocation and freeing of slabs */
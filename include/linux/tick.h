@@ -8,6 +8,7 @@
 
 #include <linux/clockchips.h>
 #include <linux/irqflags.h>
+#include <linux/cpumask.h>
 
 #ifdef CONFIG_GENERIC_CLOCKEVENTS
 
@@ -46,6 +47,11 @@ enum tick_nohz_mode {
  * @iowait_sleeptime:	Sum of the time slept in idle with sched tick stopped, with IO outstanding
  * @sleep_length:	Duration of the current idle sleep
  * @do_timer_lst:	CPU was the last one doing do_timer before going idle
+ * @nohz_full_stopped:	The tick was stopped while running a single task
+ * @full_jiffies:	jiffies accounted to that task so far
+ * @full_stops:		Number of times the tick was stopped that way
+ * @full_kicks:		Number of times it was kicked by another CPU
+ * @full_kick_pending:	A kick is on its way to this CPU
  */
 struct tick_sched {
 	struct hrtimer			sched_timer;
@@ -68,6 +74,13 @@ struct tick_sched {
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
 	int				do_timer_last;
+#ifdef CONFIG_NO_HZ_FULL
+	int				nohz_full_stopped;
+	unsigned long			full_jiffies;
+	unsigned long			full_stops;
+	unsigned long			full_kicks;
+	unsigned long			full_kick_pending;
+#endif
 };
 
 extern void __init tick_init(void);
@@ -142,4 +155,27 @@ static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+# ifdef CONFIG_NO_HZ_FULL
+extern bool tick_nohz_full_running;
+extern cpumask_var_t tick_nohz_full_mask;
+
+static inline bool tick_nohz_full_cpu(int cpu)
+{
+	if (!tick_nohz_full_running)
+		return false;
+	return cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+extern void tick_nohz_full_irq_exit(void);
+extern void tick_nohz_task_switch(void);
+extern bool tick_nohz_full_kick_cpu(int cpu);
+extern void tick_nohz_full_kick_all(void);
+# else
+static inline bool tick_nohz_full_cpu(int cpu) { return false; }
+static inline void tick_nohz_full_irq_exit(void) { }
+static inline void tick_nohz_task_switch(void) { }
+static inline bool tick_nohz_full_kick_cpu(int cpu) { return false; }
+static inline void tick_nohz_full_kick_all(void) { }
+# endif /* !NO_HZ_FULL */
+
 #endif
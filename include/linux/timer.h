@@ -229,6 +229,14 @@ extern void set_timer_slack(struct timer_list *time, int slack_hz);
  */
 extern unsigned long get_next_timer_interrupt(unsigned long now);
 
+#if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
+extern void timer_set_idle(void);
+extern void timer_clear_idle(void);
+#else
+static inline void timer_set_idle(void) { }
+static inline void timer_clear_idle(void) { }
+#endif
+
 /*
  * Timer-statistics info:
  */
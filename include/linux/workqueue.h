@@ -11,6 +11,7 @@
 #include <linux/lockdep.h>
 #include <linux/threads.h>
 #include <linux/atomic.h>
+#include <linux/numa.h>
 
 struct workqueue_struct;
 
@@ -54,9 +55,12 @@ enum {
 	WORK_NR_COLORS		= (1 << WORK_STRUCT_COLOR_BITS) - 1,
 	WORK_NO_COLOR		= WORK_NR_COLORS,
 
-	/* special cpu IDs */
+	/*
+	 * special cpu IDs, unbound gcwqs are per NUMA node and identified
+	 * as WORK_CPU_UNBOUND + node
+	 */
 	WORK_CPU_UNBOUND	= NR_CPUS,
-	WORK_CPU_NONE		= NR_CPUS + 1,
+	WORK_CPU_NONE		= NR_CPUS + MAX_NUMNODES,
 	WORK_CPU_LAST		= WORK_CPU_NONE,
 
 	/*
@@ -83,6 +87,9 @@ struct work_struct {
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
+#ifdef CONFIG_WQ_STATS
+	u64 queued;		/* local_clock() when queued */
+#endif
 };
 
 #define WORK_DATA_INIT()	ATOMIC_LONG_INIT(WORK_STRUCT_NO_CPU)
@@ -165,6 +172,12 @@ static inline void destroy_work_on_stack(struct work_struct *work) { }
 static inline unsigned int work_static(struct work_struct *work) { return 0; }
 #endif
 
+#ifdef CONFIG_WQ_STATS
+#define __INIT_WORK_STATS(_work)	do { (_work)->queued = 0; } while (0)
+#else
+#define __INIT_WORK_STATS(_work)	do { } while (0)
+#endif
+
 /*
  * initialize all of a work item in one go
  *
@@ -181,6 +194,7 @@ static inline unsigned int work_static(struct work_struct *work) { return 0; }
 		(_work)->data = (atomic_long_t) WORK_DATA_INIT();	\
 		lockdep_init_map(&(_work)->lockdep_map, #_work, &__key, 0);\
 		INIT_LIST_HEAD(&(_work)->entry);			\
+		__INIT_WORK_STATS(_work);				\
 		PREPARE_WORK((_work), (_func));				\
 	} while (0)
 #else
@@ -189,6 +203,7 @@ static inline unsigned int work_static(struct work_struct *work) { return 0; }
 		__init_work((_work), _onstack);				\
 		(_work)->data = (atomic_long_t) WORK_DATA_INIT();	\
 		INIT_LIST_HEAD(&(_work)->entry);			\
+		__INIT_WORK_STATS(_work);				\
 		PREPARE_WORK((_work), (_func));				\
 	} while (0)
 #endif
@@ -254,9 +269,11 @@ enum {
 	WQ_MEM_RECLAIM		= 1 << 3, /* may be used for memory reclaim */
 	WQ_HIGHPRI		= 1 << 4, /* high priority */
 	WQ_CPU_INTENSIVE	= 1 << 5, /* cpu instensive workqueue */
+	WQ_SYSFS		= 1 << 8, /* visible in sysfs */
 
 	WQ_DRAINING		= 1 << 6, /* internal: workqueue is draining */
 	WQ_RESCUER		= 1 << 7, /* internal: workqueue has rescuer */
+	WQ_ORDERED		= 1 << 9, /* internal: unbound, max_active 1 */
 
 	WQ_MAX_ACTIVE		= 512,	  /* I like 512, better ideas? */
 	WQ_MAX_UNBOUND_PER_CPU	= 4,	  /* 4 * #cpus for unbound wq */
@@ -0,0 +1,78 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpufreq_schedutil
+
+#if !defined(_TRACE_CPUFREQ_SCHEDUTIL_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUFREQ_SCHEDUTIL_H
+
+#include <linux/tracepoint.h>
+
+/**
+ * sugov_next_freq - called when the governor requests a new frequency
+ * @cpu: cpu whose utilization update triggered the request
+ * @util: highest utilization among the cpus of the policy
+ * @max: utilization at full capacity
+ * @next_freq: requested frequency in kHz
+ */
+TRACE_EVENT(sugov_next_freq,
+
+	TP_PROTO(unsigned int cpu, unsigned long util, unsigned long max,
+		 unsigned int next_freq),
+
+	TP_ARGS(cpu, util, max, next_freq),
+
+	TP_STRUCT__entry(
+		__field(	unsigned int,	cpu		)
+		__field(	unsigned long,	util		)
+		__field(	unsigned long,	max		)
+		__field(	unsigned int,	next_freq	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->util		= util;
+		__entry->max		= max;
+		__entry->next_freq	= next_freq;
+	),
+
+	TP_printk("cpu=%u util=%lu max=%lu next_freq=%u",
+		  __entry->cpu, __entry->util, __entry->max,
+		  __entry->next_freq)
+);
+
+/**
+ * sugov_freq_applied - called once the driver switched frequency
+ * @cpu: policy cpu
+ * @old_freq: frequency before the switch in kHz
+ * @new_freq: frequency after the switch in kHz
+ * @latency_ns: time from the request to the completed switch
+ */
+TRACE_EVENT(sugov_freq_applied,
+
+	TP_PROTO(unsigned int cpu, unsigned int old_freq,
+		 unsigned int new_freq, u64 latency_ns),
+
+	TP_ARGS(cpu, old_freq, new_freq, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(	unsigned int,	cpu		)
+		__field(	unsigned int,	old_freq	)
+		__field(	unsigned int,	new_freq	)
+		__field(	u64,		latency_ns	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->old_freq	= old_freq;
+		__entry->new_freq	= new_freq;
+		__entry->latency_ns	= latency_ns;
+	),
+
+	TP_printk("cpu=%u old_freq=%u new_freq=%u latency_ns=%llu",
+		  __entry->cpu, __entry->old_freq, __entry->new_freq,
+		  (unsigned long long)__entry->latency_ns)
+);
+
+#endif /* _TRACE_CPUFREQ_SCHEDUTIL_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -30,6 +30,16 @@
 	(RECLAIM_WB_ASYNC) \
 	)
 
+#define LRU_LOCK_PAGEVEC	0	/* per-cpu pagevec drained */
+#define LRU_LOCK_ISOLATE	1	/* pages isolated for reclaim */
+#define LRU_LOCK_PUTBACK	2	/* reclaimed pages put back */
+
+#define show_lru_lock_site(site)				\
+	__print_symbolic(site,					\
+		{LRU_LOCK_PAGEVEC,	"pagevec"},		\
+		{LRU_LOCK_ISOLATE,	"isolate"},		\
+		{LRU_LOCK_PUTBACK,	"putback"})
+
 #define trace_shrink_flags(file) \
 	( \
 		(file ? RECLAIM_WB_FILE : RECLAIM_WB_ANON) | \
@@ -377,6 +387,36 @@ TRACE_EVENT(mm_vmscan_lru_shrink_inactive,
 		show_reclaim_flags(__entry->reclaim_flags))
 );
 
+TRACE_EVENT(mm_lru_lock_hold,
+
+	TP_PROTO(struct zone *zone, int site, unsigned long nr_pages,
+			u64 hold_ns),
+
+	TP_ARGS(zone, site, nr_pages, hold_ns),
+
+	TP_STRUCT__entry(
+		__field(int, nid)
+		__field(int, zid)
+		__field(int, site)
+		__field(unsigned long, nr_pages)
+		__field(u64, hold_ns)
+	),
+
+	TP_fast_assign(
+		__entry->nid = zone_to_nid(zone);
+		__entry->zid = zone_idx(zone);
+		__entry->site = site;
+		__entry->nr_pages = nr_pages;
+		__entry->hold_ns = hold_ns;
+	),
+
+	TP_printk("nid=%d zid=%d site=%s nr_pages=%lu hold_ns=%llu",
+		__entry->nid, __entry->zid,
+		show_lru_lock_site(__entry->site),
+		__entry->nr_pages,
+		(unsigned long long)__entry->hold_ns)
+);
+
 #endif /* _TRACE_VMSCAN_H */
 
 /* This part must be outside protection */
@@ -115,6 +115,70 @@ DEFINE_EVENT(workqueue_work, workqueue_execute_end,
 	TP_ARGS(work)
 );
 
+#ifdef CONFIG_WQ_STATS
+/**
+ * workqueue_execute_stats - called after the workqueue callback returned
+ * @cwq:	pointer to struct cpu_workqueue_struct
+ * @function:	the callback
+ * @latency:	nsecs the work waited between queueing and execution
+ * @runtime:	nsecs the callback ran
+ *
+ * Only occurs while workqueue statistics are collected.
+ */
+TRACE_EVENT(workqueue_execute_stats,
+
+	TP_PROTO(struct cpu_workqueue_struct *cwq, work_func_t function,
+		 u64 latency, u64 runtime),
+
+	TP_ARGS(cwq, function, latency, runtime),
+
+	TP_STRUCT__entry(
+		__field( void *,	workqueue)
+		__field( void *,	function)
+		__field( u64,		latency	)
+		__field( u64,		runtime	)
+	),
+
+	TP_fast_assign(
+		__entry->workqueue	= cwq->wq;
+		__entry->function	= function;
+		__entry->latency	= latency;
+		__entry->runtime	= runtime;
+	),
+
+	TP_printk("workqueue=%p function=%pf latency=%llu runtime=%llu",
+		  __entry->workqueue, __entry->function,
+		  (unsigned long long)__entry->latency,
+		  (unsigned long long)__entry->runtime)
+);
+#endif
+
+/**
+ * workqueue_rescue - called when a rescuer steps in
+ * @cwq:	pointer to struct cpu_workqueue_struct
+ *
+ * This event occurs when the rescuer of a workqueue starts processing
+ * its works on a gcwq that failed to create a new worker in time.
+ */
+TRACE_EVENT(workqueue_rescue,
+
+	TP_PROTO(struct cpu_workqueue_struct *cwq),
+
+	TP_ARGS(cwq),
+
+	TP_STRUCT__entry(
+		__field( void *,	workqueue)
+		__field( unsigned int,	cpu	)
+	),
+
+	TP_fast_assign(
+		__entry->workqueue	= cwq->wq;
+		__entry->cpu		= cwq->pool->gcwq->cpu;
+	),
+
+	TP_printk("workqueue=%p cpu=%u", __entry->workqueue, __entry->cpu)
+);
+
 #endif /*  _TRACE_WORKQUEUE_H */
 
 /* This part must be outside protection */
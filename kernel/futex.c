@@ -60,6 +60,9 @@
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
 #include <linux/ptrace.h>
+#include <linux/bootmem.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/futex.h>
 
@@ -67,8 +70,6 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
-
 /*
  * Futex flags used to encode options to functions and preserve them across
  * restarts.
@@ -142,13 +143,61 @@ static const struct futex_q futex_q_init = {
  * Hash buckets are shared by all the futex_keys that hash to the same
  * location.  Each key may have multiple futex_q structures, one for each task
  * waiting on a futex.
+ *
+ * @waiters counts the tasks queued, or about to queue, on the bucket, so that
+ * futex_wake() can return without taking the lock when nobody waits.  The
+ * ordering that makes this safe is:
+ *
+ * CPU 0 (waiter)                      CPU 1 (waker)
+ *
+ * waiters++; (a)                      *futex = newval;
+ * smp_mb(); (A)                       sys_futex(WAKE, futex);
+ * lock(hash_bucket(futex));             get_futex_key(); smp_mb(); (B)
+ * uval = *futex;                        if (waiters == 0)
+ * if (uval == val)                          return;
+ *     queue(); unlock(); schedule();    lock(hash_bucket(futex));
+ *                                       wake_waiters(futex);
+ *
+ * Either the waker sees (a), or the waiter sees the new futex value and
+ * does not sleep.  Barrier (B) is implied by get_futex_key_refs().
  */
 struct futex_hash_bucket {
+	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
-};
+} ____cacheline_aligned_in_smp;
+
+static unsigned long __read_mostly futex_hashsize;
+static struct futex_hash_bucket *futex_queues;
+
+static DEFINE_PER_CPU(unsigned long, futex_wake_skipped);
+
+static inline void hb_waiters_inc(struct futex_hash_bucket *hb)
+{
+#ifdef CONFIG_SMP
+	atomic_inc(&hb->waiters);
+	/*
+	 * Full barrier (A), see the ordering comment above.
+	 */
+	smp_mb__after_atomic_inc();
+#endif
+}
+
+static inline void hb_waiters_dec(struct futex_hash_bucket *hb)
+{
+#ifdef CONFIG_SMP
+	atomic_dec(&hb->waiters);
+#endif
+}
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
+{
+#ifdef CONFIG_SMP
+	return atomic_read(&hb->waiters);
+#else
+	return 1;
+#endif
+}
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
@@ -158,7 +207,7 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
 /*
@@ -184,11 +233,19 @@ static void get_futex_key_refs(union futex_key *key)
 
 	switch (key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED)) {
 	case FUT_OFF_INODE:
-		ihold(key->shared.inode);
+		ihold(key->shared.inode); /* implies MB (B) */
 		break;
 	case FUT_OFF_MMSHARED:
 		atomic_inc(&key->private.mm->mm_count);
+		smp_mb__after_atomic_inc(); /* explicit MB (B) */
 		break;
+	default:
+		/*
+		 * Private futexes do not hold a reference on an inode or
+		 * mm, so the only reason to get here is the barrier the
+		 * lockless waiter check in futex_wake() relies on.
+		 */
+		smp_mb(); /* explicit MB (B) */
 	}
 }
 
@@ -259,7 +316,7 @@ get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
 			return -EFAULT;
 		key->private.mm = mm;
 		key->private.address = address;
-		get_futex_key_refs(key);
+		get_futex_key_refs(key);  /* implies MB (B) */
 		return 0;
 	}
 
@@ -833,6 +890,7 @@ static void __unqueue_futex(struct futex_q *q)
 
 	hb = container_of(q->lock_ptr, struct futex_hash_bucket, lock);
 	plist_del(&q->list, &hb->chain);
+	hb_waiters_dec(hb);
 }
 
 /*
@@ -993,6 +1051,13 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 		goto out;
 
 	hb = hash_futex(&key);
+
+	/* Make sure we really have tasks to wakeup */
+	if (!hb_waiters_pending(hb)) {
+		this_cpu_inc(futex_wake_skipped);
+		goto out_put_key;
+	}
+
 	spin_lock(&hb->lock);
 	head = &hb->chain;
 
@@ -1014,6 +1079,7 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	}
 
 	spin_unlock(&hb->lock);
+out_put_key:
 	put_futex_key(&key);
 out:
 	return ret;
@@ -1137,7 +1203,9 @@ void requeue_futex(struct futex_q *q, struct futex_hash_bucket *hb1,
 	 */
 	if (likely(&hb1->chain != &hb2->chain)) {
 		plist_del(&q->list, &hb1->chain);
+		hb_waiters_dec(hb1);
 		plist_add(&q->list, &hb2->chain);
+		hb_waiters_inc(hb2);
 		q->lock_ptr = &hb2->lock;
 	}
 	get_futex_key_refs(key2);
@@ -1312,6 +1380,12 @@ retry:
 	hb2 = hash_futex(&key2);
 
 retry_private:
+	/*
+	 * Waiters may be moved onto hb2 while we hold the locks: count
+	 * ourselves there so a concurrent futex_wake() on uaddr2 does not
+	 * skip the bucket before they show up.
+	 */
+	hb_waiters_inc(hb2);
 	double_lock_hb(hb1, hb2);
 
 	if (likely(cmpval != NULL)) {
@@ -1321,6 +1395,7 @@ retry_private:
 
 		if (unlikely(ret)) {
 			double_unlock_hb(hb1, hb2);
+			hb_waiters_dec(hb2);
 
 			ret = get_user(curval, uaddr1);
 			if (ret)
@@ -1370,6 +1445,7 @@ retry_private:
 			break;
 		case -EFAULT:
 			double_unlock_hb(hb1, hb2);
+			hb_waiters_dec(hb2);
 			put_futex_key(&key2);
 			put_futex_key(&key1);
 			ret = fault_in_user_writeable(uaddr2);
@@ -1379,6 +1455,7 @@ retry_private:
 		case -EAGAIN:
 			/* The owner was exiting, try again. */
 			double_unlock_hb(hb1, hb2);
+			hb_waiters_dec(hb2);
 			put_futex_key(&key2);
 			put_futex_key(&key1);
 			cond_resched();
@@ -1455,6 +1532,7 @@ retry_private:
 
 out_unlock:
 	double_unlock_hb(hb1, hb2);
+	hb_waiters_dec(hb2);
 
 	/*
 	 * drop_futex_key_refs() must be called outside the spinlocks. During
@@ -1482,6 +1560,17 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 	struct futex_hash_bucket *hb;
 
 	hb = hash_futex(&q->key);
+
+	/*
+	 * Increment the counter before taking the lock so that
+	 * a potential waker won't miss a to-be-slept task that is
+	 * waiting for the spinlock. This is safe as all queue_lock()
+	 * users end up calling queue_me(). Similarly, for housekeeping,
+	 * decrement the counter at queue_unlock() when some error has
+	 * occurred and we don't end up adding the task to the list.
+	 */
+	hb_waiters_inc(hb);
+
 	q->lock_ptr = &hb->lock;
 
 	spin_lock(&hb->lock);
@@ -1493,6 +1582,7 @@ queue_unlock(struct futex_q *q, struct futex_hash_bucket *hb)
 	__releases(&hb->lock)
 {
 	spin_unlock(&hb->lock);
+	hb_waiters_dec(hb);
 }
 
 /**
@@ -2227,6 +2317,7 @@ int handle_early_requeue_pi_wakeup(struct futex_hash_bucket *hb,
 		 * Unqueue the futex_q and determine which it was.
 		 */
 		plist_del(&q->list, &hb->chain);
+		hb_waiters_dec(hb);
 
 		/* Handle spurious wakeups gracefully */
 		ret = -EWOULDBLOCK;
@@ -2732,7 +2823,20 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 static int __init futex_init(void)
 {
 	u32 curval;
-	int i;
+	unsigned int futex_shift;
+	unsigned long i;
+
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+#endif
+
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       &futex_shift, NULL,
+					       futex_hashsize, futex_hashsize);
+	futex_hashsize = 1UL << futex_shift;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2747,7 +2851,8 @@ static int __init futex_init(void)
 	if (cmpxchg_futex_value_locked(&curval, NULL, 0, 0) == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+	for (i = 0; i < futex_hashsize; i++) {
+		atomic_set(&futex_queues[i].waiters, 0);
 		plist_head_init(&futex_queues[i].chain);
 		spin_lock_init(&futex_queues[i].lock);
 	}
@@ -2755,3 +2860,63 @@ static int __init futex_init(void)
 	return 0;
 }
 __initcall(futex_init);
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Walk the hash table to show how evenly the waiters spread over it.
+ * Contention on the bucket locks themselves shows up in lock_stat.
+ */
+static int futex_hash_show(struct seq_file *m, void *v)
+{
+	unsigned long i, used = 0, waiters = 0, longest = 0, skipped = 0;
+	int cpu;
+
+	for (i = 0; i < futex_hashsize; i++) {
+		struct futex_hash_bucket *hb = &futex_queues[i];
+		struct futex_q *this;
+		unsigned long len = 0;
+
+		spin_lock(&hb->lock);
+		plist_for_each_entry(this, &hb->chain, list)
+			len++;
+		spin_unlock(&hb->lock);
+
+		if (!len)
+			continue;
+		used++;
+		waiters += len;
+		longest = max(longest, len);
+	}
+
+	for_each_possible_cpu(cpu)
+		skipped += per_cpu(futex_wake_skipped, cpu);
+
+	seq_printf(m, "buckets:       %lu\n", futex_hashsize);
+	seq_printf(m, "bucket_size:   %zu\n", sizeof(struct futex_hash_bucket));
+	seq_printf(m, "used_buckets:  %lu\n", used);
+	seq_printf(m, "waiters:       %lu\n", waiters);
+	seq_printf(m, "longest_chain: %lu\n", longest);
+	seq_printf(m, "wake_skipped:  %lu\n", skipped);
+	return 0;
+}
+
+static int futex_hash_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, futex_hash_show, NULL);
+}
+
+static const struct file_operations futex_hash_fops = {
+	.open		= futex_hash_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init futex_debugfs_init(void)
+{
+	debugfs_create_file("futex_hash", S_IRUSR, NULL, NULL,
+			    &futex_hash_fops);
+	return 0;
+}
+late_initcall(futex_debugfs_init);
+#endif
@@ -8,6 +8,7 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include <trace/events/timer.h>
 
 /*
@@ -580,6 +581,8 @@ static void arm_timer(struct k_itimer *timer)
 				cputime_expires->sched_exp = exp->sched;
 			break;
 		}
+		/* Full dynticks CPUs must sample it from their tick */
+		tick_nohz_full_kick_all();
 	}
 }
 
@@ -1274,6 +1277,23 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Can the tick of the CPU running @tsk be stopped?  Not while CPU time
+ * timers are armed for it, they are checked from the tick.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+
+	if (tsk->signal->cputimer.running)
+		return false;
+
+	return true;
+}
+#endif
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -1389,6 +1409,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 		break;
 	}
+
+	tick_nohz_full_kick_all();
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
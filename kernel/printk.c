@@ -42,6 +42,7 @@
 #include <linux/notifier.h>
 #include <linux/rculist.h>
 #include <linux/poll.h>
+#include <linux/kthread.h>
 
 #include <asm/uaccess.h>
 
@@ -126,6 +127,9 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 /* Flag: console code may call schedule() */
 static int console_may_schedule;
 
+/* Writes deferred messages to the log and the consoles, see printk.deferred */
+static struct task_struct *printk_kthread;
+
 /*
  * The printk log buffer consists of a chain of concatenated variable
  * length records. Every record starts with a record header, containing
@@ -1421,7 +1425,8 @@ static void cont_flush(enum log_flags flags)
 	}
 }
 
-static bool cont_add(int facility, int level, const char *text, size_t len)
+static bool cont_add(int facility, int level, const char *text, size_t len,
+		     struct task_struct *owner, u64 ts_nsec)
 {
 	if (cont.len && cont.flushed)
 		return false;
@@ -1435,8 +1440,8 @@ static bool cont_add(int facility, int level, const char *text, size_t len)
 	if (!cont.len) {
 		cont.facility = facility;
 		cont.level = level;
-		cont.owner = current;
-		cont.ts_nsec = local_clock();
+		cont.owner = owner;
+		cont.ts_nsec = ts_nsec ? ts_nsec : local_clock();
 		cont.flags = 0;
 		cont.cons = 0;
 		cont.flushed = false;
@@ -1479,6 +1484,418 @@ static size_t cont_print_text(char *text, size_t size)
 	return textlen;
 }
 
+/*
+ * Mark and strip a trailing newline, strip the kernel syslog prefix and
+ * extract the log level or control flags from it.
+ */
+static char *printk_parse(int facility, int *level, enum log_flags *lflags,
+			  char *text, size_t *text_len)
+{
+	/* mark and strip a trailing newline */
+	if (*text_len && text[*text_len-1] == '\n') {
+		(*text_len)--;
+		*lflags |= LOG_NEWLINE;
+	}
+
+	/* strip kernel syslog prefix and extract log level or control flags */
+	if (facility == 0) {
+		int kern_level = printk_get_level(text);
+
+		if (kern_level) {
+			const char *end_of_header = printk_skip_level(text);
+			switch (kern_level) {
+			case '0' ... '7':
+				if (*level == -1)
+					*level = kern_level - '0';
+			case 'd':	/* KERN_DEFAULT */
+				*lflags |= LOG_PREFIX;
+			case 'c':	/* KERN_CONT */
+				break;
+			}
+			*text_len -= end_of_header - text;
+			text = (char *)end_of_header;
+		}
+	}
+
+	if (*level == -1)
+		*level = default_message_loglevel;
+
+	return text;
+}
+
+/*
+ * Store a message printed by @owner in the log, merging continuation
+ * lines. Called with logbuf_lock held.
+ */
+static void log_emit(int facility, int level, enum log_flags lflags,
+		     u64 ts_nsec, struct task_struct *owner,
+		     const char *dict, size_t dictlen,
+		     const char *text, size_t text_len)
+{
+	if (dict)
+		lflags |= LOG_PREFIX|LOG_NEWLINE;
+
+	if (!(lflags & LOG_NEWLINE)) {
+		/*
+		 * Flush the conflicting buffer. An earlier newline was missing,
+		 * or another task also prints continuation lines.
+		 */
+		if (cont.len && (lflags & LOG_PREFIX || cont.owner != owner))
+			cont_flush(LOG_NEWLINE);
+
+		/* buffer line if possible, otherwise store it right away */
+		if (!cont_add(facility, level, text, text_len, owner, ts_nsec))
+			log_store(facility, level, lflags | LOG_CONT, ts_nsec,
+				  dict, dictlen, text, text_len);
+	} else {
+		bool stored = false;
+
+		/*
+		 * If an earlier newline was missing and it was the same task,
+		 * either merge it with the current buffer and flush, or if
+		 * there was a race with interrupts (prefix == true) then just
+		 * flush it out and store this line separately.
+		 */
+		if (cont.len && cont.owner == owner) {
+			if (!(lflags & LOG_PREFIX))
+				stored = cont_add(facility, level, text,
+						  text_len, owner, ts_nsec);
+			cont_flush(LOG_NEWLINE);
+		}
+
+		if (!stored)
+			log_store(facility, level, lflags, ts_nsec,
+				  dict, dictlen, text, text_len);
+	}
+}
+
+/*
+ * Deferred printk.
+ *
+ * With printk.deferred=1, printk() does not take logbuf_lock or call the
+ * console drivers. Each cpu formats its messages into a buffer of its own,
+ * with interrupts disabled, and tags them with a global sequence number.
+ * The printk kthread merges the per cpu buffers back into the log in
+ * sequence order and then drives the consoles.
+ *
+ * Until the kthread runs, and once an oops or panic is in progress or the
+ * system goes down, printk() works synchronously again. It moves whatever
+ * the per cpu buffers still hold to the log before its own message.
+ */
+#define PRINTK_CPU_BUF_SIZE	(1 << 14)
+
+struct printk_cpu_rec {
+	u32 seq;		/* global sequence number */
+	u16 len;		/* length of entire record, 0 for padding */
+	u16 text_len;		/* length of text */
+	u16 dict_len;		/* length of dictionary */
+	u8 facility;		/* syslog facility */
+	u8 flags;		/* log_flags */
+	u8 level;		/* syslog level */
+	u64 ts_nsec;		/* timestamp in nanoseconds */
+	struct task_struct *owner; /* printing task, for continuation lines */
+};
+
+struct printk_cpu_buf {
+	unsigned int head;	/* written by the owning cpu only */
+	unsigned int tail;	/* written under logbuf_lock only */
+	int busy;		/* a printk is filling text or data */
+	unsigned long deferred;	/* messages queued */
+	unsigned long dropped;	/* messages lost, buffer full or nested */
+	char text[LOG_LINE_MAX];
+	char data[PRINTK_CPU_BUF_SIZE] __aligned(8);
+};
+
+static bool __read_mostly printk_deferred;
+module_param_named(deferred, printk_deferred, bool, S_IRUGO);
+
+static DEFINE_PER_CPU(struct printk_cpu_buf *, printk_cpu_buf);
+static atomic_t printk_cpu_seq = ATOMIC_INIT(0);
+/* the next sequence number expected by printk_cpu_drain_one() */
+static u32 printk_cpu_seq_next = 1;
+/* dropped messages that were already reported in the log */
+static unsigned long printk_cpu_dropped_seen;
+
+static void printk_kick_output(void);
+
+static inline bool printk_cpu_active(void)
+{
+	return printk_kthread && !oops_in_progress &&
+	       (system_state == SYSTEM_BOOTING ||
+		system_state == SYSTEM_RUNNING);
+}
+
+static int printk_cpu_count_get(char *buffer, const struct kernel_param *kp)
+{
+	size_t offset = (size_t)kp->arg;
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct printk_cpu_buf *b = per_cpu(printk_cpu_buf, cpu);
+
+		if (b)
+			sum += *(unsigned long *)((char *)b + offset);
+	}
+	return sprintf(buffer, "%lu", sum);
+}
+
+static struct kernel_param_ops printk_cpu_count_ops = {
+	.get = printk_cpu_count_get,
+};
+module_param_cb(deferred_messages, &printk_cpu_count_ops,
+		(void *)offsetof(struct printk_cpu_buf, deferred), S_IRUGO);
+module_param_cb(dropped_messages, &printk_cpu_count_ops,
+		(void *)offsetof(struct printk_cpu_buf, dropped), S_IRUGO);
+
+/* Queue a message in this cpu's buffer. Called with interrupts disabled. */
+static bool printk_cpu_store(struct printk_cpu_buf *b, int facility,
+			     int level, enum log_flags lflags,
+			     const char *dict, size_t dict_len,
+			     const char *text, size_t text_len)
+{
+	struct printk_cpu_rec *rec;
+	unsigned int pos, pad = 0;
+	size_t size;
+
+	size = ALIGN(sizeof(*rec) + text_len + dict_len, 8);
+	pos = b->head & (PRINTK_CPU_BUF_SIZE - 1);
+	if (PRINTK_CPU_BUF_SIZE - pos < size)
+		pad = PRINTK_CPU_BUF_SIZE - pos;
+
+	if (b->head + pad + size - ACCESS_ONCE(b->tail) > PRINTK_CPU_BUF_SIZE)
+		return false;
+	/* do not overwrite what the reader may still look at */
+	smp_mb();
+
+	if (pad) {
+		if (pad >= sizeof(*rec))
+			((struct printk_cpu_rec *)(b->data + pos))->len = 0;
+		pos = 0;
+	}
+
+	rec = (struct printk_cpu_rec *)(b->data + pos);
+	rec->len = size;
+	rec->text_len = text_len;
+	rec->dict_len = dict_len;
+	rec->facility = facility;
+	rec->flags = lflags;
+	rec->level = level;
+	rec->ts_nsec = local_clock();
+	rec->owner = current;
+	memcpy(rec + 1, text, text_len);
+	memcpy((char *)(rec + 1) + text_len, dict, dict_len);
+	rec->seq = atomic_inc_return(&printk_cpu_seq);
+
+	/* publish the record, pairs with smp_rmb() in printk_cpu_peek() */
+	smp_wmb();
+	b->head += pad + size;
+	return true;
+}
+
+static int vprintk_deferred(int facility, int level,
+			    const char *dict, size_t dictlen,
+			    const char *fmt, va_list args)
+{
+	struct printk_cpu_buf *b = __this_cpu_read(printk_cpu_buf);
+	enum log_flags lflags = 0;
+	size_t text_len;
+	char *text;
+
+	/* an NMI, or a printk from within printk */
+	if (b->busy) {
+		b->dropped++;
+		return 0;
+	}
+	b->busy = 1;
+
+	text_len = vscnprintf(b->text, sizeof(b->text), fmt, args);
+	text = printk_parse(facility, &level, &lflags, b->text, &text_len);
+	if (dict)
+		lflags |= LOG_PREFIX|LOG_NEWLINE;
+
+	if (printk_cpu_store(b, facility, level, lflags,
+			     dict, dictlen, text, text_len))
+		b->deferred++;
+	else
+		b->dropped++;
+	printk_kick_output();
+
+	b->busy = 0;
+	return text_len;
+}
+
+/* Oldest unread record of @b, or NULL. Called with logbuf_lock held. */
+static struct printk_cpu_rec *printk_cpu_peek(struct printk_cpu_buf *b)
+{
+	unsigned int head = ACCESS_ONCE(b->head);
+	struct printk_cpu_rec *rec;
+	unsigned int pos;
+
+	if (b->tail == head)
+		return NULL;
+	smp_rmb();
+
+	pos = b->tail & (PRINTK_CPU_BUF_SIZE - 1);
+	rec = (struct printk_cpu_rec *)(b->data + pos);
+	if (PRINTK_CPU_BUF_SIZE - pos < sizeof(*rec) || !rec->len) {
+		/* skip the padding at the end of the buffer */
+		smp_mb();
+		b->tail += PRINTK_CPU_BUF_SIZE - pos;
+		rec = (struct printk_cpu_rec *)b->data;
+	}
+	return rec;
+}
+
+/*
+ * Move the record with the lowest sequence number from the per cpu buffers
+ * to the log. Called with logbuf_lock held. Returns 0 if there is nothing
+ * to move, and -EAGAIN if @in_order is set and the next record in sequence
+ * is still being written on another cpu.
+ */
+static int printk_cpu_drain_one(bool in_order)
+{
+	struct printk_cpu_buf *oldest = NULL;
+	struct printk_cpu_rec *r = NULL;
+	char *text;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct printk_cpu_buf *b = per_cpu(printk_cpu_buf, cpu);
+		struct printk_cpu_rec *rec;
+
+		if (!b)
+			continue;
+		rec = printk_cpu_peek(b);
+		if (rec && (!r || (s32)(rec->seq - r->seq) < 0)) {
+			r = rec;
+			oldest = b;
+		}
+	}
+	if (!r)
+		return 0;
+	if (in_order && r->seq != printk_cpu_seq_next)
+		return -EAGAIN;
+
+	text = (char *)(r + 1);
+	log_emit(r->facility, r->level, r->flags, r->ts_nsec, r->owner,
+		 r->dict_len ? text + r->text_len : NULL, r->dict_len,
+		 text, r->text_len);
+	printk_cpu_seq_next = r->seq + 1;
+
+	/* done reading the record before the cpu may reuse its space */
+	smp_mb();
+	oldest->tail += r->len;
+	return 1;
+}
+
+/* Report messages dropped since last time. Called with logbuf_lock held. */
+static void printk_cpu_report_dropped(void)
+{
+	static const char fmt[] = "printk: %lu messages dropped";
+	char text[sizeof(fmt) + 20];
+	unsigned long dropped = 0;
+	size_t len;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct printk_cpu_buf *b = per_cpu(printk_cpu_buf, cpu);
+
+		if (b)
+			dropped += ACCESS_ONCE(b->dropped);
+	}
+	if (dropped == printk_cpu_dropped_seen)
+		return;
+
+	len = scnprintf(text, sizeof(text), fmt,
+			dropped - printk_cpu_dropped_seen);
+	printk_cpu_dropped_seen = dropped;
+	/* emit KERN_WARNING message */
+	log_store(0, 4, LOG_PREFIX|LOG_NEWLINE, 0, NULL, 0, text, len);
+}
+
+static bool printk_cpu_pending(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct printk_cpu_buf *b = per_cpu(printk_cpu_buf, cpu);
+
+		if (b && ACCESS_ONCE(b->head) != ACCESS_ONCE(b->tail))
+			return true;
+	}
+	return false;
+}
+
+static int printk_kthread_fn(void *unused)
+{
+	unsigned long flags;
+	int spins = 0;
+	int ret;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_cpu_pending())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		/*
+		 * Take the lock for one record at a time, printk() on other
+		 * cpus does not wait for it anyway but the synchronous
+		 * path and the readers of the log do.
+		 */
+		do {
+			raw_spin_lock_irqsave(&logbuf_lock, flags);
+			ret = printk_cpu_drain_one(spins < 100);
+			if (!ret)
+				printk_cpu_report_dropped();
+			raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+
+			if (ret == -EAGAIN) {
+				spins++;
+				cpu_relax();
+			} else {
+				spins = 0;
+			}
+		} while (ret);
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	struct task_struct *tsk;
+	int cpu;
+
+	if (!printk_deferred)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		struct printk_cpu_buf *b;
+
+		b = kzalloc_node(sizeof(*b), GFP_KERNEL, cpu_to_node(cpu));
+		if (!b) {
+			pr_err("printk: no memory for deferred printk\n");
+			return -ENOMEM;
+		}
+		per_cpu(printk_cpu_buf, cpu) = b;
+	}
+
+	tsk = kthread_run(printk_kthread_fn, NULL, "printk");
+	if (IS_ERR(tsk)) {
+		pr_err("printk: failed to start printk thread\n");
+		return PTR_ERR(tsk);
+	}
+	/* the buffers must be visible before anyone uses them */
+	smp_wmb();
+	printk_kthread = tsk;
+	return 0;
+}
+early_initcall(printk_kthread_init);
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
@@ -1499,6 +1916,12 @@ asmlinkage int vprintk_emit(int facility, int level,
 	local_irq_save(flags);
 	this_cpu = smp_processor_id();
 
+	if (printk_cpu_active()) {
+		printed_len = vprintk_deferred(facility, level, dict, dictlen,
+					       fmt, args);
+		goto out_restore_irqs;
+	}
+
 	/*
 	 * Ouch, printk recursed into itself!
 	 */
@@ -1521,6 +1944,13 @@ asmlinkage int vprintk_emit(int facility, int level,
 	raw_spin_lock(&logbuf_lock);
 	logbuf_cpu = this_cpu;
 
+	/* deferred messages go first, whatever order the cpus left them in */
+	if (printk_kthread) {
+		while (printk_cpu_drain_one(false))
+			;
+		printk_cpu_report_dropped();
+	}
+
 	if (recursion_bug) {
 		static const char recursion_msg[] =
 			"BUG: recent printk recursion!";
@@ -1537,70 +1967,9 @@ asmlinkage int vprintk_emit(int facility, int level,
 	 * prefix which might be passed-in as a parameter.
 	 */
 	text_len = vscnprintf(text, sizeof(textbuf), fmt, args);
-
-	/* mark and strip a trailing newline */
-	if (text_len && text[text_len-1] == '\n') {
-		text_len--;
-		lflags |= LOG_NEWLINE;
-	}
-
-	/* strip kernel syslog prefix and extract log level or control flags */
-	if (facility == 0) {
-		int kern_level = printk_get_level(text);
-
-		if (kern_level) {
-			const char *end_of_header = printk_skip_level(text);
-			switch (kern_level) {
-			case '0' ... '7':
-				if (level == -1)
-					level = kern_level - '0';
-			case 'd':	/* KERN_DEFAULT */
-				lflags |= LOG_PREFIX;
-			case 'c':	/* KERN_CONT */
-				break;
-			}
-			text_len -= end_of_header - text;
-			text = (char *)end_of_header;
-		}
-	}
-
-	if (level == -1)
-		level = default_message_loglevel;
-
-	if (dict)
-		lflags |= LOG_PREFIX|LOG_NEWLINE;
-
-	if (!(lflags & LOG_NEWLINE)) {
-		/*
-		 * Flush the conflicting buffer. An earlier newline was missing,
-		 * or another task also prints continuation lines.
-		 */
-		if (cont.len && (lflags & LOG_PREFIX || cont.owner != current))
-			cont_flush(LOG_NEWLINE);
-
-		/* buffer line if possible, otherwise store it right away */
-		if (!cont_add(facility, level, text, text_len))
-			log_store(facility, level, lflags | LOG_CONT, 0,
-				  dict, dictlen, text, text_len);
-	} else {
-		bool stored = false;
-
-		/*
-		 * If an earlier newline was missing and it was the same task,
-		 * either merge it with the current buffer and flush, or if
-		 * there was a race with interrupts (prefix == true) then just
-		 * flush it out and store this line separately.
-		 */
-		if (cont.len && cont.owner == current) {
-			if (!(lflags & LOG_PREFIX))
-				stored = cont_add(facility, level, text, text_len);
-			cont_flush(LOG_NEWLINE);
-		}
-
-		if (!stored)
-			log_store(facility, level, lflags, 0,
-				  dict, dictlen, text, text_len);
-	}
+	text = printk_parse(facility, &level, &lflags, text, &text_len);
+	log_emit(facility, level, lflags, 0, current,
+		 dict, dictlen, text, text_len);
 	printed_len += text_len;
 
 	/*
@@ -1952,10 +2321,22 @@ int is_console_locked(void)
 
 #define PRINTK_PENDING_WAKEUP	0x01
 #define PRINTK_PENDING_SCHED	0x02
+#define PRINTK_PENDING_OUTPUT	0x04
 
 static DEFINE_PER_CPU(int, printk_pending);
 static DEFINE_PER_CPU(char [PRINTK_BUF_SIZE], printk_sched_buf);
 
+#ifdef CONFIG_PRINTK
+/*
+ * The printk kthread is woken from the tick, printk() itself may be called
+ * with scheduler locks held.
+ */
+static void printk_kick_output(void)
+{
+	__this_cpu_or(printk_pending, PRINTK_PENDING_OUTPUT);
+}
+#endif
+
 void printk_tick(void)
 {
 	if (__this_cpu_read(printk_pending)) {
@@ -1966,6 +2347,8 @@ void printk_tick(void)
 		}
 		if (pending & PRINTK_PENDING_WAKEUP)
 			wake_up_interruptible(&log_wait);
+		if (pending & PRINTK_PENDING_OUTPUT)
+			wake_up_process(printk_kthread);
 	}
 }
 
@@ -52,6 +52,7 @@
 #include <linux/prefetch.h>
 #include <linux/delay.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
 
 #include "rcutree.h"
 #include <trace/events/rcu.h>
@@ -62,7 +63,7 @@
 
 static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 
-#define RCU_STATE_INITIALIZER(sname, cr) { \
+#define RCU_STATE_INITIALIZER(sname, sabbr, cr) { \
 	.level = { &sname##_state.node[0] }, \
 	.call = cr, \
 	.fqs_state = RCU_GP_IDLE, \
@@ -74,13 +75,15 @@ static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 	.barrier_mutex = __MUTEX_INITIALIZER(sname##_state.barrier_mutex), \
 	.fqslock = __RAW_SPIN_LOCK_UNLOCKED(&sname##_state.fqslock), \
 	.name = #sname, \
+	.abbr = sabbr, \
 }
 
 struct rcu_state rcu_sched_state =
-	RCU_STATE_INITIALIZER(rcu_sched, call_rcu_sched);
+	RCU_STATE_INITIALIZER(rcu_sched, 's', call_rcu_sched);
 DEFINE_PER_CPU(struct rcu_data, rcu_sched_data);
 
-struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh, call_rcu_bh);
+struct rcu_state rcu_bh_state =
+	RCU_STATE_INITIALIZER(rcu_bh, 'b', call_rcu_bh);
 DEFINE_PER_CPU(struct rcu_data, rcu_bh_data);
 
 static struct rcu_state *rcu_state;
@@ -699,6 +702,13 @@ static int rcu_implicit_dynticks_qs(struct rcu_data *rdp)
 		return 1;
 	}
 
+	/*
+	 * A full dynticks CPU running a task takes no scheduling-clock
+	 * interrupts that could note its quiescent states, so kick it.
+	 */
+	if (tick_nohz_full_kick_cpu(rdp->cpu))
+		trace_rcu_fqs(rdp->rsp->name, rdp->gpnum, rdp->cpu, "kick");
+
 	/* Go check for the CPU being offline. */
 	return rcu_implicit_offline_qs(rdp);
 }
@@ -1403,6 +1413,10 @@ static void rcu_adopt_orphan_cbs(struct rcu_state *rsp)
 	    rsp->rcu_barrier_in_progress != current)
 		return;
 
+	/* No-CBs CPUs are handled specially. */
+	if (rcu_nocb_adopt_orphan_cbs(rsp, rdp))
+		return;
+
 	/* Do the accounting first. */
 	rdp->qlen_lazy += rsp->qlen_lazy;
 	rdp->qlen += rsp->qlen;
@@ -1669,6 +1683,7 @@ void rcu_check_callbacks(int cpu, int user)
 		rcu_bh_qs(cpu);
 	}
 	rcu_preempt_check_callbacks(cpu);
+	do_nocb_deferred_wakeup(cpu);
 	if (rcu_pending(cpu))
 		invoke_rcu_core();
 	trace_rcu_utilization("End scheduler-tick");
@@ -1943,6 +1958,12 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* No-CBs CPUs hand their callbacks to their rcuo kthread. */
+	if (__call_rcu_nocb(rdp, head, flags)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	ACCESS_ONCE(rdp->qlen)++;
 	if (lazy)
@@ -2278,7 +2299,8 @@ static int rcu_cpu_has_callbacks(int cpu)
 	for_each_rcu_flavor(rsp)
 		if (per_cpu_ptr(rsp->rda, cpu)->nxtlist)
 			return 1;
-	return 0;
+	/* Or an rcuo kthread still to be awakened from the tick? */
+	return rcu_nocb_need_deferred_wakeup(cpu);
 }
 
 /*
@@ -2405,7 +2427,13 @@ static void _rcu_barrier(struct rcu_state *rsp)
 	for_each_possible_cpu(cpu) {
 		preempt_disable();
 		rdp = per_cpu_ptr(rsp->rda, cpu);
-		if (cpu_is_offline(cpu)) {
+		if (is_nocb_cpu(cpu)) {
+			/* Online or not, the rcuo kthread invokes them. */
+			_rcu_barrier_trace(rsp, "NoCB", cpu,
+					   rsp->n_barrier_done);
+			preempt_enable();
+			rcu_nocb_barrier(rdp);
+		} else if (cpu_is_offline(cpu)) {
 			_rcu_barrier_trace(rsp, "Offline", cpu,
 					   rsp->n_barrier_done);
 			preempt_enable();
@@ -2502,6 +2530,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -2809,6 +2838,7 @@ void __init rcu_init(void)
 	rcu_init_one(&rcu_sched_state, &rcu_sched_data);
 	rcu_init_one(&rcu_bh_state, &rcu_bh_data);
 	__rcu_init_preempt();
+	rcu_init_nocb();
 	 open_softirq(RCU_SOFTIRQ, rcu_process_callbacks);
 
 	/*
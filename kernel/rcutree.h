@@ -318,6 +318,24 @@ struct rcu_data {
 	/* 6) _rcu_barrier() callback. */
 	struct rcu_head barrier_head;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 7) Callback offloading. */
+	struct rcu_head *nocb_head;	/* CBs waiting for kthread. */
+	struct rcu_head **nocb_tail;
+	atomic_long_t nocb_q_count;	/* # CBs waiting for kthread */
+	long nocb_p_count;		/* # CBs being invoked by kthread */
+	unsigned long n_nocb_invoked;	/* # CBs invoked by kthread */
+	unsigned long n_nocb_gps;	/* # GPs waited for, leader only */
+	bool nocb_defer_wakeup;		/* Wake kthread from next tick. */
+	struct rcu_head *nocb_batch;	/* CBs of the kthread's current */
+	struct rcu_head **nocb_batch_tail; /*  batch from this CPU. */
+	struct rcu_data *nocb_leader;	/* First CPU of this CPU's group. */
+	struct rcu_data *nocb_next;	/* Next CPU in the group. */
+	wait_queue_head_t nocb_wq;	/* For the group's kthread to */
+					/*  sleep on, leader only. */
+	struct task_struct *nocb_kthread; /* Leader only. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 	int cpu;
 	struct rcu_state *rsp;
 };
@@ -423,6 +441,7 @@ struct rcu_state {
 	unsigned long gp_max;			/* Maximum GP duration in */
 						/*  jiffies. */
 	char *name;				/* Name of structure. */
+	char abbr;				/* Abbreviated name. */
 	struct list_head flavors;		/* List of RCU flavors. */
 };
 
@@ -510,5 +529,15 @@ static void print_cpu_stall_info(struct rcu_state *rsp, int cpu);
 static void print_cpu_stall_info_end(void);
 static void zero_cpu_stall_ticks(struct rcu_data *rdp);
 static void increment_cpu_stall_ticks(void);
+static bool is_nocb_cpu(int cpu);
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    unsigned long flags);
+static bool rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
+				      struct rcu_data *rdp);
+static bool rcu_nocb_barrier(struct rcu_data *rdp);
+static bool rcu_nocb_need_deferred_wakeup(int cpu);
+static void do_nocb_deferred_wakeup(int cpu);
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp);
+static void __init rcu_init_nocb(void);
 
 #endif /* #ifndef RCU_TREE_NONCORE */
@@ -25,6 +25,7 @@
  */
 
 #include <linux/delay.h>
+#include <linux/bootmem.h>
 
 #define RCU_KTHREAD_PRIO 1
 
@@ -79,7 +80,7 @@ static void __init rcu_bootup_announce_oddness(void)
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
 struct rcu_state rcu_preempt_state =
-	RCU_STATE_INITIALIZER(rcu_preempt, call_rcu);
+	RCU_STATE_INITIALIZER(rcu_preempt, 'p', call_rcu);
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 static struct rcu_state *rcu_state = &rcu_preempt_state;
 
@@ -2227,3 +2228,469 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback invocation from the CPUs given by the rcu_nocbs=
+ * boot parameter ("no-CBs CPUs").  Their callbacks are queued locklessly
+ * and invoked by a kthread, so that RCU_SOFTIRQ does nothing but
+ * quiescent-state bookkeeping on them.  Consecutive no-CBs CPUs are
+ * grouped, rcu_nocb_group_size of them at a time, and each group has one
+ * "rcuo" kthread per RCU flavor.  The kthread takes everything that the
+ * group's CPUs queued so far, waits for a single grace period, invokes
+ * the lot and starts over.  The kthreads are affined to the CPUs that
+ * are not no-CBs CPUs, and may be moved elsewhere by the administrator.
+ */
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+static int rcu_nocb_group_size;	    /* CPUs per rcuo kthread, 0 = sqrt. */
+module_param(rcu_nocb_group_size, int, 0444);
+static char __initdata nocb_buf[NR_CPUS * 5];
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Enqueue the specified string of rcu_head structures onto the specified
+ * CPU's no-CBs list, and wake the group's rcuo kthread if the list was
+ * empty.  The kthread is awakened from the next scheduling-clock tick
+ * instead if the caller has interrupts disabled, because it might then
+ * be holding scheduler locks.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp,
+				    struct rcu_head **rhtp,
+				    long rhcount, unsigned long flags)
+{
+	struct rcu_head **old_rhpp;
+	struct rcu_data *leader = rdp->nocb_leader;
+
+	/* Enqueue the callbacks on the no-CBs list and update counts. */
+	old_rhpp = xchg(&rdp->nocb_tail, rhtp);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_add(rhcount, &rdp->nocb_q_count);
+
+	/* A non-empty list means that the kthread has been told already. */
+	if (old_rhpp != &rdp->nocb_head || !ACCESS_ONCE(leader->nocb_kthread))
+		return;
+	if (irqs_disabled_flags(flags))
+		rdp->nocb_defer_wakeup = true;
+	else
+		wake_up(&leader->nocb_wq);
+}
+
+static void rcu_nocb_gp_done(struct rcu_head *rhp);
+
+/*
+ * Hand the callback to the rcuo kthread if the CPU is a no-CBs CPU.
+ * Returns true if so, false if the caller must queue it normally.
+ * The callbacks that rcuo kthreads use to wait for grace periods are
+ * always queued normally, as they cannot wait for themselves.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    unsigned long flags)
+{
+	if (!is_nocb_cpu(rdp->cpu) || rhp->func == rcu_nocb_gp_done)
+		return false;
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1, flags);
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func,
+					 0, atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp, 0,
+				   atomic_long_read(&rdp->nocb_q_count));
+	return true;
+}
+
+/*
+ * Move the rcuo kthreads' grace-period callbacks from an orphan list to
+ * @rdp's own callback list, as __call_rcu_nocb() would have queued them:
+ * handed to an rcuo kthread, one could end up waiting for itself.
+ * Returns the number of callbacks moved.
+ */
+static long rcu_nocb_adopt_gp_cbs(struct rcu_data *rdp,
+				  struct rcu_head **list,
+				  struct rcu_head ***tail)
+{
+	struct rcu_head **rhpp = list;
+	struct rcu_head *rhp;
+	long n = 0;
+
+	while ((rhp = *rhpp) != NULL) {
+		if (rhp->func != rcu_nocb_gp_done) {
+			rhpp = &rhp->next;
+			continue;
+		}
+		*rhpp = rhp->next;
+		if (*tail == &rhp->next)
+			*tail = rhpp;
+		rhp->next = NULL;
+		ACCESS_ONCE(rdp->qlen)++;
+		rcu_idle_count_callbacks_posted();
+		*rdp->nxttail[RCU_NEXT_TAIL] = rhp;
+		rdp->nxttail[RCU_NEXT_TAIL] = &rhp->next;
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Adopt orphaned callbacks on a no-CBs CPU by queueing them for its rcuo
+ * kthread, the CPU's own callback list is not processed.  The ones that
+ * were done already get to wait for another grace period.  The exception
+ * are rcuo kthreads' own grace-period callbacks, which stay on the CPU's
+ * own list.
+ */
+static bool __maybe_unused rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
+						     struct rcu_data *rdp)
+{
+	long qll = rsp->qlen_lazy;
+	long ql = rsp->qlen;
+
+	if (!is_nocb_cpu(smp_processor_id()))
+		return false;
+	rsp->qlen = 0;
+	rsp->qlen_lazy = 0;
+
+	ql -= rcu_nocb_adopt_gp_cbs(rdp, &rsp->orphan_donelist,
+				    &rsp->orphan_donetail);
+	ql -= rcu_nocb_adopt_gp_cbs(rdp, &rsp->orphan_nxtlist,
+				    &rsp->orphan_nxttail);
+
+	/* First the ready-to-invoke callbacks, then the others. */
+	if (rsp->orphan_donelist != NULL) {
+		__call_rcu_nocb_enqueue(rdp, rsp->orphan_donelist,
+					rsp->orphan_donetail, ql, 0);
+		ql = qll = 0;
+		rsp->orphan_donelist = NULL;
+		rsp->orphan_donetail = &rsp->orphan_donelist;
+	}
+	if (rsp->orphan_nxtlist != NULL) {
+		__call_rcu_nocb_enqueue(rdp, rsp->orphan_nxtlist,
+					rsp->orphan_nxttail, ql, 0);
+		rsp->orphan_nxtlist = NULL;
+		rsp->orphan_nxttail = &rsp->orphan_nxtlist;
+	}
+	return true;
+}
+
+/*
+ * Post an rcu_barrier() callback behind the specified no-CBs CPU's
+ * callbacks, if it has any.
+ */
+static bool rcu_nocb_barrier(struct rcu_data *rdp)
+{
+	struct rcu_state *rsp = rdp->rsp;
+
+	if (!atomic_long_read(&rdp->nocb_q_count) &&
+	    !ACCESS_ONCE(rdp->nocb_p_count) &&
+	    !ACCESS_ONCE(rdp->nocb_head))
+		return false;
+	atomic_inc(&rsp->barrier_cpu_count);
+	smp_mb__after_atomic_inc(); /* Ensure atomic_inc() before callback. */
+	rdp->barrier_head.func = rcu_barrier_callback;
+	debug_rcu_head_queue(&rdp->barrier_head);
+	__call_rcu_nocb_enqueue(rdp, &rdp->barrier_head,
+				&rdp->barrier_head.next, 1, 0);
+	return true;
+}
+
+/* Does the specified CPU still need to awaken an rcuo kthread? */
+static bool rcu_nocb_need_deferred_wakeup(int cpu)
+{
+	struct rcu_state *rsp;
+
+	if (!is_nocb_cpu(cpu))
+		return false;
+	for_each_rcu_flavor(rsp)
+		if (ACCESS_ONCE(per_cpu_ptr(rsp->rda, cpu)->nocb_defer_wakeup))
+			return true;
+	return false;
+}
+
+/*
+ * Awaken the rcuo kthreads whose wakeup was deferred by __call_rcu()
+ * on the specified CPU, called from the scheduling-clock interrupt.
+ */
+static void do_nocb_deferred_wakeup(int cpu)
+{
+	struct rcu_state *rsp;
+	struct rcu_data *rdp;
+
+	if (!is_nocb_cpu(cpu))
+		return;
+	for_each_rcu_flavor(rsp) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		if (rdp->nocb_defer_wakeup) {
+			rdp->nocb_defer_wakeup = false;
+			wake_up(&rdp->nocb_leader->nocb_wq);
+		}
+	}
+}
+
+/* Does any CPU of the specified group have callbacks queued? */
+static bool rcu_nocb_group_has_cbs(struct rcu_data *leader)
+{
+	struct rcu_data *rdp;
+
+	for (rdp = leader; rdp; rdp = rdp->nocb_next)
+		if (ACCESS_ONCE(rdp->nocb_head))
+			return true;
+	return false;
+}
+
+struct rcu_nocb_gp {
+	struct rcu_head head;
+	struct completion done;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *rhp)
+{
+	struct rcu_nocb_gp *gp = container_of(rhp, struct rcu_nocb_gp, head);
+
+	complete(&gp->done);
+}
+
+/*
+ * Wait for a grace period of the specified flavor.  The callback is
+ * queued on the current CPU's own list even if it is a no-CBs CPU, see
+ * __call_rcu_nocb().
+ */
+static void rcu_nocb_wait_gp(struct rcu_state *rsp)
+{
+	struct rcu_nocb_gp gp;
+
+	init_rcu_head_on_stack(&gp.head);
+	init_completion(&gp.done);
+	rsp->call(&gp.head, rcu_nocb_gp_done);
+	wait_for_completion(&gp.done);
+	destroy_rcu_head_on_stack(&gp.head);
+}
+
+/*
+ * Per-group kthread: take the callbacks queued by the group's CPUs as
+ * one batch, wait for a grace period, invoke them, repeat.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	struct rcu_data *leader = arg;
+	struct rcu_state *rsp = leader->rsp;
+	struct rcu_head *list, *next, **tail;
+	struct rcu_data *rdp;
+	long c;
+
+	for (;;) {
+		wait_event_interruptible(leader->nocb_wq,
+					 rcu_nocb_group_has_cbs(leader));
+
+		/*
+		 * Extract the queued callbacks.  Count them as being
+		 * invoked before they stop being counted as queued, so
+		 * that rcu_barrier() never sees them as gone.
+		 */
+		for (rdp = leader; rdp; rdp = rdp->nocb_next) {
+			rdp->nocb_batch = ACCESS_ONCE(rdp->nocb_head);
+			if (!rdp->nocb_batch)
+				continue;
+			ACCESS_ONCE(rdp->nocb_head) = NULL;
+			rdp->nocb_batch_tail = xchg(&rdp->nocb_tail,
+						    &rdp->nocb_head);
+			c = atomic_long_read(&rdp->nocb_q_count);
+			ACCESS_ONCE(rdp->nocb_p_count) += c;
+			smp_mb(); /* Count as invoked before as not queued. */
+			atomic_long_sub(c, &rdp->nocb_q_count);
+		}
+
+		/* One grace period for the whole batch. */
+		rcu_nocb_wait_gp(rsp);
+		leader->n_nocb_gps++;
+
+		for (rdp = leader; rdp; rdp = rdp->nocb_next) {
+			list = rdp->nocb_batch;
+			tail = rdp->nocb_batch_tail;
+			if (!list)
+				continue;
+			trace_rcu_batch_start(rsp->name, 0,
+					      ACCESS_ONCE(rdp->nocb_p_count),
+					      -1);
+			c = 0;
+			while (list) {
+				next = ACCESS_ONCE(list->next);
+				/* Wait for enqueuing to complete, if needed. */
+				while (next == NULL && &list->next != tail) {
+					schedule_timeout_interruptible(1);
+					next = ACCESS_ONCE(list->next);
+				}
+				debug_rcu_head_unqueue(list);
+				local_bh_disable();
+				__rcu_reclaim(rsp->name, list);
+				local_bh_enable();
+				c++;
+				list = next;
+			}
+			trace_rcu_batch_end(rsp->name, c, false, 0, 0, 1);
+			ACCESS_ONCE(rdp->nocb_p_count) -= c;
+			rdp->n_nocb_invoked += c;
+			rdp->nocb_batch = NULL;
+			cond_resched();
+		}
+	}
+	return 0;
+}
+
+/* Initialize the no-CBs fields of a CPU's rcu_data structure. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	rdp->nocb_leader = rdp;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/* Split the no-CBs CPUs into groups, each with a leader CPU. */
+static void __init rcu_init_nocb(void)
+{
+	struct rcu_data *leader = NULL, *prev = NULL, *rdp;
+	struct rcu_state *rsp;
+	int cpu, n;
+
+#ifdef CONFIG_NO_HZ_FULL
+	/* The full dynticks CPUs cannot stop their tick with callbacks. */
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask &&
+		    zalloc_cpumask_var(&rcu_nocb_mask, GFP_KERNEL))
+			have_rcu_nocb_mask = true;
+		if (have_rcu_nocb_mask)
+			cpumask_or(rcu_nocb_mask, rcu_nocb_mask,
+				   tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
+	if (!have_rcu_nocb_mask)
+		return;
+
+	cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+	/* Someone has to take care of callbacks posted early in boot. */
+	if (cpumask_test_cpu(smp_processor_id(), rcu_nocb_mask)) {
+		pr_info("\tBoot CPU %d cannot be a no-CBs CPU.\n",
+			smp_processor_id());
+		cpumask_clear_cpu(smp_processor_id(), rcu_nocb_mask);
+	}
+	if (cpumask_empty(rcu_nocb_mask)) {
+		have_rcu_nocb_mask = false;
+		return;
+	}
+
+	if (rcu_nocb_group_size <= 0)
+		rcu_nocb_group_size = int_sqrt(nr_cpu_ids);
+	if (rcu_nocb_group_size <= 0)
+		rcu_nocb_group_size = 1;
+
+	cpulist_scnprintf(nocb_buf, sizeof(nocb_buf), rcu_nocb_mask);
+	pr_info("\tOffload RCU callbacks from CPUs: %s, %d per kthread.\n",
+		nocb_buf, rcu_nocb_group_size);
+
+	for_each_rcu_flavor(rsp) {
+		n = 0;
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			if (n++ % rcu_nocb_group_size == 0)
+				leader = rdp;
+			else
+				prev->nocb_next = rdp;
+			rdp->nocb_leader = leader;
+			prev = rdp;
+		}
+	}
+}
+
+/* Create one rcuo kthread per group and flavor. */
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	cpumask_var_t housekeeping;
+	struct task_struct *t;
+	struct rcu_state *rsp;
+	struct rcu_data *rdp;
+	int cpu;
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	if (!zalloc_cpumask_var(&housekeeping, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_andnot(housekeeping, cpu_possible_mask, rcu_nocb_mask);
+
+	for_each_rcu_flavor(rsp) {
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			if (rdp->nocb_leader != rdp)
+				continue;
+			t = kthread_run(rcu_nocb_kthread, rdp,
+					"rcuo%c/%d", rsp->abbr, cpu);
+			BUG_ON(IS_ERR(t));
+			set_cpus_allowed_ptr(t, housekeeping);
+			ACCESS_ONCE(rdp->nocb_kthread) = t;
+		}
+	}
+	free_cpumask_var(housekeeping);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    unsigned long flags)
+{
+	return false;
+}
+
+static bool __maybe_unused rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
+						     struct rcu_data *rdp)
+{
+	return false;
+}
+
+static bool rcu_nocb_barrier(struct rcu_data *rdp)
+{
+	return false;
+}
+
+static bool rcu_nocb_need_deferred_wakeup(int cpu)
+{
+	return false;
+}
+
+static void do_nocb_deferred_wakeup(int cpu)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+static void __init rcu_init_nocb(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
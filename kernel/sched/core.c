@@ -623,6 +623,17 @@ static inline bool got_nohz_idle_kick(void)
 
 #endif /* CONFIG_NO_HZ */
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Can the tick of the current CPU be stopped while it runs a task?
+ * Only if there is nothing to time-slice against.
+ */
+bool sched_can_stop_tick(void)
+{
+	return this_rq()->nr_running <= 1;
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 void sched_avg_update(struct rq *rq)
 {
 	s64 period = sched_avg_period();
@@ -1711,6 +1722,8 @@ static void __sched_fork(struct task_struct *p)
 	p->se.prev_sum_exec_runtime	= 0;
 	p->se.nr_migrations		= 0;
 	p->se.vruntime			= 0;
+	p->se.util_stamp		= 0;
+	p->se.util_avg			= 0;
 	INIT_LIST_HEAD(&p->se.group_node);
 
 #ifdef CONFIG_SCHEDSTATS
@@ -3380,6 +3393,7 @@ need_resched:
 	cpu = smp_processor_id();
 	rq = cpu_rq(cpu);
 	rcu_note_context_switch(cpu);
+	tick_nohz_task_switch();
 	prev = rq->curr;
 
 	schedule_debug(prev);
@@ -0,0 +1,30 @@
+/*
+ * Scheduler code and data structures related to cpufreq.
+ *
+ * The scheduler reports utilization changes of a cpu through the
+ * update_util_data hook registered for it, see cpufreq_update_util().
+ */
+
+#include <linux/export.h>
+
+#include "sched.h"
+
+DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_set_update_util_data - populate the CPU's update_util_data pointer
+ * @cpu: the cpu to set the pointer for
+ * @data: new pointer value, or NULL to clear it
+ *
+ * The callback is invoked from scheduler paths with the runqueue lock held.
+ * When clearing the pointer, the caller must wait for synchronize_sched()
+ * to return before freeing @data.
+ */
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data)
+{
+	if (WARN_ON(data && !data->func))
+		return;
+
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_set_update_util_data);
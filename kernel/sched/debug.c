@@ -285,6 +285,7 @@ do {									\
 	P(cpu_load[2]);
 	P(cpu_load[3]);
 	P(cpu_load[4]);
+	P(util_avg);
 #undef P
 #undef PN
 
@@ -489,6 +490,7 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 		   "nr_involuntary_switches", (long long)p->nivcsw);
 
 	P(se.load.weight);
+	P(se.util_avg);
 	P(policy);
 	P(prio);
 #undef PN
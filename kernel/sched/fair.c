@@ -2170,6 +2170,108 @@ static inline void hrtick_update(struct rq *rq)
 }
 #endif
 
+/*
+ * Utilization tracking.
+ *
+ * Tasks and runqueues keep a geometric average of the fraction of time
+ * they were runnable, in SCHED_POWER_SCALE units, sampled in ~1ms
+ * periods:
+ *
+ *   util' = util * y^n + SCHED_POWER_SCALE * (1 - y^n)	(runnable)
+ *   util' = util * y^n					(not runnable)
+ *
+ * where n is the number of periods elapsed and y^UTIL_HALFLIFE = 1/2.
+ * Unlike rq->load.weight this doesn't forget a task the moment it
+ * blocks, so bursty tasks still look busy between bursts.
+ *
+ * The rq average (fraction of time there were runnable fair tasks) is
+ * also what cpufreq is told about, so it rises four times faster than
+ * it decays: a burst is picked up within a few ticks, while short idle
+ * gaps don't drop the frequency straight away.
+ *
+ * Both are brought up to date, using rq->clock, on enqueue and dequeue
+ * and on every tick for the running task.
+ */
+#define UTIL_PERIOD_SHIFT	20
+#define UTIL_HALFLIFE		32	/* must match util_y_inv[] */
+#define UTIL_RISE_SHIFT		2
+
+/* y^n * 2^32 for n = 0..UTIL_HALFLIFE-1, where y^UTIL_HALFLIFE = 1/2 */
+static const u32 util_y_inv[UTIL_HALFLIFE] = {
+	0xffffffff, 0xfa83b2db, 0xf5257d15, 0xefe4b99b, 0xeac0c6e7, 0xe5b906e7,
+	0xe0ccdeec, 0xdbfbb797, 0xd744fcca, 0xd2a81d91, 0xce248c15, 0xc9b9bd86,
+	0xc5672a11, 0xc12c4cca, 0xbd08a39f, 0xb8fbaf47, 0xb504f333, 0xb123f581,
+	0xad583eea, 0xa9a15ab4, 0xa5fed6a9, 0xa2704303, 0x9ef53260, 0x9b8d39b9,
+	0x9837f051, 0x94f4efa8, 0x91c3d373, 0x8ea4398b, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+/* val * y^n */
+static unsigned long decay_util(unsigned long val, u64 n)
+{
+	if (n >= UTIL_HALFLIFE * 16)
+		return 0;
+
+	val >>= (unsigned int)n / UTIL_HALFLIFE;
+	return ((u64)val * util_y_inv[(unsigned int)n % UTIL_HALFLIFE]) >> 32;
+}
+
+/*
+ * Number of whole periods between *stamp and now; advances *stamp by
+ * that much.  The stamp of a task may come from another cpu's clock,
+ * don't let a clock running behind it turn into a huge interval.
+ */
+static u64 util_periods(u64 *stamp, u64 now)
+{
+	s64 delta = now - *stamp;
+	u64 periods;
+
+	if (delta < 0) {
+		*stamp = now;
+		return 0;
+	}
+
+	periods = (u64)delta >> UTIL_PERIOD_SHIFT;
+	*stamp += periods << UTIL_PERIOD_SHIFT;
+	return periods;
+}
+
+static void update_rq_util(struct rq *rq)
+{
+	u64 periods = util_periods(&rq->util_stamp, rq->clock);
+
+	if (!periods)
+		return;
+
+	/*
+	 * h_nr_running tells us what the rq looked like since the last
+	 * update: we are called before every change to it.
+	 */
+	if (rq->cfs.h_nr_running)
+		rq->util_avg = SCHED_POWER_SCALE -
+			decay_util(SCHED_POWER_SCALE - rq->util_avg,
+				   periods << UTIL_RISE_SHIFT);
+	else
+		rq->util_avg = decay_util(rq->util_avg, periods);
+}
+
+/* @runnable: whether @p was runnable since its last update */
+static void update_task_util(struct rq *rq, struct task_struct *p,
+			     int runnable)
+{
+	struct sched_entity *se = &p->se;
+	u64 periods = util_periods(&se->util_stamp, rq->clock);
+
+	if (!periods)
+		return;
+
+	if (runnable)
+		se->util_avg = SCHED_POWER_SCALE -
+			decay_util(SCHED_POWER_SCALE - se->util_avg, periods);
+	else
+		se->util_avg = decay_util(se->util_avg, periods);
+}
+
 /*
  * The enqueue_task method is called before nr_running is
  * increased. Here we update the fair scheduling stats and
@@ -2181,6 +2283,9 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	update_rq_util(rq);
+	update_task_util(rq, p, 0);
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
@@ -2214,6 +2319,8 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	if (!se)
 		inc_nr_running(rq);
 	hrtick_update(rq);
+
+	cpufreq_update_util(rq, rq->util_avg, SCHED_POWER_SCALE);
 }
 
 static void set_next_buddy(struct sched_entity *se);
@@ -2229,6 +2336,9 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct sched_entity *se = &p->se;
 	int task_sleep = flags & DEQUEUE_SLEEP;
 
+	update_rq_util(rq);
+	update_task_util(rq, p, 1);
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		dequeue_entity(cfs_rq, se, flags);
@@ -2331,6 +2441,36 @@ static unsigned long cpu_avg_load_per_task(int cpu)
 	return 0;
 }
 
+/*
+ * Utilization of a cpu, or of a task, decayed up to now if it had
+ * nothing to run since it was last updated.  These are read from the
+ * wakeup path without the rq lock, the result is only a hint.
+ */
+static unsigned long cpu_util(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+	u64 stamp = rq->util_stamp;
+	u64 now;
+
+	if (ACCESS_ONCE(rq->cfs.h_nr_running))
+		return rq->util_avg;
+
+	now = sched_clock_cpu(smp_processor_id());
+	return decay_util(rq->util_avg, util_periods(&stamp, now));
+}
+
+static unsigned long task_util(struct task_struct *p)
+{
+	u64 stamp = p->se.util_stamp;
+	u64 now;
+
+	if (p->on_rq)
+		return p->se.util_avg;
+
+	now = sched_clock_cpu(smp_processor_id());
+	return decay_util(p->se.util_avg, util_periods(&stamp, now));
+}
+
 
 static void task_waking_fair(struct task_struct *p)
 {
@@ -2469,6 +2609,39 @@ static inline unsigned long effective_load(struct task_group *tg, int cpu,
 
 #endif
 
+/*
+ * The loads above only see tasks which are queued right now: a waker
+ * which is about to block, or a wakee which runs in short bursts, look
+ * like nothing.  Decide on their utilization instead: p may come to
+ * this_cpu if it fits in the spare capacity there, or if this_cpu would
+ * still be less busy than prev_cpu (which p's utilization is part of).
+ */
+static int wake_affine_util(struct sched_domain *sd, struct task_struct *p,
+			    int sync, int this_cpu, int prev_cpu)
+{
+	unsigned long this_util = cpu_util(this_cpu);
+	unsigned long prev_util = cpu_util(prev_cpu);
+	unsigned long p_util = task_util(p);
+	s64 this_eff_util, prev_eff_util;
+
+	if (sync)
+		this_util -= min(this_util, task_util(current));
+
+	if ((this_util + p_util) * sd->imbalance_pct <=
+	    SCHED_POWER_SCALE * 100)
+		return 1;
+
+	this_eff_util = 100;
+	this_eff_util *= power_of(prev_cpu);
+	this_eff_util *= this_util + p_util;
+
+	prev_eff_util = 100 + (sd->imbalance_pct - 100) / 2;
+	prev_eff_util *= power_of(this_cpu);
+	prev_eff_util *= prev_util;
+
+	return this_eff_util <= prev_eff_util;
+}
+
 static int wake_affine(struct sched_domain *sd, struct task_struct *p, int sync)
 {
 	s64 this_load, load;
@@ -2509,7 +2682,9 @@ static int wake_affine(struct sched_domain *sd, struct task_struct *p, int sync)
 	 * Otherwise check if either cpus are near enough in load to allow this
 	 * task to be woken on this_cpu.
 	 */
-	if (this_load > 0) {
+	if (sched_feat(WAKE_UTIL)) {
+		balanced = wake_affine_util(sd, p, sync, this_cpu, prev_cpu);
+	} else if (this_load > 0) {
 		s64 this_eff_load, prev_eff_load;
 
 		this_eff_load = 100;
@@ -2656,28 +2831,44 @@ static int select_idle_sibling(struct task_struct *p, int target)
 
 	/*
 	 * Otherwise, iterate the domains and find an elegible idle cpu.
+	 * Of several idle groups, prefer the least utilized: a group whose
+	 * bursty tasks just blocked is likely to be busy again soon.
 	 */
 	sd = rcu_dereference(per_cpu(sd_llc, target));
 	for_each_lower_domain(sd) {
+		struct sched_group *idlest = NULL;
+		unsigned long util, min_util = ULONG_MAX;
+
 		sg = sd->groups;
 		do {
 			if (!cpumask_intersects(sched_group_cpus(sg),
 						tsk_cpus_allowed(p)))
 				goto next;
 
+			util = 0;
 			for_each_cpu(i, sched_group_cpus(sg)) {
 				if (!idle_cpu(i))
 					goto next;
+				if (sched_feat(WAKE_UTIL))
+					util += cpu_util(i);
 			}
 
-			target = cpumask_first_and(sched_group_cpus(sg),
-					tsk_cpus_allowed(p));
-			goto done;
+			if (util < min_util) {
+				min_util = util;
+				idlest = sg;
+			}
+			if (!sched_feat(WAKE_UTIL))
+				break;
 next:
 			sg = sg->next;
 		} while (sg != sd->groups);
+
+		if (idlest) {
+			target = cpumask_first_and(sched_group_cpus(idlest),
+					tsk_cpus_allowed(p));
+			break;
+		}
 	}
-done:
 	return target;
 }
 
@@ -4987,6 +5178,10 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	update_rq_util(rq);
+	update_task_util(rq, curr, 1);
+	cpufreq_update_util(rq, rq->util_avg, SCHED_POWER_SCALE);
 }
 
 /*
@@ -66,6 +66,13 @@ SCHED_FEAT(NONTASK_POWER, true)
  */
 SCHED_FEAT(TTWU_QUEUE, true)
 
+/*
+ * Use decayed utilization rather than instantaneous load to decide
+ * whether a wakee fits next to its waker, and to pick among idle
+ * siblings.
+ */
+SCHED_FEAT(WAKE_UTIL, true)
+
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
@@ -3,6 +3,7 @@
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
 
 #include "cpupri.h"
 
@@ -434,6 +435,10 @@ struct rq {
 	u64 prev_steal_time_rq;
 #endif
 
+	/* cfs utilization, see update_rq_util() */
+	u64 util_stamp;
+	unsigned long util_avg;
+
 	/* calc_load related fields */
 	unsigned long calc_load_update;
 	long calc_load_active;
@@ -920,6 +925,12 @@ static inline void cpuacct_charge(struct task_struct *tsk, u64 cputime) {}
 static inline void inc_nr_running(struct rq *rq)
 {
 	rq->nr_running++;
+
+#ifdef CONFIG_NO_HZ_FULL
+	/* The tick has to time-slice the second task against the first */
+	if (rq->nr_running == 2)
+		tick_nohz_full_kick_cpu(cpu_of(rq));
+#endif
 }
 
 static inline void dec_nr_running(struct rq *rq)
@@ -927,6 +938,32 @@ static inline void dec_nr_running(struct rq *rq)
 	rq->nr_running--;
 }
 
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_update_util - report the utilization of a runqueue to cpufreq
+ * @rq: runqueue whose utilization changed
+ * @util: current utilization
+ * @max: utilization of the cpu running at full capacity
+ *
+ * Called with @rq->lock held.
+ */
+static inline void cpufreq_update_util(struct rq *rq, unsigned long util,
+				       unsigned long max)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (data)
+		data->func(data, rq->clock, util, max);
+}
+#else
+static inline void cpufreq_update_util(struct rq *rq, unsigned long util,
+				       unsigned long max) { }
+#endif
+
 extern void update_rq_clock(struct rq *rq);
 
 extern void activate_task(struct rq *rq, struct task_struct *p, int flags);
@@ -348,8 +348,12 @@ void irq_exit(void)
 
 #ifdef CONFIG_NO_HZ
 	/* Make sure that timer wheel updates are propagated */
-	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
-		tick_nohz_irq_exit();
+	if (!in_interrupt() && !need_resched()) {
+		if (idle_cpu(smp_processor_id()))
+			tick_nohz_irq_exit();
+		else
+			tick_nohz_full_irq_exit();
+	}
 #endif
 	rcu_irq_exit();
 	sched_preempt_enable_no_resched();
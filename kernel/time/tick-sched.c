@@ -20,6 +20,9 @@
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/bootmem.h>
+#include <linux/perf_event.h>
+#include <linux/posix-timers.h>
 
 #include <asm/irq_regs.h>
 
@@ -301,6 +304,16 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 			delta_jiffies = rcu_delta_jiffies;
 		}
 	}
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * A busy CPU still wants a tick every second or so, to keep the
+	 * scheduler's clock and load statistics from going stale.
+	 */
+	if (!ts->inidle && delta_jiffies > HZ) {
+		next_jiffies = last_jiffies + HZ;
+		delta_jiffies = HZ;
+	}
+#endif
 	/*
 	 * Do not stop the tick, if we are only one off
 	 * or if the cpu is required for rcu
@@ -372,11 +385,14 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
-			calc_load_enter_idle();
+			if (ts->inidle) {
+				select_nohz_load_balancer(1);
+				calc_load_enter_idle();
+			}
 
 			ts->last_tick = hrtimer_get_expires(&ts->sched_timer);
 			ts->tick_stopped = 1;
+			timer_set_idle();
 		}
 
 		/*
@@ -430,6 +446,15 @@ static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
 	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
 		return false;
 
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * The full dynticks CPUs rely on the CPU doing do_timer() to
+	 * keep jiffies going, so it must not give up that duty.
+	 */
+	if (tick_nohz_full_running && cpu == tick_do_timer_cpu)
+		return false;
+#endif
+
 	if (need_resched())
 		return false;
 
@@ -542,6 +567,7 @@ ktime_t tick_nohz_get_sleep_length(void)
 
 static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
 {
+	timer_clear_idle();
 	hrtimer_cancel(&ts->sched_timer);
 	hrtimer_set_expires(&ts->sched_timer, ts->last_tick);
 
@@ -635,6 +661,234 @@ void tick_nohz_idle_exit(void)
 	local_irq_enable();
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Full dynticks: a CPU listed in nohz_full= also stops its tick while
+ * it runs a single task in user space.  Another CPU keeps doing
+ * do_timer(), and the CPUs that need a quiescent state from it for RCU
+ * kick it with an IPI, see tick_nohz_full_kick_cpu().  The tick is
+ * restarted as soon as the CPU schedules, a second task is queued, or a
+ * timer, posix CPU timer or perf event needs it.
+ */
+cpumask_var_t tick_nohz_full_mask;
+bool tick_nohz_full_running;
+
+static DEFINE_PER_CPU(struct call_single_data, tick_nohz_full_csd);
+static char __initdata nohz_full_buf[NR_CPUS * 5];
+
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu = smp_processor_id();
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_running = !cpumask_empty(tick_nohz_full_mask);
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+static bool can_stop_full_tick(struct tick_sched *ts)
+{
+	/* Low resolution hrtimers are run from the tick */
+	if (ts->nohz_mode != NOHZ_MODE_HIGHRES)
+		return false;
+
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+
+	if (!perf_event_can_stop_tick())
+		return false;
+
+	return true;
+}
+
+/*
+ * The tick does not account the time the task ran with the tick
+ * stopped, do it here.  All of it is accounted as user time.
+ */
+static void tick_nohz_full_account_ticks(struct tick_sched *ts)
+{
+	unsigned long ticks = jiffies - ts->full_jiffies;
+	cputime_t cputime;
+
+	ts->full_jiffies = jiffies;
+	if (ticks && ticks < LONG_MAX) {
+		cputime = jiffies_to_cputime(ticks);
+		account_user_time(current, cputime,
+				  cputime_to_scaled(cputime));
+	}
+}
+
+static void tick_nohz_full_stop_tick(struct tick_sched *ts, int cpu)
+{
+	int was_stopped = ts->tick_stopped;
+
+	tick_nohz_stop_sched_tick(ts, ktime_get(), cpu);
+
+	if (!was_stopped && ts->tick_stopped) {
+		ts->nohz_full_stopped = 1;
+		ts->full_jiffies = ts->last_jiffies;
+		ts->full_stops++;
+	}
+}
+
+static void tick_nohz_full_restart(struct tick_sched *ts)
+{
+	ktime_t now = ktime_get();
+
+	tick_do_update_jiffies64(now);
+	tick_nohz_full_account_ticks(ts);
+	touch_softlockup_watchdog();
+
+	ts->tick_stopped = 0;
+	ts->nohz_full_stopped = 0;
+
+	tick_nohz_restart(ts, now);
+}
+
+/**
+ * tick_nohz_full_irq_exit - stop or restart the tick of a busy CPU
+ *
+ * Called from irq_exit() when the CPU is not idle.  The tick is only
+ * stopped when the interrupt came from user space, because the kernel
+ * has no hook to notice the task entering the kernel again.
+ */
+void tick_nohz_full_irq_exit(void)
+{
+	int cpu = smp_processor_id();
+	struct tick_sched *ts = &per_cpu(tick_cpu_sched, cpu);
+	struct pt_regs *regs = get_irq_regs();
+
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	if (!can_stop_full_tick(ts)) {
+		if (ts->nohz_full_stopped)
+			tick_nohz_full_restart(ts);
+	} else if (ts->nohz_full_stopped || (regs && user_mode(regs))) {
+		tick_nohz_full_stop_tick(ts, cpu);
+	}
+}
+
+/**
+ * tick_nohz_task_switch - restart the tick before scheduling
+ *
+ * Called from __schedule(): the task the tick was stopped for might be
+ * about to give the CPU up, and the scheduler wants the tick back
+ * anyway when there is more than one task to run.  The tick is stopped
+ * again on the next interrupt from user space.
+ */
+void tick_nohz_task_switch(void)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+	unsigned long flags;
+
+	if (!ts->nohz_full_stopped)
+		return;
+
+	local_irq_save(flags);
+	if (ts->nohz_full_stopped)
+		tick_nohz_full_restart(ts);
+	local_irq_restore(flags);
+}
+
+static void tick_nohz_full_kick_func(void *info)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+	struct pt_regs *regs = get_irq_regs();
+
+	clear_bit(0, &ts->full_kick_pending);
+	if (!ts->nohz_full_stopped)
+		return;
+
+	ts->full_kicks++;
+	/*
+	 * Interrupting user space is a quiescent state for RCU, which is
+	 * why it kicks us.  Otherwise let the tick find one.  Whatever
+	 * else the kick was for is checked from irq_exit().  This needs
+	 * the architecture's IPI handler to set_irq_regs(): without them
+	 * the tick is restarted.
+	 */
+	if (regs && user_mode(regs))
+		rcu_check_callbacks(smp_processor_id(), 1);
+	else
+		tick_nohz_full_restart(ts);
+}
+
+/**
+ * tick_nohz_full_kick_cpu - make a full dynticks CPU reconsider its tick
+ * @cpu: the CPU to kick
+ *
+ * Sends an IPI if @cpu has its tick stopped while running a task,
+ * returns true if so.  The current CPU is made to reschedule instead,
+ * unless it is in an interrupt whose exit will reconsider the tick.
+ * Can be called with interrupts disabled and scheduler locks held.
+ */
+bool tick_nohz_full_kick_cpu(int cpu)
+{
+	struct tick_sched *ts = &per_cpu(tick_cpu_sched, cpu);
+
+	if (!ACCESS_ONCE(ts->nohz_full_stopped))
+		return false;
+
+	if (cpu == smp_processor_id()) {
+		if (!in_irq())
+			set_need_resched();
+		return false;
+	}
+
+	if (!cpu_online(cpu) || test_and_set_bit(0, &ts->full_kick_pending))
+		return false;
+
+	__smp_call_function_single(cpu, &per_cpu(tick_nohz_full_csd, cpu), 0);
+	return true;
+}
+
+/**
+ * tick_nohz_full_kick_all - kick all the full dynticks CPUs
+ */
+void tick_nohz_full_kick_all(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	preempt_disable();
+	for_each_cpu_and(cpu, tick_nohz_full_mask, cpu_online_mask)
+		tick_nohz_full_kick_cpu(cpu);
+	preempt_enable();
+}
+
+static int __init tick_nohz_full_init(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_running)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		per_cpu(tick_nohz_full_csd, cpu).func = tick_nohz_full_kick_func;
+
+	cpulist_scnprintf(nohz_full_buf, sizeof(nohz_full_buf),
+			  tick_nohz_full_mask);
+	printk(KERN_INFO "NOHZ: Full dynticks CPUs: %s.\n", nohz_full_buf);
+	return 0;
+}
+early_initcall(tick_nohz_full_init);
+#endif /* CONFIG_NO_HZ_FULL */
+
 static int tick_nohz_reprogram(struct tick_sched *ts, ktime_t now)
 {
 	hrtimer_forward(&ts->sched_timer, now, tick_period);
@@ -678,6 +932,10 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	if (ts->tick_stopped) {
 		touch_softlockup_watchdog();
 		ts->idle_jiffies++;
+#ifdef CONFIG_NO_HZ_FULL
+		if (ts->nohz_full_stopped)
+			ts->full_jiffies++;
+#endif
 	}
 
 	update_process_times(user_mode(regs));
@@ -837,6 +1095,10 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			if (is_idle_task(current))
 				ts->idle_jiffies++;
+#ifdef CONFIG_NO_HZ_FULL
+			if (ts->nohz_full_stopped)
+				ts->full_jiffies++;
+#endif
 		}
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
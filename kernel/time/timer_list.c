@@ -180,6 +180,11 @@ static void print_cpu(struct seq_file *m, int cpu, u64 now)
 		P(last_jiffies);
 		P(next_jiffies);
 		P_ns(idle_expires);
+#ifdef CONFIG_NO_HZ_FULL
+		P(nohz_full_stopped);
+		P(full_stops);
+		P(full_kicks);
+#endif
 		SEQ_printf(m, "jiffies: %Lu\n",
 			   (unsigned long long)jiffies);
 	}
@@ -55,40 +55,108 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The timer wheel.
+ *
+ * Timers are hashed into LVL_DEPTH levels of LVL_SIZE buckets.  Level 0
+ * has a granularity of one jiffy, and each following level is
+ * LVL_CLK_DIV times coarser:
+ *
+ * HZ 1000, 9 levels
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         62 ms
+ *  1     64         8 ms               63 ms -        503 ms
+ *  2    128        64 ms              504 ms -       4031 ms (~4s)
+ *  3    192       512 ms             4032 ms -      32255 ms (~32s)
+ *  4    256      4096 ms (~4s)      32256 ms -     258047 ms (~4m)
+ *  5    320     32768 ms (~32s)    258048 ms -    2064383 ms (~34m)
+ *  6    384    262144 ms (~4m)    2064384 ms -   16515071 ms (~4h)
+ *  7    448   2097152 ms (~34m)  16515072 ms -  132120575 ms (~1d)
+ *  8    512  16777216 ms (~4h)  132120576 ms - 1056964607 ms (~12d)
+ *
+ * A timer is queued once, in the level its timeout falls into, with its
+ * expiry rounded up to the granularity of that level, and stays there
+ * until it expires or is removed.  Unlike the old cascading wheel there
+ * is no re-hashing of timers from the outer levels, at the price of
+ * timers with long timeouts expiring up to 1/8th of their timeout late.
+ * Those are mostly networking and block layer timeouts which are
+ * cancelled long before they expire anyway.
+ *
+ * A bitmap of non-empty buckets lets the next expiry be found without
+ * walking the timers, and lets __run_timers() skip over a long idle
+ * period in one go.
+ *
+ * With CONFIG_BASE_SMALL the levels have 16 buckets instead of 64, which
+ * keeps the per-cpu bases small at the price of a shorter range and of
+ * timers expiring up to about half their timeout late.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-#define MAX_TVAL ((unsigned long)((1ULL << (TVR_BITS + 4*TVN_BITS)) - 1))
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+#define LVL_BITS	(CONFIG_BASE_SMALL ? 4 : 6)
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* First relative expiry which is hashed into level n */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+/* Timeouts beyond the last level are cut off to WHEEL_TIMEOUT_MAX */
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
+
+/*
+ * Each cpu has a base for normal timers and, with NO_HZ, separate ones
+ * for deferrable timers, which an idle cpu doesn't program its next
+ * event for.  On SMP the deferrable timers which were not armed on a
+ * particular cpu (add_timer_on(), mod_timer_pinned()) are run by a busy
+ * cpu while their own cpu is idle, see pull_idle_timers().
+ */
+#define BASE_STD		0
+#ifdef CONFIG_NO_HZ
+# define BASE_DEF		1
+# ifdef CONFIG_SMP
+#  define BASE_DEF_PINNED	2
+#  define NR_BASES		3
+# else
+#  define BASE_DEF_PINNED	BASE_DEF
+#  define NR_BASES		2
+# endif
+#else
+# define BASE_DEF		BASE_STD
+# define BASE_DEF_PINNED	BASE_STD
+# define NR_BASES		1
+#endif
 
 struct tvec_base {
 	spinlock_t lock;
 	struct timer_list *running_timer;
-	unsigned long timer_jiffies;
-	unsigned long next_timer;
+	unsigned long timer_jiffies;	/* next jiffy to process */
+	unsigned long next_timer;	/* stale if before timer_jiffies */
 	unsigned long active_timers;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	bool running;			/* in __run_timers() */
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
 EXPORT_SYMBOL(boot_tvec_bases);
-static DEFINE_PER_CPU(struct tvec_base *, tvec_bases) = &boot_tvec_bases;
+#if NR_BASES > 1
+static struct tvec_base boot_tvec_bases_def[NR_BASES - 1];
+#endif
+static DEFINE_PER_CPU(struct tvec_base *, tvec_bases[NR_BASES]) = {
+	&boot_tvec_bases,
+};
 
 /* Functions below help us manage 'deferrable' flag */
 static inline unsigned int tbase_get_deferrable(struct tvec_base *base)
@@ -113,6 +181,18 @@ timer_set_base(struct timer_list *timer, struct tvec_base *new_base)
 				      tbase_get_deferrable(timer->base));
 }
 
+/* The base of @cpu which @timer is to be queued on */
+static inline struct tvec_base *
+timer_target_base(struct timer_list *timer, int cpu, int pinned)
+{
+	int idx = BASE_STD;
+
+	if (tbase_get_deferrable(timer->base))
+		idx = pinned ? BASE_DEF_PINNED : BASE_DEF;
+
+	return per_cpu(tvec_bases, cpu)[idx];
+}
+
 static unsigned long round_jiffies_common(unsigned long j, int cpu,
 		bool force_up)
 {
@@ -332,62 +412,110 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
-static void
-__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+/*
+ * Bucket of the wheel for a timer expiring at @expires at level @lvl.
+ * Except for level 0 the expiry is rounded up to the granularity of
+ * the level so that the timer never fires early; the rounded expiry is
+ * returned in @bucket_expiry.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl,
+				      unsigned long *bucket_expiry)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	*bucket_expiry = expires << LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk,
+				     unsigned long *bucket_expiry)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long)delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than MAX_TVAL (on 64-bit
-		 * architectures or with CONFIG_BASE_SMALL=1) then we
-		 * use the maximum timeout.
+		*bucket_expiry = clk;
+		return clk & LVL_MASK;
+	}
+
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		/*
+		 * If the timeout is larger than the wheel can hold we use
+		 * the maximum timeout.
 		 */
-		if (idx > MAX_TVAL) {
-			idx = MAX_TVAL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		lvl = LVL_DEPTH - 1;
+	} else {
+		for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+			if (delta < LVL_START(lvl + 1))
+				break;
 	}
+	return calc_index(expires, lvl, bucket_expiry);
+}
+
+static unsigned long
+__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned long bucket_expiry;
+	unsigned int idx;
+
+	idx = calc_wheel_index(timer->expires, base->timer_jiffies,
+			       &bucket_expiry);
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
+
+	return bucket_expiry;
 }
 
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
-	__internal_add_timer(base, timer);
+	unsigned long bucket_expiry = __internal_add_timer(base, timer);
+
 	/*
 	 * Update base->active_timers and base->next_timer
 	 */
-	if (!tbase_get_deferrable(timer->base)) {
-		if (time_before(timer->expires, base->next_timer))
-			base->next_timer = timer->expires;
-		base->active_timers++;
+	if (time_before(bucket_expiry, base->next_timer))
+		base->next_timer = bucket_expiry;
+	base->active_timers++;
+}
+
+#ifdef CONFIG_NO_HZ
+static unsigned long __next_timer_interrupt(struct tvec_base *base);
+
+/*
+ * The clock of a base only advances in __run_timers(), so after an idle
+ * period it lags behind jiffies until the first timer softirq.  A new
+ * timer's level is chosen by its distance from that clock, so bring the
+ * clock up to date before queueing one, or the timer may land in a far
+ * too coarse level.  The clock must not pass the first pending bucket.
+ *
+ * Must be called with base->lock held.
+ */
+static void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long clk = jiffies;
+
+	if (base->running || !time_after(clk, base->timer_jiffies))
+		return;
+
+	if (base->active_timers) {
+		if (time_before_eq(base->next_timer, base->timer_jiffies))
+			base->next_timer = __next_timer_interrupt(base);
+		if (time_before(base->next_timer, clk))
+			clk = base->next_timer;
 	}
+	if (time_after(clk, base->timer_jiffies))
+		base->timer_jiffies = clk;
 }
+#else
+static inline void forward_timer_base(struct tvec_base *base) { }
+#endif
 
 #ifdef CONFIG_TIMER_STATS
 void __timer_stats_timer_set_start_info(struct timer_list *timer, void *addr)
@@ -620,7 +748,7 @@ static void __init_timer(struct timer_list *timer,
 			 struct lock_class_key *key)
 {
 	timer->entry.next = NULL;
-	timer->base = __raw_get_cpu_var(tvec_bases);
+	timer->base = __raw_get_cpu_var(tvec_bases)[BASE_STD];
 	timer->slack = -1;
 #ifdef CONFIG_TIMER_STATS
 	timer->start_site = NULL;
@@ -687,8 +815,26 @@ static inline void
 detach_expired_timer(struct timer_list *timer, struct tvec_base *base)
 {
 	detach_timer(timer, true);
-	if (!tbase_get_deferrable(timer->base))
-		timer->base->active_timers--;
+	base->active_timers--;
+}
+
+/*
+ * If @timer is the last timer of its bucket, mark the bucket empty.
+ * Timers which __run_timers() already took off the wheel are on a list
+ * of its own.
+ */
+static void wheel_clear_bucket(struct tvec_base *base,
+			       struct timer_list *timer)
+{
+	struct list_head *head = timer->entry.next;
+
+	if (head != timer->entry.prev)
+		return;
+	if (head < base->vectors || head >= base->vectors + WHEEL_SIZE)
+		return;
+
+	__clear_bit(head - base->vectors, base->pending_map);
+	base->next_timer = base->timer_jiffies;
 }
 
 static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
@@ -697,12 +843,9 @@ static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
 	if (!timer_pending(timer))
 		return 0;
 
+	wheel_clear_bucket(base, timer);
 	detach_timer(timer, clear_pending);
-	if (!tbase_get_deferrable(timer->base)) {
-		timer->base->active_timers--;
-		if (timer->expires == base->next_timer)
-			base->next_timer = base->timer_jiffies;
-	}
+	base->active_timers--;
 	return 1;
 }
 
@@ -763,7 +906,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	if (!pinned && get_sysctl_timer_migration() && idle_cpu(cpu))
 		cpu = get_nohz_timer_target();
 #endif
-	new_base = per_cpu(tvec_bases, cpu);
+	new_base = timer_target_base(timer, cpu, pinned);
 
 	if (base != new_base) {
 		/*
@@ -784,8 +927,13 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	}
 
 	timer->expires = expires;
+	forward_timer_base(base);
 	internal_add_timer(base, timer);
 
+	/* A stopped tick was programmed without this timer */
+	if (base == new_base && !tbase_get_deferrable(timer->base))
+		tick_nohz_full_kick_cpu(cpu);
+
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
 
@@ -941,7 +1089,7 @@ EXPORT_SYMBOL(add_timer);
  */
 void add_timer_on(struct timer_list *timer, int cpu)
 {
-	struct tvec_base *base = per_cpu(tvec_bases, cpu);
+	struct tvec_base *base = timer_target_base(timer, cpu, TIMER_PINNED);
 	unsigned long flags;
 
 	timer_stats_timer_set_start_info(timer);
@@ -949,6 +1097,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	spin_lock_irqsave(&base->lock, flags);
 	timer_set_base(timer, base);
 	debug_activate(timer, timer->expires);
+	forward_timer_base(base);
 	internal_add_timer(base, timer);
 	/*
 	 * Check whether the other CPU is idle and needs to be
@@ -959,6 +1108,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * the timer wheel.
 	 */
 	wake_up_idle_cpu(cpu);
+	tick_nohz_full_kick_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -1086,27 +1236,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		/* No accounting, while moving them */
-		__internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1150,133 +1279,164 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
-
-/**
- * __run_timers - run all expired timers (if any) on this CPU.
- * @base: the timer vector to be processed.
- *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+#ifdef CONFIG_NO_HZ
+/*
+ * Offset of the first pending bucket at or after @clk in the level
+ * starting at @offset, or -1 if the level is empty.
  */
-static inline void __run_timers(struct tvec_base *base)
+static int next_pending_bucket(struct tvec_base *base, unsigned int offset,
+			       unsigned int clk)
 {
-	struct timer_list *timer;
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
 
-	spin_lock_irq(&base->lock);
-	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
+	pos = find_next_bit(base->pending_map, end, start);
+	if (pos < end)
+		return pos - start;
 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
+	pos = find_next_bit(base->pending_map, start, offset);
+	return pos < start ? pos + LVL_SIZE - start : -1;
+}
 
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
+/*
+ * Find out when the next timer event is due to happen. This
+ * is used on S/390 to stop all activity when a CPU is idle.
+ * This function needs to be called with interrupts disabled.
+ */
+static unsigned long __next_timer_interrupt(struct tvec_base *base)
+{
+	unsigned long clk, next, adj;
+	unsigned int lvl, offset = 0;
 
-			timer_stats_account_timer(timer);
+	next = base->timer_jiffies + NEXT_TIMER_MAX_DELTA;
+	clk = base->timer_jiffies;
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		int pos = next_pending_bucket(base, offset, clk & LVL_MASK);
 
-			base->running_timer = timer;
-			detach_expired_timer(timer, base);
+		if (pos >= 0) {
+			unsigned long tmp = clk + (unsigned long)pos;
 
-			spin_unlock_irq(&base->lock);
-			call_timer_fn(timer, fn, data);
-			spin_lock_irq(&base->lock);
+			tmp <<= LVL_SHIFT(lvl);
+			if (time_before(tmp, next))
+				next = tmp;
 		}
+		/*
+		 * The next bucket of the next level to be processed is
+		 * the one clk falls into if clk is a multiple of the
+		 * level granularity, and the one after it otherwise.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
 	}
-	base->running_timer = NULL;
-	spin_unlock_irq(&base->lock);
+	return next;
 }
+#endif
 
-#ifdef CONFIG_NO_HZ
 /*
- * Find out when the next timer event is due to happen. This
- * is used on S/390 to stop all activity when a CPU is idle.
- * This function needs to be called with interrupts disabled.
+ * Move the buckets expiring at base->timer_jiffies to @heads, one per
+ * level.  Level n is only due when the low n * LVL_CLK_SHIFT bits of
+ * the clock are zero.
  */
-static unsigned long __next_timer_interrupt(struct tvec_base *base)
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
 {
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
+	unsigned long clk;
+	unsigned int idx;
+	int i, levels = 0;
+
+#ifdef CONFIG_NO_HZ
+	/*
+	 * After a long idle period, don't walk the wheel jiffy by jiffy:
+	 * forward the clock to the next expiring bucket, or to now if
+	 * there is none up to now.
+	 */
+	if ((long)(jiffies - base->timer_jiffies) > 2) {
+		unsigned long next = __next_timer_interrupt(base);
+
+		if (time_after(next, jiffies)) {
+			/* The caller increments the clock */
+			base->timer_jiffies = jiffies - 1;
+			return 0;
 		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
+		base->timer_jiffies = next;
+	}
+#endif
+	clk = base->timer_jiffies;
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + i * LVL_SIZE;
 
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_replace_init(base->vectors + idx, heads + levels++);
+
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
 	}
-	return expires;
+	return levels;
+}
+
+static void expire_timers(struct tvec_base *base, struct list_head *head)
+{
+	struct timer_list *timer;
+
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
+
+		timer = list_first_entry(head, struct timer_list, entry);
+		fn = timer->function;
+		data = timer->data;
+
+		timer_stats_account_timer(timer);
+
+		base->running_timer = timer;
+		detach_expired_timer(timer, base);
+
+		spin_unlock_irq(&base->lock);
+		call_timer_fn(timer, fn, data);
+		spin_lock_irq(&base->lock);
+	}
+}
+
+/**
+ * __run_timers - run all expired timers (if any) of a timer base.
+ * @base: the timer vector to be processed.
+ *
+ * This function executes all expired timer vectors.  The base may be
+ * another cpu's, see pull_idle_timers(); only one cpu at a time runs
+ * the timers of a base.
+ */
+static inline void __run_timers(struct tvec_base *base)
+{
+	struct list_head heads[LVL_DEPTH];
+	int levels;
+
+	spin_lock_irq(&base->lock);
+	if (base->running) {
+		spin_unlock_irq(&base->lock);
+		return;
+	}
+	base->running = true;
+
+	while (time_after_eq(jiffies, base->timer_jiffies)) {
+		levels = collect_expired_timers(base, heads);
+		++base->timer_jiffies;
+
+		while (levels--)
+			expire_timers(base, heads + levels);
+	}
+	base->running_timer = NULL;
+	base->running = false;
+#ifdef CONFIG_NO_HZ
+	if (base->active_timers &&
+	    time_before_eq(base->next_timer, base->timer_jiffies))
+		base->next_timer = __next_timer_interrupt(base);
+#endif
+	spin_unlock_irq(&base->lock);
 }
 
+#ifdef CONFIG_NO_HZ
 /*
  * Check, if the next hrtimer event is before the next timer wheel
  * event:
@@ -1327,7 +1487,7 @@ static unsigned long cmp_next_hrtimer_event(unsigned long now,
  */
 unsigned long get_next_timer_interrupt(unsigned long now)
 {
-	struct tvec_base *base = __this_cpu_read(tvec_bases);
+	struct tvec_base *base = __get_cpu_var(tvec_bases)[BASE_STD];
 	unsigned long expires = now + NEXT_TIMER_MAX_DELTA;
 
 	/*
@@ -1352,6 +1512,67 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 }
 #endif
 
+#if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
+/* cpus whose tick is stopped */
+static cpumask_var_t timers_idle_mask;
+static unsigned long timers_last_pull;
+
+/**
+ * timer_set_idle - tell the timer code that this cpu stopped its tick
+ *
+ * Its deferrable timers which are not pinned to it are then run by
+ * other cpus.
+ */
+void timer_set_idle(void)
+{
+	int cpu = smp_processor_id();
+
+	if (!cpumask_test_cpu(cpu, timers_idle_mask))
+		cpumask_set_cpu(cpu, timers_idle_mask);
+}
+
+/**
+ * timer_clear_idle - tell the timer code that this cpu restarted its tick
+ */
+void timer_clear_idle(void)
+{
+	int cpu = smp_processor_id();
+
+	if (cpumask_test_cpu(cpu, timers_idle_mask))
+		cpumask_clear_cpu(cpu, timers_idle_mask);
+}
+
+/*
+ * Run the expired deferrable timers of cpus which stopped their tick,
+ * so that they neither wake those cpus up nor wait for them.  Only one
+ * busy cpu per jiffy does this.
+ */
+static void pull_idle_timers(void)
+{
+	unsigned long last = ACCESS_ONCE(timers_last_pull);
+	unsigned long now = jiffies;
+	int this_cpu = smp_processor_id();
+	int cpu;
+
+	if (last == now || cpumask_test_cpu(this_cpu, timers_idle_mask))
+		return;
+	if (cmpxchg(&timers_last_pull, last, now) != last)
+		return;
+
+	for_each_cpu(cpu, timers_idle_mask) {
+		struct tvec_base *base = per_cpu(tvec_bases, cpu)[BASE_DEF];
+
+		if (cpu == this_cpu || !ACCESS_ONCE(base->active_timers))
+			continue;
+		if (time_before(now, ACCESS_ONCE(base->next_timer)))
+			continue;
+		__run_timers(base);
+	}
+}
+#else
+static inline void pull_idle_timers(void) { }
+#endif
+
 /*
  * Called from the timer interrupt handler to charge one tick to the current
  * process.  user_tick is 1 if the tick is user time, 0 for system.
@@ -1379,12 +1600,17 @@ void update_process_times(int user_tick)
  */
 static void run_timer_softirq(struct softirq_action *h)
 {
-	struct tvec_base *base = __this_cpu_read(tvec_bases);
+	struct tvec_base **bases = __get_cpu_var(tvec_bases);
+	int i;
 
 	hrtimer_run_pending();
 
-	if (time_after_eq(jiffies, base->timer_jiffies))
-		__run_timers(base);
+	for (i = 0; i < NR_BASES; i++) {
+		if (time_after_eq(jiffies, bases[i]->timer_jiffies))
+			__run_timers(bases[i]);
+	}
+
+	pull_idle_timers();
 }
 
 /*
@@ -1656,9 +1882,25 @@ SYSCALL_DEFINE1(sysinfo, struct sysinfo __user *, info)
 	return 0;
 }
 
-static int __cpuinit init_timers_cpu(int cpu)
+static void __cpuinit init_timer_base(struct tvec_base *base)
 {
 	int j;
+
+	spin_lock_init(&base->lock);
+
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SIZE);
+
+	base->timer_jiffies = jiffies;
+	base->next_timer = base->timer_jiffies;
+	base->active_timers = 0;
+	base->running = false;
+}
+
+static int __cpuinit init_timers_cpu(int cpu)
+{
+	int i;
 	struct tvec_base *base;
 	static char __cpuinitdata tvec_base_done[NR_CPUS];
 
@@ -1669,7 +1911,7 @@ static int __cpuinit init_timers_cpu(int cpu)
 			/*
 			 * The APs use this path later in boot
 			 */
-			base = kmalloc_node(sizeof(*base),
+			base = kmalloc_node(sizeof(*base) * NR_BASES,
 						GFP_KERNEL | __GFP_ZERO,
 						cpu_to_node(cpu));
 			if (!base)
@@ -1681,7 +1923,8 @@ static int __cpuinit init_timers_cpu(int cpu)
 				kfree(base);
 				return -ENOMEM;
 			}
-			per_cpu(tvec_bases, cpu) = base;
+			for (i = 0; i < NR_BASES; i++)
+				per_cpu(tvec_bases, cpu)[i] = base + i;
 		} else {
 			/*
 			 * This is for the boot CPU - we use compile-time
@@ -1690,27 +1933,18 @@ static int __cpuinit init_timers_cpu(int cpu)
 			 * initialised either.
 			 */
 			boot_done = 1;
-			base = &boot_tvec_bases;
+			per_cpu(tvec_bases, cpu)[BASE_STD] = &boot_tvec_bases;
+#if NR_BASES > 1
+			for (i = 1; i < NR_BASES; i++)
+				per_cpu(tvec_bases, cpu)[i] =
+					&boot_tvec_bases_def[i - 1];
+#endif
 		}
 		tvec_base_done[cpu] = 1;
-	} else {
-		base = per_cpu(tvec_bases, cpu);
 	}
 
-	spin_lock_init(&base->lock);
-
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
-
-	base->timer_jiffies = jiffies;
-	base->next_timer = base->timer_jiffies;
-	base->active_timers = 0;
+	for (i = 0; i < NR_BASES; i++)
+		init_timer_base(per_cpu(tvec_bases, cpu)[i]);
 	return 0;
 }
 
@@ -1719,6 +1953,7 @@ static void migrate_timer_list(struct tvec_base *new_base, struct list_head *hea
 {
 	struct timer_list *timer;
 
+	forward_timer_base(new_base);
 	while (!list_empty(head)) {
 		timer = list_first_entry(head, struct timer_list, entry);
 		/* We ignore the accounting on the dying cpu */
@@ -1728,15 +1963,11 @@ static void migrate_timer_list(struct tvec_base *new_base, struct list_head *hea
 	}
 }
 
-static void __cpuinit migrate_timers(int cpu)
+static void __cpuinit migrate_timer_base(struct tvec_base *old_base,
+					 struct tvec_base *new_base)
 {
-	struct tvec_base *old_base;
-	struct tvec_base *new_base;
 	int i;
 
-	BUG_ON(cpu_online(cpu));
-	old_base = per_cpu(tvec_bases, cpu);
-	new_base = get_cpu_var(tvec_bases);
 	/*
 	 * The caller is globally serialized and nobody else
 	 * takes two locks at once, deadlock is not possible.
@@ -1744,19 +1975,52 @@ static void __cpuinit migrate_timers(int cpu)
 	spin_lock_irq(&new_base->lock);
 	spin_lock_nested(&old_base->lock, SINGLE_DEPTH_NESTING);
 
+	/*
+	 * A busy cpu may still be in pull_idle_timers() for this base,
+	 * with expired timers taken off the wheel and the lock dropped
+	 * around their callbacks.  Wait for it to finish before moving
+	 * the rest, the callbacks might want new_base->lock.
+	 */
+	while (old_base->running) {
+		spin_unlock(&old_base->lock);
+		spin_unlock_irq(&new_base->lock);
+		cpu_relax();
+		spin_lock_irq(&new_base->lock);
+		spin_lock_nested(&old_base->lock, SINGLE_DEPTH_NESTING);
+	}
+
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
+	bitmap_zero(old_base->pending_map, WHEEL_SIZE);
+	old_base->active_timers = 0;
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
+}
+
+static void __cpuinit migrate_timers(int cpu)
+{
+	struct tvec_base **old_bases;
+	struct tvec_base **new_bases;
+	int i;
+
+	BUG_ON(cpu_online(cpu));
+#if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
+	/*
+	 * Keep pull_idle_timers() away from the dead cpu's bases, a puller
+	 * which already saw it in the mask is waited for below.
+	 */
+	cpumask_clear_cpu(cpu, timers_idle_mask);
+	smp_mb__after_clear_bit();
+#endif
+	old_bases = per_cpu(tvec_bases, cpu);
+	new_bases = get_cpu_var(tvec_bases);
+
+	for (i = 0; i < NR_BASES; i++)
+		migrate_timer_base(old_bases[i], new_bases[i]);
+
 	put_cpu_var(tvec_bases);
 }
 #endif /* CONFIG_HOTPLUG_CPU */
@@ -1797,6 +2061,9 @@ void __init init_timers(void)
 				(void *)(long)smp_processor_id());
 
 	init_timer_stats();
+#if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
+	BUG_ON(!zalloc_cpumask_var(&timers_idle_mask, GFP_NOWAIT));
+#endif
 
 	BUG_ON(err != NOTIFY_OK);
 	register_cpu_notifier(&timers_nb);
@@ -0,0 +1,282 @@
+/*
+ * Timer wheel benchmark
+ *
+ * Arms, re-arms and cancels a large number of timers from one thread per
+ * online cpu, the way networking code handles retransmit and keepalive
+ * timers, and reports the cost per operation and how late the timers
+ * which were left to expire fired.
+ *
+ *   modprobe timer_bench nr_timers=4000000 cancel_pct=95
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/cpu.h>
+#include <linux/slab.h>
+#include <linux/atomic.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Timer wheel benchmark");
+
+static unsigned long nr_timers = 1000000;
+module_param(nr_timers, ulong, 0444);
+MODULE_PARM_DESC(nr_timers, "Total number of timers (default 1000000)");
+
+static unsigned int min_timeout_ms = 200;
+module_param(min_timeout_ms, uint, 0444);
+MODULE_PARM_DESC(min_timeout_ms, "Shortest timeout in ms (default 200)");
+
+static unsigned int max_timeout_ms = 10000;
+module_param(max_timeout_ms, uint, 0444);
+MODULE_PARM_DESC(max_timeout_ms, "Longest timeout in ms (default 10000)");
+
+static unsigned int cancel_pct = 90;
+module_param(cancel_pct, uint, 0444);
+MODULE_PARM_DESC(cancel_pct, "Percentage of timers cancelled (default 90)");
+
+/*
+ * Short timeouts may fire while the thread is still arming, and are then
+ * armed again.  Only the timers which are pending when the cancel loop
+ * reaches them are measured: @state is 1 while such a timer is waited
+ * for, and 2 once it fired.
+ */
+struct bench_timer {
+	struct timer_list timer;
+	atomic_t state;
+};
+
+struct bench_thread {
+	struct task_struct *task;
+	struct bench_timer *timers;
+	unsigned long nr;
+	u64 arm_ns;
+	u64 rearm_ns;
+	u64 cancel_ns;
+	unsigned long cancelled;
+	unsigned long measured;
+	int err;
+};
+
+static struct bench_thread *threads;
+static int nr_bench_threads;
+static atomic_t threads_done;
+static DECLARE_COMPLETION(bench_done);
+
+static atomic_long_t nr_fired;
+static atomic_long_t total_late;
+static unsigned long max_late;
+
+static void bench_timer_fn(unsigned long data)
+{
+	struct bench_timer *t = (struct bench_timer *)data;
+	unsigned long late = jiffies - t->timer.expires;
+	unsigned long old;
+
+	/* A run of an earlier arm, racing with the timer being re-armed */
+	if ((long)late < 0)
+		return;
+	if (atomic_cmpxchg(&t->state, 1, 2) != 1)
+		return;
+
+	atomic_long_inc(&nr_fired);
+	atomic_long_add(late, &total_late);
+	do {
+		old = ACCESS_ONCE(max_late);
+		if (late <= old)
+			break;
+	} while (cmpxchg(&max_late, old, late) != old);
+}
+
+static unsigned long bench_timeout(void)
+{
+	unsigned long min = msecs_to_jiffies(min_timeout_ms);
+	unsigned long max = msecs_to_jiffies(max_timeout_ms);
+
+	return jiffies + min + random32() % (max - min + 1);
+}
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	unsigned long i;
+	ktime_t start;
+
+	bt->timers = vmalloc(bt->nr * sizeof(*bt->timers));
+	if (!bt->timers) {
+		bt->err = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < bt->nr; i++) {
+		setup_timer(&bt->timers[i].timer, bench_timer_fn,
+			    (unsigned long)&bt->timers[i]);
+		atomic_set(&bt->timers[i].state, 0);
+	}
+
+	start = ktime_get();
+	for (i = 0; i < bt->nr; i++) {
+		mod_timer(&bt->timers[i].timer, bench_timeout());
+		cond_resched();
+	}
+	bt->arm_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < bt->nr; i++) {
+		mod_timer(&bt->timers[i].timer, bench_timeout());
+		cond_resched();
+	}
+	bt->rearm_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < bt->nr; i++) {
+		struct bench_timer *t = &bt->timers[i];
+
+		if (random32() % 100 < cancel_pct) {
+			bt->cancelled += del_timer(&t->timer);
+		} else {
+			/*
+			 * If it is no longer pending it either fired
+			 * before, or it fired just now and was counted.
+			 */
+			atomic_set(&t->state, 1);
+			smp_mb();
+			if (timer_pending(&t->timer) ||
+			    atomic_cmpxchg(&t->state, 1, 0) != 1)
+				bt->measured++;
+		}
+		cond_resched();
+	}
+	bt->cancel_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+out:
+	if (atomic_inc_return(&threads_done) == nr_bench_threads)
+		complete(&bench_done);
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+	}
+	return 0;
+}
+
+static u64 per_op(u64 ns, unsigned long nr)
+{
+	return nr ? div64_u64(ns, nr) : 0;
+}
+
+static int __init timer_bench_init(void)
+{
+	unsigned long expected = 0, cancelled = 0, fired;
+	u64 arm_ns = 0, rearm_ns = 0, cancel_ns = 0;
+	unsigned long deadline;
+	int cpu, i = 0, err = 0;
+
+	if (!nr_timers || min_timeout_ms > max_timeout_ms || cancel_pct > 100)
+		return -EINVAL;
+
+	get_online_cpus();
+	nr_bench_threads = num_online_cpus();
+	threads = kcalloc(nr_bench_threads, sizeof(*threads), GFP_KERNEL);
+	if (!threads) {
+		put_online_cpus();
+		return -ENOMEM;
+	}
+
+	for_each_online_cpu(cpu) {
+		struct bench_thread *bt = &threads[i];
+
+		bt->nr = nr_timers / nr_bench_threads +
+			 (i < nr_timers % nr_bench_threads);
+		bt->task = kthread_create(bench_thread_fn, bt,
+					  "timer_bench/%d", cpu);
+		if (IS_ERR(bt->task)) {
+			err = PTR_ERR(bt->task);
+			bt->task = NULL;
+			nr_bench_threads = i;
+			break;
+		}
+		kthread_bind(bt->task, cpu);
+		i++;
+	}
+	put_online_cpus();
+
+	if (!nr_bench_threads)
+		goto out_free;
+	if (err) {
+		pr_warn("timer_bench: only %d threads\n", nr_bench_threads);
+		err = 0;
+	}
+
+	for (i = 0; i < nr_bench_threads; i++)
+		wake_up_process(threads[i].task);
+	wait_for_completion(&bench_done);
+
+	for (i = 0; i < nr_bench_threads; i++) {
+		struct bench_thread *bt = &threads[i];
+
+		if (bt->err)
+			err = bt->err;
+		if (!bt->timers)
+			continue;
+		expected += bt->measured;
+		cancelled += bt->cancelled;
+		arm_ns += bt->arm_ns;
+		rearm_ns += bt->rearm_ns;
+		cancel_ns += bt->cancel_ns;
+	}
+
+	/* Wait for the timers which were not cancelled */
+	deadline = jiffies + msecs_to_jiffies(max_timeout_ms) + 10 * HZ;
+	while (atomic_long_read(&nr_fired) < expected &&
+	       time_before(jiffies, deadline))
+		msleep(100);
+	fired = atomic_long_read(&nr_fired);
+
+	pr_info("timer_bench: %d threads, %lu timers, %u-%u ms\n",
+		nr_bench_threads, nr_timers, min_timeout_ms, max_timeout_ms);
+	pr_info("timer_bench: arm %llu ns, re-arm %llu ns, cancel %llu ns per timer\n",
+		per_op(arm_ns, nr_timers), per_op(rearm_ns, nr_timers),
+		per_op(cancel_ns, nr_timers));
+	pr_info("timer_bench: %lu cancelled, %lu of %lu fired, late avg %lu max %lu jiffies\n",
+		cancelled, fired, expected,
+		fired ? atomic_long_read(&total_late) / fired : 0, max_late);
+	if (fired != expected)
+		err = -ETIMEDOUT;
+
+out_free:
+	for (i = 0; i < nr_bench_threads; i++) {
+		struct bench_thread *bt = &threads[i];
+		unsigned long j;
+
+		kthread_stop(bt->task);
+		if (!bt->timers)
+			continue;
+		for (j = 0; j < bt->nr; j++)
+			del_timer_sync(&bt->timers[j].timer);
+		vfree(bt->timers);
+	}
+	kfree(threads);
+
+	return err;
+}
+
+static void __exit timer_bench_exit(void)
+{
+}
+
+module_init(timer_bench_init);
+module_exit(timer_bench_exit);
@@ -41,6 +41,13 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/jump_label.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/hash.h>
+#include <linux/uaccess.h>
+#include <linux/device.h>
+#include <linux/nodemask.h>
 
 #include "workqueue_sched.h"
 
@@ -122,11 +129,15 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * A: wq_attrs_mutex protected for writes, unbound workers and the
+ *    queueing path may read without it.
  */
 
 struct global_cwq;
 struct worker_pool;
 struct idle_rebind;
+struct wq_device;
 
 /*
  * The poor guys doing the actual heavy lifting.  All on-duty workers
@@ -152,6 +163,8 @@ struct worker {
 	/* for rebinding worker to CPU */
 	struct idle_rebind	*idle_rebind;	/* L: for idle worker */
 	struct work_struct	rebind_work;	/* L: for busy worker */
+
+	unsigned int		attrs_gen;	/* self: unbound attrs applied */
 };
 
 struct worker_pool {
@@ -236,6 +249,28 @@ typedef unsigned long mayday_mask_t;
 #define free_mayday_mask(mask)			do { } while (0)
 #endif
 
+#ifdef CONFIG_WQ_STATS
+/*
+ * Statistics, collected while wq_stats_key is enabled.  Latencies are
+ * measured from insert_work() to the start of execution, and sorted
+ * into log2 usecs buckets, the last one being open-ended.
+ */
+#define WQ_STATS_LAT_BUCKETS	20
+
+struct wq_stats {
+	unsigned long		nr_executed;
+	unsigned long		nr_long;	/* ran over wq_long_work_us */
+	unsigned long		nr_rescued;	/* rescuer activations */
+	int			max_concurrency; /* highest pool nr_running */
+	int			max_active;	/* highest cwq nr_active */
+	u64			lat_total;
+	u64			lat_max;
+	u64			exec_total;
+	u64			exec_max;
+	unsigned long		lat_hist[WQ_STATS_LAT_BUCKETS];
+};
+#endif
+
 /*
  * The externally visible workqueue abstraction is an array of
  * per-CPU workqueues:
@@ -244,7 +279,7 @@ struct workqueue_struct {
 	unsigned int		flags;		/* W: WQ_* flags */
 	union {
 		struct cpu_workqueue_struct __percpu	*pcpu;
-		struct cpu_workqueue_struct		*single;
+		struct cpu_workqueue_struct		*nodes;
 		unsigned long				v;
 	} cpu_wq;				/* I: cwq's */
 	struct list_head	list;		/* W: list of all workqueues */
@@ -262,8 +297,19 @@ struct workqueue_struct {
 
 	int			nr_drainers;	/* W: drain in progress */
 	int			saved_max_active; /* W: saved cwq max_active */
+
+	/* attributes of unbound workers, see worker_apply_attrs() */
+	cpumask_var_t		cpumask;	/* A: allowed cpus */
+	int			nice;		/* A: nice level */
+	unsigned int		attrs_gen;	/* A: 0 while using defaults */
+#ifdef CONFIG_SYSFS
+	struct wq_device	*wq_dev;	/* I: for WQ_SYSFS */
+#endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map	lockdep_map;
+#endif
+#ifdef CONFIG_WQ_STATS
+	struct wq_stats __percpu *stats;	/* I: statistics */
 #endif
 	char			name[];		/* I: workqueue name */
 };
@@ -303,6 +349,11 @@ static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 		}
 		if (sw & 2)
 			return WORK_CPU_UNBOUND;
+	} else if (cpu < WORK_CPU_NONE) {
+		int node = next_node(cpu - WORK_CPU_UNBOUND, node_possible_map);
+
+		if (node < MAX_NUMNODES)
+			return WORK_CPU_UNBOUND + node;
 	}
 	return WORK_CPU_NONE;
 }
@@ -316,15 +367,15 @@ static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
 /*
  * CPU iterators
  *
- * An extra gcwq is defined for an invalid cpu number
- * (WORK_CPU_UNBOUND) to host workqueues which are not bound to any
- * specific CPU.  The following iterators are similar to
- * for_each_*_cpu() iterators but also considers the unbound gcwq.
+ * Extra gcwqs are defined for invalid cpu numbers, one per possible
+ * NUMA node starting at WORK_CPU_UNBOUND, to host workqueues which are
+ * not bound to any specific CPU.  The following iterators are similar
+ * to for_each_*_cpu() iterators but also consider the unbound gcwqs.
  *
- * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
- * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
+ * for_each_gcwq_cpu()		: possible CPUs + unbound gcwqs
+ * for_each_online_gcwq_cpu()	: online CPUs + unbound gcwqs
  * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
- *				  WORK_CPU_UNBOUND for unbound workqueues
+ *				  unbound gcwqs for unbound workqueues
  */
 #define for_each_gcwq_cpu(cpu)						\
 	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
@@ -462,6 +513,18 @@ static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
 static bool workqueue_freezing;		/* W: have wqs started freezing? */
 
+/*
+ * Attributes of unbound workers.  Workqueues which haven't been given
+ * their own use wq_unbound_cpumask and the nice level of their pool.
+ * Every change takes a new generation number so that workers can tell
+ * cheaply whether they need to apply them.
+ */
+static DEFINE_MUTEX(wq_attrs_mutex);
+static cpumask_var_t wq_unbound_cpumask;	/* A: default cpumask */
+static cpumask_var_t wq_attrs_tmp;		/* A: scratch */
+static unsigned int wq_default_attrs_gen = 1;	/* A: gen of the defaults */
+static unsigned int wq_attrs_last_gen = 1;	/* A: last gen handed out */
+
 /*
  * The almighty global cpu workqueues.  nr_running is the only field
  * which is expected to be used frequently by other cpus via
@@ -471,11 +534,11 @@ static DEFINE_PER_CPU(struct global_cwq, global_cwq);
 static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, pool_nr_running[NR_WORKER_POOLS]);
 
 /*
- * Global cpu workqueue and nr_running counter for unbound gcwq.  The
- * gcwq is always online, has GCWQ_DISASSOCIATED set, and all its
- * workers have WORKER_UNBOUND set.
+ * Global cpu workqueues, one per node, and nr_running counter for
+ * unbound gcwqs.  The gcwqs are always online, have GCWQ_DISASSOCIATED
+ * set, and all their workers have WORKER_UNBOUND set.
  */
-static struct global_cwq unbound_global_cwq;
+static struct global_cwq unbound_global_cwq[MAX_NUMNODES];
 static atomic_t unbound_pool_nr_running[NR_WORKER_POOLS] = {
 	[0 ... NR_WORKER_POOLS - 1]	= ATOMIC_INIT(0),	/* always 0 */
 };
@@ -489,10 +552,10 @@ static int worker_pool_pri(struct worker_pool *pool)
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(global_cwq, cpu);
 	else
-		return &unbound_global_cwq;
+		return &unbound_global_cwq[cpu - WORK_CPU_UNBOUND];
 }
 
 static atomic_t *get_pool_nr_running(struct worker_pool *pool)
@@ -500,23 +563,82 @@ static atomic_t *get_pool_nr_running(struct worker_pool *pool)
 	int cpu = pool->gcwq->cpu;
 	int idx = worker_pool_pri(pool);
 
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(pool_nr_running, cpu)[idx];
 	else
 		return &unbound_pool_nr_running[idx];
 }
 
+/*
+ * cwqs are forced aligned according to WORK_STRUCT_FLAG_BITS.  Make
+ * sure that the alignment isn't lower than that of unsigned long long.
+ * Unbound workqueues have an array of cwqs, one per node, each padded
+ * to that alignment.
+ */
+#define CWQ_ALIGN	max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,	\
+			      __alignof__(unsigned long long))
+#define CWQ_NODE_SIZE	ALIGN(sizeof(struct cpu_workqueue_struct), CWQ_ALIGN)
+
 static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 					    struct workqueue_struct *wq)
 {
 	if (!(wq->flags & WQ_UNBOUND)) {
 		if (likely(cpu < nr_cpu_ids))
 			return per_cpu_ptr(wq->cpu_wq.pcpu, cpu);
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
-		return wq->cpu_wq.single;
+	} else if (likely(cpu >= WORK_CPU_UNBOUND && cpu < WORK_CPU_NONE))
+		return (void *)wq->cpu_wq.nodes +
+			(cpu - WORK_CPU_UNBOUND) * CWQ_NODE_SIZE;
 	return NULL;
 }
 
+static const struct cpumask *wq_attrs_cpumask(struct workqueue_struct *wq)
+{
+	return ACCESS_ONCE(wq->attrs_gen) ? wq->cpumask : wq_unbound_cpumask;
+}
+
+static int wq_attrs_nice(struct workqueue_struct *wq)
+{
+	if (wq->attrs_gen)
+		return wq->nice;
+	return wq->flags & WQ_HIGHPRI ? HIGHPRI_NICE_LEVEL : 0;
+}
+
+/**
+ * unbound_gcwq_cpu - pick the unbound gcwq for a work item
+ * @wq: the unbound workqueue the work item is queued on
+ * @cpu: the cpu the work item is issued from or asked to run on
+ *
+ * Work items are placed on the node of @cpu, or of the local cpu if
+ * @cpu isn't a valid cpu number.  If @wq isn't allowed to run on that
+ * node, the node of a cpu it may run on is used.  Ordered workqueues
+ * need a single cwq and always use the first one.  @wq's cpumask may
+ * change under us, which is fine as it's only used as a hint.
+ *
+ * RETURNS:
+ * The cpu number of the unbound gcwq to use.
+ */
+static unsigned int unbound_gcwq_cpu(struct workqueue_struct *wq,
+				     unsigned int cpu)
+{
+	const struct cpumask *mask;
+	int node;
+
+	if (nr_node_ids == 1 || (wq->flags & WQ_ORDERED))
+		return WORK_CPU_UNBOUND;
+
+	if (cpu >= nr_cpu_ids)
+		cpu = raw_smp_processor_id();
+	node = cpu_to_node(cpu);
+
+	mask = wq_attrs_cpumask(wq);
+	if (unlikely(!cpumask_intersects(mask, cpumask_of_node(node)))) {
+		cpu = cpumask_any_and(mask, cpu_online_mask);
+		if (cpu < nr_cpu_ids)
+			node = cpu_to_node(cpu);
+	}
+	return WORK_CPU_UNBOUND + node;
+}
+
 static unsigned int work_color_to_flags(int color)
 {
 	return color << WORK_STRUCT_COLOR_SHIFT;
@@ -595,7 +717,7 @@ static struct global_cwq *get_work_gcwq(struct work_struct *work)
 	if (cpu == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
+	BUG_ON(cpu >= nr_cpu_ids && cpu < WORK_CPU_UNBOUND);
 	return get_gcwq(cpu);
 }
 
@@ -902,6 +1024,160 @@ static struct worker *find_worker_executing_work(struct global_cwq *gcwq,
 					    work);
 }
 
+#ifdef CONFIG_WQ_STATS
+/*
+ * Per work function statistics.  Slots are claimed for good by the
+ * first function hashing to them, functions not finding a free slot
+ * after a few probes are not accounted.
+ */
+#define WQ_FUNC_STATS_BITS	8
+#define WQ_FUNC_STATS_SIZE	(1 << WQ_FUNC_STATS_BITS)
+#define WQ_FUNC_STATS_PROBES	8
+
+struct wq_func_stats {
+	work_func_t		func;
+	unsigned long		nr_executed;
+	unsigned long		nr_long;
+	u64			exec_total;
+	u64			exec_max;
+	u64			lat_max;
+};
+
+static struct static_key wq_stats_key = STATIC_KEY_INIT_FALSE;
+static DEFINE_MUTEX(wq_stats_mutex);	/* enable/disable and reset */
+static u64 wq_stats_since;		/* local_clock() when enabled */
+static u32 wq_long_work_us = 10000;
+static struct wq_func_stats wq_func_stats[WQ_FUNC_STATS_SIZE];
+static DEFINE_RAW_SPINLOCK(wq_func_stats_lock);
+
+static inline bool wq_stats_enabled(void)
+{
+	return static_key_false(&wq_stats_key);
+}
+
+static inline void wq_stats_queue(struct work_struct *work)
+{
+	if (wq_stats_enabled())
+		work->queued = local_clock();
+}
+
+static struct wq_func_stats *wq_func_stats_slot(work_func_t func)
+{
+	unsigned long idx = hash_ptr(func, WQ_FUNC_STATS_BITS);
+	int i;
+
+	for (i = 0; i < WQ_FUNC_STATS_PROBES; i++) {
+		struct wq_func_stats *fs;
+
+		fs = &wq_func_stats[(idx + i) & (WQ_FUNC_STATS_SIZE - 1)];
+		if (fs->func == func)
+			return fs;
+		if (!fs->func) {
+			fs->func = func;
+			return fs;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Account the start of @work's execution, returns the start time and
+ * the queueing latency in @lat.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static u64 wq_stats_execute_start(struct cpu_workqueue_struct *cwq,
+				  struct work_struct *work, u64 *lat)
+{
+	struct wq_stats *st = this_cpu_ptr(cwq->wq->stats);
+	u64 now = local_clock();
+	u64 queued = work->queued;
+	int bucket;
+
+	work->queued = 0;
+	*lat = 0;
+	/* queued before collection started, or on another cpu's clock */
+	if (queued >= wq_stats_since && queued < now)
+		*lat = now - queued;
+
+	bucket = fls64(div_u64(*lat, NSEC_PER_USEC));
+	st->lat_hist[min(bucket, WQ_STATS_LAT_BUCKETS - 1)]++;
+	st->lat_total += *lat;
+	st->lat_max = max(st->lat_max, *lat);
+	st->max_concurrency = max(st->max_concurrency,
+				  atomic_read(get_pool_nr_running(cwq->pool)));
+	st->max_active = max(st->max_active, cwq->nr_active);
+
+	return now;
+}
+
+/*
+ * Account the end of execution of a work item running @func.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void wq_stats_execute_end(struct cpu_workqueue_struct *cwq,
+				 work_func_t func, u64 start, u64 lat)
+{
+	struct wq_stats *st = this_cpu_ptr(cwq->wq->stats);
+	u64 now = local_clock();
+	/* an unbound worker may have moved to a cpu with a clock behind */
+	u64 exec = now > start ? now - start : 0;
+	bool is_long = exec > (u64)wq_long_work_us * NSEC_PER_USEC;
+	struct wq_func_stats *fs;
+
+	st->nr_executed++;
+	st->nr_long += is_long;
+	st->exec_total += exec;
+	st->exec_max = max(st->exec_max, exec);
+
+	raw_spin_lock(&wq_func_stats_lock);
+	fs = wq_func_stats_slot(func);
+	if (fs) {
+		fs->nr_executed++;
+		fs->nr_long += is_long;
+		fs->exec_total += exec;
+		fs->exec_max = max(fs->exec_max, exec);
+		fs->lat_max = max(fs->lat_max, lat);
+	}
+	raw_spin_unlock(&wq_func_stats_lock);
+
+	trace_workqueue_execute_stats(cwq, func, lat, exec);
+}
+
+static inline void wq_stats_rescue(struct workqueue_struct *wq)
+{
+	if (wq_stats_enabled())
+		this_cpu_inc(wq->stats->nr_rescued);
+}
+
+static int wq_stats_alloc(struct workqueue_struct *wq)
+{
+	wq->stats = alloc_percpu(struct wq_stats);
+	return wq->stats ? 0 : -ENOMEM;
+}
+
+static void wq_stats_free(struct workqueue_struct *wq)
+{
+	free_percpu(wq->stats);
+}
+#else	/* CONFIG_WQ_STATS */
+static inline bool wq_stats_enabled(void) { return false; }
+static inline void wq_stats_queue(struct work_struct *work) { }
+static inline u64 wq_stats_execute_start(struct cpu_workqueue_struct *cwq,
+					 struct work_struct *work, u64 *lat)
+{
+	return 0;
+}
+static inline void wq_stats_execute_end(struct cpu_workqueue_struct *cwq,
+					work_func_t func, u64 start, u64 lat) { }
+static inline void wq_stats_rescue(struct workqueue_struct *wq) { }
+static inline int wq_stats_alloc(struct workqueue_struct *wq) { return 0; }
+static inline void wq_stats_free(struct workqueue_struct *wq) { }
+#endif	/* CONFIG_WQ_STATS */
+
 /**
  * insert_work - insert a work into gcwq
  * @cwq: cwq @work belongs to
@@ -923,6 +1199,7 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 
 	/* we own @work, set data and link */
 	set_work_cwq(work, cwq, extra_flags);
+	wq_stats_queue(work);
 
 	/*
 	 * Ensure that we get the right work->data if we see the
@@ -978,7 +1255,7 @@ static bool is_chained_work(struct workqueue_struct *wq)
 static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
-	struct global_cwq *gcwq;
+	struct global_cwq *gcwq, *last_gcwq;
 	struct cpu_workqueue_struct *cwq;
 	struct list_head *worklist;
 	unsigned int work_flags;
@@ -993,39 +1270,37 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 
 	/* determine gcwq to use */
 	if (!(wq->flags & WQ_UNBOUND)) {
-		struct global_cwq *last_gcwq;
-
 		if (unlikely(cpu == WORK_CPU_UNBOUND))
 			cpu = raw_smp_processor_id();
-
-		/*
-		 * It's multi cpu.  If @wq is non-reentrant and @work
-		 * was previously on a different cpu, it might still
-		 * be running there, in which case the work needs to
-		 * be queued on that cpu to guarantee non-reentrance.
-		 */
 		gcwq = get_gcwq(cpu);
-		if (wq->flags & WQ_NON_REENTRANT &&
-		    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
-			struct worker *worker;
+	} else
+		gcwq = get_gcwq(unbound_gcwq_cpu(wq, cpu));
 
-			spin_lock_irqsave(&last_gcwq->lock, flags);
+	/*
+	 * It's multi cpu.  If @wq is non-reentrant and @work was
+	 * previously on a different cpu, it might still be running
+	 * there, in which case the work needs to be queued on that cpu
+	 * to guarantee non-reentrance.  Unbound workqueues are spread
+	 * over the per-node gcwqs and get the same treatment, so that
+	 * their work items stay non-reentrant as with a single gcwq.
+	 */
+	if (wq->flags & (WQ_NON_REENTRANT | WQ_UNBOUND) &&
+	    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
+		struct worker *worker;
 
-			worker = find_worker_executing_work(last_gcwq, work);
+		spin_lock_irqsave(&last_gcwq->lock, flags);
 
-			if (worker && worker->current_cwq->wq == wq)
-				gcwq = last_gcwq;
-			else {
-				/* meh... not running there, queue here */
-				spin_unlock_irqrestore(&last_gcwq->lock, flags);
-				spin_lock_irqsave(&gcwq->lock, flags);
-			}
-		} else
+		worker = find_worker_executing_work(last_gcwq, work);
+
+		if (worker && worker->current_cwq->wq == wq)
+			gcwq = last_gcwq;
+		else {
+			/* meh... not running there, queue here */
+			spin_unlock_irqrestore(&last_gcwq->lock, flags);
 			spin_lock_irqsave(&gcwq->lock, flags);
-	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
+		}
+	} else
 		spin_lock_irqsave(&gcwq->lock, flags);
-	}
 
 	/* gcwq determined, get cwq and queue */
 	cwq = get_cwq(gcwq->cpu, wq);
@@ -1156,7 +1431,7 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 		if (!(wq->flags & WQ_UNBOUND)) {
 			struct global_cwq *gcwq = get_work_gcwq(work);
 
-			if (gcwq && gcwq->cpu != WORK_CPU_UNBOUND)
+			if (gcwq && gcwq->cpu < WORK_CPU_UNBOUND)
 				lcpu = gcwq->cpu;
 			else
 				lcpu = raw_smp_processor_id();
@@ -1542,13 +1817,15 @@ static struct worker *create_worker(struct worker_pool *pool)
 	worker->pool = pool;
 	worker->id = id;
 
-	if (gcwq->cpu != WORK_CPU_UNBOUND)
+	if (gcwq->cpu < WORK_CPU_UNBOUND)
 		worker->task = kthread_create_on_node(worker_thread,
 					worker, cpu_to_node(gcwq->cpu),
 					"kworker/%u:%d%s", gcwq->cpu, id, pri);
 	else
-		worker->task = kthread_create(worker_thread, worker,
-					      "kworker/u:%d%s", id, pri);
+		worker->task = kthread_create_on_node(worker_thread,
+					worker, gcwq->cpu - WORK_CPU_UNBOUND,
+					"kworker/u%u:%d%s",
+					gcwq->cpu - WORK_CPU_UNBOUND, id, pri);
 	if (IS_ERR(worker->task))
 		goto fail;
 
@@ -1662,6 +1939,25 @@ static void idle_worker_timeout(unsigned long __pool)
 	spin_unlock_irq(&gcwq->lock);
 }
 
+/*
+ * Unbound gcwqs can't be set in mayday_mask, use the first possible cpu
+ * of their node instead, which rescuer_thread() maps back with
+ * cpu_to_node().  Unbound gcwqs are only used for nodes which have
+ * cpus, except for the first one which ordered workqueues use
+ * regardless and which is therefore marked as cpu 0.
+ */
+static unsigned int unbound_mayday_cpu(struct workqueue_struct *wq,
+				       unsigned int gcwq_cpu)
+{
+	unsigned int cpu;
+
+	if (!(wq->flags & WQ_ORDERED))
+		for_each_possible_cpu(cpu)
+			if (WORK_CPU_UNBOUND + cpu_to_node(cpu) == gcwq_cpu)
+				return cpu;
+	return 0;
+}
+
 static bool send_mayday(struct work_struct *work)
 {
 	struct cpu_workqueue_struct *cwq = get_work_cwq(work);
@@ -1673,9 +1969,8 @@ static bool send_mayday(struct work_struct *work)
 
 	/* mayday mayday mayday */
 	cpu = cwq->pool->gcwq->cpu;
-	/* WORK_CPU_UNBOUND can't be set in cpumask, use cpu 0 instead */
-	if (cpu == WORK_CPU_UNBOUND)
-		cpu = 0;
+	if (cpu >= WORK_CPU_UNBOUND)
+		cpu = unbound_mayday_cpu(wq, cpu);
 	if (!mayday_test_and_set_cpu(cpu, wq->mayday_mask))
 		wake_up_process(wq->rescuer->task);
 	return true;
@@ -1994,6 +2289,48 @@ static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
 		complete(&cwq->wq->first_flusher->done);
 }
 
+static unsigned int wq_attrs_gen(struct workqueue_struct *wq)
+{
+	return ACCESS_ONCE(wq->attrs_gen) ?: ACCESS_ONCE(wq_default_attrs_gen);
+}
+
+/**
+ * worker_apply_attrs - apply the attributes of an unbound workqueue
+ * @worker: self
+ * @wq: workqueue of the work item about to be executed
+ *
+ * Unbound workers are shared by all unbound workqueues.  Before
+ * executing a work item, make @worker follow the cpumask and nice level
+ * of its workqueue, staying on the node of its gcwq if the cpumask
+ * allows it.  This is a no-op unless the attributes differ from those
+ * of the last workqueue @worker served.
+ *
+ * CONTEXT:
+ * Might sleep.  Called without any lock.
+ */
+static void worker_apply_attrs(struct worker *worker,
+			       struct workqueue_struct *wq)
+{
+	int node = worker->pool->gcwq->cpu - WORK_CPU_UNBOUND;
+	const struct cpumask *mask;
+
+	if (likely(worker->attrs_gen == wq_attrs_gen(wq)))
+		return;
+
+	mutex_lock(&wq_attrs_mutex);
+
+	mask = wq_attrs_cpumask(wq);
+	cpumask_and(wq_attrs_tmp, mask, cpumask_of_node(node));
+	if (cpumask_intersects(wq_attrs_tmp, cpu_online_mask))
+		mask = wq_attrs_tmp;
+
+	set_cpus_allowed_ptr(current, mask);
+	set_user_nice(current, wq_attrs_nice(wq));
+	worker->attrs_gen = wq_attrs_gen(wq);
+
+	mutex_unlock(&wq_attrs_mutex);
+}
+
 /**
  * process_one_work - process single work
  * @worker: self
@@ -2020,6 +2357,7 @@ __acquires(&gcwq->lock)
 	work_func_t f = work->func;
 	int work_color;
 	struct worker *collision;
+	u64 stats_start = 0, stats_lat = 0;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * It is permissible to free the struct work_struct from
@@ -2078,8 +2416,15 @@ __acquires(&gcwq->lock)
 	if ((worker->flags & WORKER_UNBOUND) && need_more_worker(pool))
 		wake_up_worker(pool);
 
+	if (wq_stats_enabled())
+		stats_start = wq_stats_execute_start(cwq, work, &stats_lat);
+
 	spin_unlock_irq(&gcwq->lock);
 
+	/* rescuers keep their own nice level and go wherever needed */
+	if (gcwq->cpu >= WORK_CPU_UNBOUND && worker != cwq->wq->rescuer)
+		worker_apply_attrs(worker, cwq->wq);
+
 	smp_wmb();	/* paired with test_and_set_bit(PENDING) */
 	work_clear_pending(work);
 
@@ -2107,6 +2452,9 @@ __acquires(&gcwq->lock)
 
 	spin_lock_irq(&gcwq->lock);
 
+	if (stats_start)
+		wq_stats_execute_end(cwq, f, stats_start, stats_lat);
+
 	/* clear cpu intensive status */
 	if (unlikely(cpu_intensive))
 		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
@@ -2272,11 +2620,12 @@ repeat:
 	}
 
 	/*
-	 * See whether any cpu is asking for help.  Unbounded
-	 * workqueues use cpu 0 in mayday_mask for CPU_UNBOUND.
+	 * See whether any cpu is asking for help.  Unbound workqueues
+	 * use a cpu of the node in mayday_mask, see unbound_mayday_cpu().
 	 */
 	for_each_mayday_cpu(cpu, wq->mayday_mask) {
-		unsigned int tcpu = is_unbound ? WORK_CPU_UNBOUND : cpu;
+		unsigned int tcpu = !is_unbound ? cpu : WORK_CPU_UNBOUND +
+			(wq->flags & WQ_ORDERED ? 0 : cpu_to_node(cpu));
 		struct cpu_workqueue_struct *cwq = get_cwq(tcpu, wq);
 		struct worker_pool *pool = cwq->pool;
 		struct global_cwq *gcwq = pool->gcwq;
@@ -2289,6 +2638,9 @@ repeat:
 		rescuer->pool = pool;
 		worker_maybe_bind_and_lock(rescuer);
 
+		trace_workqueue_rescue(cwq);
+		wq_stats_rescue(wq);
+
 		/*
 		 * Slurp in all works issued via this workqueue and
 		 * process'em.
@@ -3135,36 +3487,314 @@ int keventd_up(void)
 	return system_wq != NULL;
 }
 
-static int alloc_cwqs(struct workqueue_struct *wq)
+#ifdef CONFIG_SYSFS
+/*
+ * Workqueues created with WQ_SYSFS show up in /sys/bus/workqueue/devices/
+ * with their max_active and, if unbound, the cpumask and nice level of
+ * the workers executing their work items.  /sys/bus/workqueue/cpumask
+ * is the cpumask of unbound workqueues which haven't been given one.
+ */
+struct wq_device {
+	struct workqueue_struct		*wq;
+	struct device			dev;
+};
+
+static bool wq_sysfs_ready;
+static struct device *wq_root_dev;
+
+static struct workqueue_struct *dev_to_wq(struct device *dev)
+{
+	return container_of(dev, struct wq_device, dev)->wq;
+}
+
+/* 0 is reserved for workqueues using the default attributes */
+static unsigned int wq_next_attrs_gen(void)
+{
+	if (!++wq_attrs_last_gen)
+		wq_attrs_last_gen++;
+	return wq_attrs_last_gen;
+}
+
+/* give @wq its own attributes, called with wq_attrs_mutex held */
+static void wq_set_attrs(struct workqueue_struct *wq,
+			 const struct cpumask *cpumask, int nice)
 {
+	cpumask_copy(wq->cpumask, cpumask);
+	wq->nice = nice;
+	/* make the attributes visible before switching to them */
+	smp_wmb();
+	wq->attrs_gen = wq_next_attrs_gen();
+}
+
+static int wq_parse_cpumask(const char *buf, size_t count,
+			    struct cpumask *cpumask)
+{
+	int ret;
+
+	ret = bitmap_parse(buf, count, cpumask_bits(cpumask),
+			   nr_cpumask_bits);
+	if (ret)
+		return ret;
+
+	cpumask_and(cpumask, cpumask, cpu_possible_mask);
+	return cpumask_empty(cpumask) ? -EINVAL : 0;
+}
+
+static ssize_t wq_show_cpumask(const struct cpumask *cpumask, char *buf)
+{
+	int len;
+
+	mutex_lock(&wq_attrs_mutex);
+	len = cpumask_scnprintf(buf, PAGE_SIZE - 1, cpumask);
+	mutex_unlock(&wq_attrs_mutex);
+
+	buf[len++] = '\n';
+	return len;
+}
+
+static ssize_t wq_per_cpu_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", !(dev_to_wq(dev)->flags & WQ_UNBOUND));
+}
+
+static ssize_t wq_max_active_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", dev_to_wq(dev)->saved_max_active);
+}
+
+static ssize_t wq_max_active_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int val;
+
+	if (wq->flags & WQ_ORDERED)
+		return -EINVAL;
+
+	if (kstrtoint(buf, 0, &val) || val <= 0)
+		return -EINVAL;
+
+	workqueue_set_max_active(wq, val);
+	return count;
+}
+
+static ssize_t wq_cpumask_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	return wq_show_cpumask(wq_attrs_cpumask(dev_to_wq(dev)), buf);
+}
+
+static ssize_t wq_cpumask_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	cpumask_var_t cpumask;
+	int ret;
+
+	if (!alloc_cpumask_var(&cpumask, GFP_KERNEL))
+		return -ENOMEM;
+
+	ret = wq_parse_cpumask(buf, count, cpumask);
+	if (!ret) {
+		mutex_lock(&wq_attrs_mutex);
+		wq_set_attrs(wq, cpumask, wq_attrs_nice(wq));
+		mutex_unlock(&wq_attrs_mutex);
+	}
+
+	free_cpumask_var(cpumask);
+	return ret ?: count;
+}
+
+static ssize_t wq_nice_show(struct device *dev,
+			    struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", wq_attrs_nice(dev_to_wq(dev)));
+}
+
+static ssize_t wq_nice_store(struct device *dev,
+			     struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int nice;
+
+	if (kstrtoint(buf, 0, &nice) || nice < -20 || nice > 19)
+		return -EINVAL;
+
+	mutex_lock(&wq_attrs_mutex);
+	cpumask_copy(wq_attrs_tmp, wq_attrs_cpumask(wq));
+	wq_set_attrs(wq, wq_attrs_tmp, nice);
+	mutex_unlock(&wq_attrs_mutex);
+
+	return count;
+}
+
+static struct device_attribute wq_sysfs_attrs[] = {
+	__ATTR(per_cpu, 0444, wq_per_cpu_show, NULL),
+	__ATTR(max_active, 0644, wq_max_active_show, wq_max_active_store),
+	__ATTR_NULL,
+};
+
+static struct device_attribute wq_sysfs_unbound_attrs[] = {
+	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
+	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
+	__ATTR_NULL,
+};
+
+static struct bus_type wq_subsys = {
+	.name				= "workqueue",
+	.dev_attrs			= wq_sysfs_attrs,
+};
+
+static ssize_t wq_unbound_cpumask_show(struct bus_type *bus, char *buf)
+{
+	return wq_show_cpumask(wq_unbound_cpumask, buf);
+}
+
+static ssize_t wq_unbound_cpumask_store(struct bus_type *bus,
+					const char *buf, size_t count)
+{
+	cpumask_var_t cpumask;
+	int ret;
+
+	if (!alloc_cpumask_var(&cpumask, GFP_KERNEL))
+		return -ENOMEM;
+
+	ret = wq_parse_cpumask(buf, count, cpumask);
+	if (!ret) {
+		mutex_lock(&wq_attrs_mutex);
+		cpumask_copy(wq_unbound_cpumask, cpumask);
+		wq_default_attrs_gen = wq_next_attrs_gen();
+		mutex_unlock(&wq_attrs_mutex);
+	}
+
+	free_cpumask_var(cpumask);
+	return ret ?: count;
+}
+
+static BUS_ATTR(cpumask, 0644, wq_unbound_cpumask_show,
+		wq_unbound_cpumask_store);
+
+static void wq_device_release(struct device *dev)
+{
+	kfree(container_of(dev, struct wq_device, dev));
+}
+
+static void wq_sysfs_register(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev;
+	struct device_attribute *attr;
+	int ret;
+
+	/* wq_sysfs_init() registers the ones created before it ran */
+	if (!wq_sysfs_ready)
+		return;
+
+	wq_dev = kzalloc(sizeof(*wq_dev), GFP_KERNEL);
+	if (!wq_dev) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	wq_dev->wq = wq;
+	wq_dev->dev.bus = &wq_subsys;
+	wq_dev->dev.parent = wq_root_dev;
+	wq_dev->dev.release = wq_device_release;
+	dev_set_name(&wq_dev->dev, "%s", wq->name);
+
+	ret = device_register(&wq_dev->dev);
+	if (ret) {
+		put_device(&wq_dev->dev);
+		goto fail;
+	}
+
+	if (wq->flags & WQ_UNBOUND) {
+		for (attr = wq_sysfs_unbound_attrs; attr->attr.name; attr++) {
+			ret = device_create_file(&wq_dev->dev, attr);
+			if (ret) {
+				device_unregister(&wq_dev->dev);
+				goto fail;
+			}
+		}
+	}
+
+	wq->wq_dev = wq_dev;
+	return;
+fail:
+	printk(KERN_WARNING "workqueue: failed to register %s with sysfs "
+	       "(%d)\n", wq->name, ret);
+}
+
+static void wq_sysfs_unregister(struct workqueue_struct *wq)
+{
+	if (wq->wq_dev)
+		device_unregister(&wq->wq_dev->dev);
+	wq->wq_dev = NULL;
+}
+
+static int __init wq_sysfs_init(void)
+{
+	struct workqueue_struct *wq;
+	int ret;
+
+	ret = bus_register(&wq_subsys);
+	if (ret)
+		return ret;
+
+	ret = bus_create_file(&wq_subsys, &bus_attr_cpumask);
+	if (ret)
+		return ret;
+
+	wq_root_dev = root_device_register("workqueue");
+	if (IS_ERR(wq_root_dev))
+		return PTR_ERR(wq_root_dev);
+
+	wq_sysfs_ready = true;
+
 	/*
-	 * cwqs are forced aligned according to WORK_STRUCT_FLAG_BITS.
-	 * Make sure that the alignment isn't lower than that of
-	 * unsigned long long.
+	 * Only the early workqueues exist and nothing else is creating
+	 * or destroying workqueues yet, no need for workqueue_lock.
 	 */
+	list_for_each_entry(wq, &workqueues, list)
+		if (wq->flags & WQ_SYSFS)
+			wq_sysfs_register(wq);
+	return 0;
+}
+core_initcall(wq_sysfs_init);
+#else	/* CONFIG_SYSFS */
+static void wq_sysfs_register(struct workqueue_struct *wq) { }
+static void wq_sysfs_unregister(struct workqueue_struct *wq) { }
+#endif	/* CONFIG_SYSFS */
+
+static int alloc_cwqs(struct workqueue_struct *wq)
+{
 	const size_t size = sizeof(struct cpu_workqueue_struct);
-	const size_t align = max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,
-				   __alignof__(unsigned long long));
+	const size_t nodes_size = nr_node_ids * CWQ_NODE_SIZE;
 
 	if (!(wq->flags & WQ_UNBOUND))
-		wq->cpu_wq.pcpu = __alloc_percpu(size, align);
+		wq->cpu_wq.pcpu = __alloc_percpu(size, CWQ_ALIGN);
 	else {
 		void *ptr;
 
 		/*
-		 * Allocate enough room to align cwq and put an extra
+		 * Allocate enough room to align the cwqs and put an extra
 		 * pointer at the end pointing back to the originally
 		 * allocated pointer which will be used for free.
 		 */
-		ptr = kzalloc(size + align + sizeof(void *), GFP_KERNEL);
+		ptr = kzalloc(nodes_size + CWQ_ALIGN + sizeof(void *),
+			      GFP_KERNEL);
 		if (ptr) {
-			wq->cpu_wq.single = PTR_ALIGN(ptr, align);
-			*(void **)(wq->cpu_wq.single + 1) = ptr;
+			wq->cpu_wq.nodes = PTR_ALIGN(ptr, CWQ_ALIGN);
+			*(void **)((void *)wq->cpu_wq.nodes + nodes_size) = ptr;
 		}
 	}
 
 	/* just in case, make sure it's actually aligned */
-	BUG_ON(!IS_ALIGNED(wq->cpu_wq.v, align));
+	BUG_ON(!IS_ALIGNED(wq->cpu_wq.v, CWQ_ALIGN));
 	return wq->cpu_wq.v ? 0 : -ENOMEM;
 }
 
@@ -3172,9 +3802,10 @@ static void free_cwqs(struct workqueue_struct *wq)
 {
 	if (!(wq->flags & WQ_UNBOUND))
 		free_percpu(wq->cpu_wq.pcpu);
-	else if (wq->cpu_wq.single) {
-		/* the pointer to free is stored right after the cwq */
-		kfree(*(void **)(wq->cpu_wq.single + 1));
+	else if (wq->cpu_wq.nodes) {
+		/* the pointer to free is stored right after the cwqs */
+		kfree(*(void **)((void *)wq->cpu_wq.nodes +
+				 nr_node_ids * CWQ_NODE_SIZE));
 	}
 }
 
@@ -3225,6 +3856,21 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	max_active = max_active ?: WQ_DFL_ACTIVE;
 	max_active = wq_clamp_max_active(max_active, flags, wq->name);
 
+	/*
+	 * Unbound workqueues with @max_active of one are expected to
+	 * execute their work items in order, they can't be spread over
+	 * the nodes.
+	 */
+	if ((flags & WQ_UNBOUND) && max_active == 1)
+		flags |= WQ_ORDERED;
+
+	/*
+	 * Ordered workqueues rely on max_active staying at one, don't let
+	 * userland change it through sysfs.
+	 */
+	if (WARN_ON((flags & WQ_ORDERED) && (flags & WQ_SYSFS)))
+		goto err;
+
 	/* init wq */
 	wq->flags = flags;
 	wq->saved_max_active = max_active;
@@ -3236,7 +3882,11 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
 	INIT_LIST_HEAD(&wq->list);
 
-	if (alloc_cwqs(wq) < 0)
+	if (alloc_cwqs(wq) < 0 || wq_stats_alloc(wq) < 0)
+		goto err;
+
+	if ((flags & WQ_UNBOUND) &&
+	    !zalloc_cpumask_var(&wq->cpumask, GFP_KERNEL))
 		goto err;
 
 	for_each_cwq_cpu(cpu, wq) {
@@ -3286,10 +3936,16 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 
 	spin_unlock(&workqueue_lock);
 
+	if (flags & WQ_SYSFS)
+		wq_sysfs_register(wq);
+
 	return wq;
 err:
 	if (wq) {
 		free_cwqs(wq);
+		wq_stats_free(wq);
+		if (flags & WQ_UNBOUND)
+			free_cpumask_var(wq->cpumask);
 		free_mayday_mask(wq->mayday_mask);
 		kfree(wq->rescuer);
 		kfree(wq);
@@ -3311,6 +3967,8 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
 
+	wq_sysfs_unregister(wq);
+
 	/*
 	 * wq list is used to freeze wq, remove from list after
 	 * flushing is complete in case freeze races us.
@@ -3337,6 +3995,9 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	}
 
 	free_cwqs(wq);
+	wq_stats_free(wq);
+	if (wq->flags & WQ_UNBOUND)
+		free_cpumask_var(wq->cpumask);
 	kfree(wq);
 }
 EXPORT_SYMBOL_GPL(destroy_workqueue);
@@ -3346,7 +4007,8 @@ EXPORT_SYMBOL_GPL(destroy_workqueue);
  * @wq: target workqueue
  * @max_active: new max_active value.
  *
- * Set max_active of @wq to @max_active.
+ * Set max_active of @wq to @max_active.  Ordered workqueues must keep
+ * their max_active of one and are left alone.
  *
  * CONTEXT:
  * Don't call from IRQ context.
@@ -3355,6 +4017,10 @@ void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 {
 	unsigned int cpu;
 
+	/* disallow meddling with max_active for ordered workqueues */
+	if (WARN_ON(wq->flags & WQ_ORDERED))
+		return;
+
 	max_active = wq_clamp_max_active(max_active, wq->flags, wq->name);
 
 	spin_lock(&workqueue_lock);
@@ -3382,16 +4048,22 @@ EXPORT_SYMBOL_GPL(workqueue_set_max_active);
  * @cpu: CPU in question
  * @wq: target workqueue
  *
- * Test whether @wq's cpu workqueue for @cpu is congested.  There is
- * no synchronization around this function and the test result is
- * unreliable and only useful as advisory hints or for debugging.
+ * Test whether @wq's cpu workqueue for @cpu is congested.  For an
+ * unbound @wq, the one of @cpu's node is tested, or of the local node
+ * if @cpu is %WORK_CPU_UNBOUND.  There is no synchronization around
+ * this function and the test result is unreliable and only useful as
+ * advisory hints or for debugging.
  *
  * RETURNS:
  * %true if congested, %false otherwise.
  */
 bool workqueue_congested(unsigned int cpu, struct workqueue_struct *wq)
 {
-	struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	struct cpu_workqueue_struct *cwq;
+
+	if (wq->flags & WQ_UNBOUND)
+		cpu = unbound_gcwq_cpu(wq, cpu);
+	cwq = get_cwq(cpu, wq);
 
 	return !list_empty(&cwq->delayed_works);
 }
@@ -3402,13 +4074,16 @@ EXPORT_SYMBOL_GPL(workqueue_congested);
  * @work: the work of interest
  *
  * RETURNS:
- * CPU number if @work was ever queued.  WORK_CPU_NONE otherwise.
+ * CPU number if @work was ever queued, WORK_CPU_UNBOUND if it was
+ * queued on an unbound workqueue.  WORK_CPU_NONE otherwise.
  */
 unsigned int work_cpu(struct work_struct *work)
 {
 	struct global_cwq *gcwq = get_work_gcwq(work);
 
-	return gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	if (!gcwq)
+		return WORK_CPU_NONE;
+	return min_t(unsigned int, gcwq->cpu, WORK_CPU_UNBOUND);
 }
 EXPORT_SYMBOL_GPL(work_cpu);
 
@@ -3785,6 +4460,10 @@ static int __init init_workqueues(void)
 	cpu_notifier(workqueue_cpu_up_callback, CPU_PRI_WORKQUEUE_UP);
 	cpu_notifier(workqueue_cpu_down_callback, CPU_PRI_WORKQUEUE_DOWN);
 
+	BUG_ON(!alloc_cpumask_var(&wq_unbound_cpumask, GFP_KERNEL) ||
+	       !alloc_cpumask_var(&wq_attrs_tmp, GFP_KERNEL));
+	cpumask_copy(wq_unbound_cpumask, cpu_possible_mask);
+
 	/* initialize gcwqs */
 	for_each_gcwq_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
@@ -3821,7 +4500,7 @@ static int __init init_workqueues(void)
 		struct global_cwq *gcwq = get_gcwq(cpu);
 		struct worker_pool *pool;
 
-		if (cpu != WORK_CPU_UNBOUND)
+		if (cpu < WORK_CPU_UNBOUND)
 			gcwq->flags &= ~GCWQ_DISASSOCIATED;
 
 		for_each_worker_pool(pool, gcwq) {
@@ -3838,7 +4517,8 @@ static int __init init_workqueues(void)
 	system_wq = alloc_workqueue("events", 0, 0);
 	system_long_wq = alloc_workqueue("events_long", 0, 0);
 	system_nrt_wq = alloc_workqueue("events_nrt", WQ_NON_REENTRANT, 0);
-	system_unbound_wq = alloc_workqueue("events_unbound", WQ_UNBOUND,
+	system_unbound_wq = alloc_workqueue("events_unbound",
+					    WQ_UNBOUND | WQ_SYSFS,
 					    WQ_UNBOUND_MAX_ACTIVE);
 	system_freezable_wq = alloc_workqueue("events_freezable",
 					      WQ_FREEZABLE, 0);
@@ -3850,3 +4530,206 @@ static int __init init_workqueues(void)
 	return 0;
 }
 early_initcall(init_workqueues);
+
+#ifdef CONFIG_WQ_STATS
+/*
+ * debugfs interface to the statistics: writing 1 to workqueue/enable
+ * clears them and starts collecting, writing 0 stops.
+ */
+static void wq_stats_sum(struct workqueue_struct *wq, struct wq_stats *sum)
+{
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		struct wq_stats *st = per_cpu_ptr(wq->stats, cpu);
+
+		sum->nr_executed += st->nr_executed;
+		sum->nr_long += st->nr_long;
+		sum->nr_rescued += st->nr_rescued;
+		sum->max_concurrency = max(sum->max_concurrency,
+					   st->max_concurrency);
+		sum->max_active = max(sum->max_active, st->max_active);
+		sum->lat_total += st->lat_total;
+		sum->lat_max = max(sum->lat_max, st->lat_max);
+		sum->exec_total += st->exec_total;
+		sum->exec_max = max(sum->exec_max, st->exec_max);
+		for (i = 0; i < WQ_STATS_LAT_BUCKETS; i++)
+			sum->lat_hist[i] += st->lat_hist[i];
+	}
+}
+
+static void wq_stats_reset(void)
+{
+	struct workqueue_struct *wq;
+	int cpu;
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueues, list)
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(wq->stats, cpu), 0,
+			       sizeof(struct wq_stats));
+	spin_unlock(&workqueue_lock);
+
+	raw_spin_lock_irq(&wq_func_stats_lock);
+	memset(wq_func_stats, 0, sizeof(wq_func_stats));
+	raw_spin_unlock_irq(&wq_func_stats_lock);
+}
+
+static unsigned long long wq_ns_to_us(u64 ns)
+{
+	return div_u64(ns, NSEC_PER_USEC);
+}
+
+static unsigned long long wq_avg_us(u64 total, unsigned long nr)
+{
+	return nr ? wq_ns_to_us(div64_u64(total, nr)) : 0;
+}
+
+static int wq_stats_show(struct seq_file *m, void *v)
+{
+	struct workqueue_struct *wq;
+	struct wq_stats sum;
+
+	seq_printf(m, "%-24s %10s %10s %10s %10s %10s %8s %6s %6s %8s\n",
+		   "workqueue", "executed", "lat_avg", "lat_max", "exec_avg",
+		   "exec_max", "long", "conc", "active", "rescued");
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueues, list) {
+		wq_stats_sum(wq, &sum);
+		seq_printf(m, "%-24s %10lu %10llu %10llu %10llu %10llu %8lu "
+			   "%6d %6d %8lu\n",
+			   wq->name, sum.nr_executed,
+			   wq_avg_us(sum.lat_total, sum.nr_executed),
+			   wq_ns_to_us(sum.lat_max),
+			   wq_avg_us(sum.exec_total, sum.nr_executed),
+			   wq_ns_to_us(sum.exec_max), sum.nr_long,
+			   sum.max_concurrency, sum.max_active, sum.nr_rescued);
+	}
+	spin_unlock(&workqueue_lock);
+	return 0;
+}
+
+static int wq_latency_show(struct seq_file *m, void *v)
+{
+	struct workqueue_struct *wq;
+	struct wq_stats sum;
+	int i;
+
+	seq_printf(m, "%-24s", "workqueue");
+	for (i = 0; i < WQ_STATS_LAT_BUCKETS - 1; i++)
+		seq_printf(m, " %8lu", 1UL << i);
+	seq_printf(m, " %8s\n", "more");
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueues, list) {
+		wq_stats_sum(wq, &sum);
+		seq_printf(m, "%-24s", wq->name);
+		for (i = 0; i < WQ_STATS_LAT_BUCKETS; i++)
+			seq_printf(m, " %8lu", sum.lat_hist[i]);
+		seq_putc(m, '\n');
+	}
+	spin_unlock(&workqueue_lock);
+	return 0;
+}
+
+static int wq_functions_show(struct seq_file *m, void *v)
+{
+	struct wq_func_stats fs;
+	int i;
+
+	seq_printf(m, "%-40s %10s %10s %10s %8s %10s\n", "function",
+		   "executed", "exec_avg", "exec_max", "long", "lat_max");
+
+	for (i = 0; i < WQ_FUNC_STATS_SIZE; i++) {
+		raw_spin_lock_irq(&wq_func_stats_lock);
+		fs = wq_func_stats[i];
+		raw_spin_unlock_irq(&wq_func_stats_lock);
+
+		if (!fs.func)
+			continue;
+		seq_printf(m, "%-40pf %10lu %10llu %10llu %8lu %10llu\n",
+			   fs.func, fs.nr_executed,
+			   wq_avg_us(fs.exec_total, fs.nr_executed),
+			   wq_ns_to_us(fs.exec_max), fs.nr_long,
+			   wq_ns_to_us(fs.lat_max));
+	}
+	return 0;
+}
+
+static int wq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, inode->i_private, NULL);
+}
+
+static const struct file_operations wq_stats_fops = {
+	.open		= wq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t wq_stats_enable_read(struct file *file, char __user *ubuf,
+				    size_t count, loff_t *ppos)
+{
+	char buf[2];
+
+	buf[0] = static_key_enabled(&wq_stats_key) ? '1' : '0';
+	buf[1] = '\n';
+	return simple_read_from_buffer(ubuf, count, ppos, buf, sizeof(buf));
+}
+
+static ssize_t wq_stats_enable_write(struct file *file,
+				     const char __user *ubuf,
+				     size_t count, loff_t *ppos)
+{
+	char buf[8];
+	size_t len = min(count, sizeof(buf) - 1);
+	bool enable;
+
+	if (copy_from_user(buf, ubuf, len))
+		return -EFAULT;
+	buf[len] = '\0';
+	if (strtobool(buf, &enable))
+		return -EINVAL;
+
+	mutex_lock(&wq_stats_mutex);
+	if (enable && !static_key_enabled(&wq_stats_key)) {
+		wq_stats_reset();
+		wq_stats_since = local_clock();
+		static_key_slow_inc(&wq_stats_key);
+	} else if (!enable && static_key_enabled(&wq_stats_key)) {
+		static_key_slow_dec(&wq_stats_key);
+	}
+	mutex_unlock(&wq_stats_mutex);
+
+	return count;
+}
+
+static const struct file_operations wq_stats_enable_fops = {
+	.read		= wq_stats_enable_read,
+	.write		= wq_stats_enable_write,
+	.llseek		= default_llseek,
+};
+
+static int __init wq_stats_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("workqueue", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	debugfs_create_file("enable", 0600, dir, NULL, &wq_stats_enable_fops);
+	debugfs_create_u32("long_work_us", 0600, dir, &wq_long_work_us);
+	debugfs_create_file("stats", 0400, dir, wq_stats_show,
+			    &wq_stats_fops);
+	debugfs_create_file("latency", 0400, dir, wq_latency_show,
+			    &wq_stats_fops);
+	debugfs_create_file("functions", 0400, dir, wq_functions_show,
+			    &wq_stats_fops);
+	return 0;
+}
+late_initcall(wq_stats_debugfs_init);
+#endif	/* CONFIG_WQ_STATS */
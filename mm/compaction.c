@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/cpu.h>
 #include "internal.h"
 
 #if defined CONFIG_COMPACTION || defined CONFIG_CMA
@@ -642,6 +645,81 @@ static isolate_migrate_t isolate_migratepages(struct zone *zone,
 	return ISOLATE_SUCCESS;
 }
 
+/*
+ * Proactive compaction: kcompactd compacts a node in the background when
+ * too much of its free memory is outside blocks of COMPACTION_HPAGE_ORDER
+ * pages, rather than waiting for high-order allocations to stall in direct
+ * compaction.  How much fragmentation is tolerated is set by
+ * sysctl_compaction_proactiveness, 0 disabling proactive compaction.
+ */
+#define COMPACTION_HPAGE_ORDER	pageblock_order
+#define KCOMPACTD_CHECK_INTERVAL_MSEC	500
+
+int sysctl_compaction_proactiveness = 20;
+
+/*
+ * The percentage of the free memory of @zone that is not in blocks of at
+ * least @order pages.
+ */
+static unsigned int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	unsigned long free_pages = 0, suitable_pages = 0;
+	unsigned int o;
+
+	for (o = 0; o < MAX_ORDER; o++) {
+		unsigned long pages = zone->free_area[o].nr_free << o;
+
+		free_pages += pages;
+		if (o >= order)
+			suitable_pages += pages;
+	}
+
+	if (!free_pages)
+		return 0;
+	return div64_u64((u64)(free_pages - suitable_pages) * 100, free_pages);
+}
+
+/*
+ * The fragmentation score of a zone, weighted by its share of the node's
+ * pages so that the scores of a node's zones add up to the node's score,
+ * between 0 and 100.
+ */
+static unsigned int fragmentation_score_zone(struct zone *zone)
+{
+	unsigned long node_pages = zone->zone_pgdat->node_present_pages;
+
+	if (!node_pages)
+		return 0;
+	return div64_u64((u64)extfrag_for_order(zone, COMPACTION_HPAGE_ORDER) *
+			 zone->present_pages, node_pages);
+}
+
+static unsigned int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned int score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (populated_zone(zone))
+			score += fragmentation_score_zone(zone);
+	}
+
+	return score;
+}
+
+/*
+ * kcompactd starts compacting a node when its score exceeds the high
+ * watermark, and stops when it drops to the low one.
+ */
+static unsigned int fragmentation_score_wmark(pg_data_t *pgdat, bool low)
+{
+	unsigned int wmark_low = 100 - sysctl_compaction_proactiveness;
+
+	return low ? wmark_low : min(wmark_low + 10, 100U);
+}
+
 static int compact_finished(struct zone *zone,
 			    struct compact_control *cc)
 {
@@ -675,10 +753,15 @@ static int compact_finished(struct zone *zone,
 
 	/*
 	 * order == -1 is expected when compacting via
-	 * /proc/sys/vm/compact_memory
+	 * /proc/sys/vm/compact_memory, and by kcompactd, which stops once
+	 * the zone is no longer fragmented.
 	 */
-	if (cc->order == -1)
+	if (cc->order == -1) {
+		if (cc->proactive && fragmentation_score_zone(zone) <=
+		    fragmentation_score_wmark(zone->zone_pgdat, true))
+			return COMPACT_COMPLETE;
 		return COMPACT_CONTINUE;
+	}
 
 	/* Compaction run is not finished if the watermark is not met */
 	watermark = low_wmark_pages(zone);
@@ -803,6 +886,12 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 
 		count_vm_event(COMPACTBLOCKS);
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
+		if (cc->proactive)
+			count_vm_events(COMPACTDAEMONPAGES,
+					nr_migrate - nr_remaining);
+		else if (cc->direct)
+			count_vm_events(COMPACTDIRECTPAGES,
+					nr_migrate - nr_remaining);
 		if (nr_remaining)
 			count_vm_events(COMPACTPAGEFAILED, nr_remaining);
 		trace_mm_compaction_migratepages(nr_migrate - nr_remaining,
@@ -838,6 +927,7 @@ static unsigned long compact_zone_order(struct zone *zone,
 		.migratetype = allocflags_to_migratetype(gfp_mask),
 		.zone = zone,
 		.sync = sync,
+		.direct = true,
 		.contended = contended,
 	};
 	INIT_LIST_HEAD(&cc.freepages);
@@ -990,6 +1080,157 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+static void proactive_compact_node(pg_data_t *pgdat)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.order = -1,
+			.sync = true,
+			.proactive = true,
+			.zone = zone,
+		};
+
+		if (!populated_zone(zone))
+			continue;
+
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+}
+
+static bool should_proactive_compact_node(pg_data_t *pgdat)
+{
+	if (!sysctl_compaction_proactiveness)
+		return false;
+
+	return fragmentation_score_node(pgdat) >
+		fragmentation_score_wmark(pgdat, false);
+}
+
+/*
+ * The background compaction daemon, one per node.  It wakes up every
+ * KCOMPACTD_CHECK_INTERVAL_MSEC to check the node's fragmentation score.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		unsigned int prev_score, score;
+
+		schedule_timeout_interruptible(
+			msecs_to_jiffies(KCOMPACTD_CHECK_INTERVAL_MSEC));
+		try_to_freeze();
+
+		if (!should_proactive_compact_node(pgdat))
+			continue;
+		if (pgdat->proactive_defer) {
+			pgdat->proactive_defer--;
+			continue;
+		}
+
+		count_vm_event(KCOMPACTD_WAKE);
+		prev_score = fragmentation_score_node(pgdat);
+		proactive_compact_node(pgdat);
+		score = fragmentation_score_node(pgdat);
+
+		/*
+		 * If compaction did not help, the free memory is probably
+		 * pinned by unmovable pages: back off for a while.
+		 */
+		if (score >= prev_score)
+			pgdat->proactive_defer = 1 << COMPACT_MAX_DEFER_SHIFT;
+	}
+
+	return 0;
+}
+
+/*
+ * It's optimal to keep kcompactd on the same CPUs as their memory, but
+ * not required for correctness.  So if the last cpu in a node goes away,
+ * we get changed to run anywhere: as the first one comes back, restore
+ * their cpu bindings.
+ */
+static int __devinit kcompactd_cpu_callback(struct notifier_block *nfb,
+					    unsigned long action, void *hcpu)
+{
+	int nid;
+
+	if (action == CPU_ONLINE || action == CPU_ONLINE_FROZEN) {
+		for_each_node_state(nid, N_HIGH_MEMORY) {
+			pg_data_t *pgdat = NODE_DATA(nid);
+			const struct cpumask *mask;
+
+			mask = cpumask_of_node(pgdat->node_id);
+
+			if (pgdat->kcompactd &&
+			    cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+				/* One of our CPUs online: restore mask */
+				set_cpus_allowed_ptr(pgdat->kcompactd, mask);
+		}
+	}
+	return NOTIFY_OK;
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ * On node-hot-add, kcompactd will moved to proper cpus if cpus are hot-added.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		pr_err("Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.  Caller must
+ * hold lock_memory_hotplug().
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	hotcpu_notifier(kcompactd_cpu_callback, 0);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct device *dev,
 			struct device_attribute *attr,
@@ -1507,6 +1507,70 @@ static int page_cache_read(struct file *file, pgoff_t offset)
 }
 
 #define MMAP_LOTSAMISS  (100)
+#define MMAP_STRIDE_CONFIDENT	(2)
+
+/*
+ * Remember how far apart the faults on this file are.  Faulters race on
+ * these fields just like they do on mmap_miss: it is only a hint.
+ */
+static void mmap_fault_history(struct file_ra_state *ra, pgoff_t offset)
+{
+	long stride = (long)(offset - ra->mmap_prev);
+
+	/* A retried fault tells us nothing new */
+	if (!stride)
+		return;
+
+	if (stride == ra->mmap_stride) {
+		if (ra->mmap_stride_hits < MMAP_STRIDE_CONFIDENT)
+			ra->mmap_stride_hits++;
+	} else {
+		ra->mmap_stride = stride;
+		ra->mmap_stride_hits = 0;
+	}
+	ra->mmap_prev = offset;
+}
+
+/*
+ * The last few faults on this file were the same distance apart.
+ *
+ * A dense stride, no wider than the read-around or fault-around window,
+ * gets one contiguous window in the direction of travel instead of one
+ * centered on the fault; fault-around then maps it as the faults walk
+ * through.  A sparse stride reads just the pages the pattern touches next.
+ */
+static void do_stride_mmap_readahead(struct file_ra_state *ra,
+				     struct address_space *mapping,
+				     struct file *file,
+				     pgoff_t offset)
+{
+	unsigned long ra_pages = max_sane_readahead(ra->ra_pages);
+	long stride = ra->mmap_stride;
+	unsigned long nr;
+
+	if (abs(stride) <= max(ra_pages / 2, fault_around_pages())) {
+		if (stride > 0) {
+			ra->start = offset;
+			ra->async_size = ra_pages / 4;
+		} else {
+			ra->start = max_t(long, 0, offset - ra_pages + 1);
+			ra->async_size = 0;
+		}
+		ra->size = ra_pages;
+		ra_submit(ra, mapping, file);
+		return;
+	}
+
+	ra->size = 1;
+	ra->async_size = 0;
+	for (nr = max(ra_pages / 4, 1UL); nr; nr--) {
+		ra->start = offset;
+		ra_submit(ra, mapping, file);
+		if (stride < 0 && offset < -stride)
+			break;
+		offset += stride;
+	}
+}
 
 /*
  * Synchronous readahead happens when we don't even find
@@ -1532,6 +1596,11 @@ static void do_sync_mmap_readahead(struct vm_area_struct *vma,
 		return;
 	}
 
+	if (ra->mmap_stride_hits >= MMAP_STRIDE_CONFIDENT) {
+		do_stride_mmap_readahead(ra, mapping, file, offset);
+		return;
+	}
+
 	/* Avoid banging the cache line if not needed */
 	if (ra->mmap_miss < MMAP_LOTSAMISS * 10)
 		ra->mmap_miss++;
@@ -1603,6 +1672,9 @@ int filemap_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	if (offset >= size)
 		return VM_FAULT_SIGBUS;
 
+	if (!VM_RandomReadHint(vma))
+		mmap_fault_history(ra, offset);
+
 	/*
 	 * Do we have something in the page cache already?
 	 */
@@ -1708,6 +1780,88 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+/**
+ * filemap_map_pages - map already cached pages around a read fault
+ * @vma:	vma in which the fault was taken
+ * @vmf:	struct vm_fault describing the range to map
+ *
+ * filemap_map_pages() is called under the page table lock to map the pages
+ * from @vmf->pgoff to @vmf->max_pgoff which are up to date in the page cache
+ * and can be locked without sleeping.  Anything else is left to ->fault().
+ */
+void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct radix_tree_iter iter;
+	void **slot;
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	loff_t size;
+	struct page *page;
+	unsigned long address = (unsigned long) vmf->virtual_address;
+	unsigned long addr;
+	pte_t *pte;
+
+	rcu_read_lock();
+	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter, vmf->pgoff) {
+		if (iter.index > vmf->max_pgoff)
+			break;
+repeat:
+		page = radix_tree_deref_slot(slot);
+		if (unlikely(!page))
+			goto next;
+		if (radix_tree_exception(page)) {
+			if (radix_tree_deref_retry(page))
+				break;
+			else
+				goto next;
+		}
+
+		if (!page_cache_get_speculative(page))
+			goto repeat;
+
+		/* Has the page moved? */
+		if (unlikely(page != *slot)) {
+			page_cache_release(page);
+			goto repeat;
+		}
+
+		/* Leave readahead marks for ->fault() to trip over */
+		if (!PageUptodate(page) ||
+				PageReadahead(page) ||
+				PageHWPoison(page))
+			goto skip;
+		if (!trylock_page(page))
+			goto skip;
+
+		if (page->mapping != mapping || !PageUptodate(page))
+			goto unlock;
+
+		size = i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1;
+		if (page->index >= size >> PAGE_CACHE_SHIFT)
+			goto unlock;
+
+		pte = vmf->pte + page->index - vmf->pgoff;
+		if (!pte_none(*pte))
+			goto unlock;
+
+		if (file->f_ra.mmap_miss > 0)
+			file->f_ra.mmap_miss--;
+		addr = address + (page->index - vmf->pgoff) * PAGE_SIZE;
+		do_set_pte(vma, addr, page, pte, false, false);
+		unlock_page(page);
+		goto next;
+unlock:
+		unlock_page(page);
+skip:
+		page_cache_release(page);
+next:
+		if (iter.index == vmf->max_pgoff)
+			break;
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
 int filemap_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
 {
 	struct page *page = vmf->page;
@@ -1736,6 +1890,7 @@ EXPORT_SYMBOL(filemap_page_mkwrite);
 
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 	.page_mkwrite	= filemap_page_mkwrite,
 };
 
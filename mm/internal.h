@@ -85,6 +85,11 @@ static inline void get_page_foll(struct page *page)
 
 extern unsigned long highest_memmap_pfn;
 
+/*
+ * in mm/memory.c:
+ */
+extern unsigned long fault_around_pages(void);
+
 /*
  * in mm/vmscan.c:
  */
@@ -127,6 +132,9 @@ struct compact_control {
 					   from the top of the zone;
 					   remember we wrapped around. */
 
+	bool direct;			/* Direct compaction */
+	bool proactive;			/* Proactive compaction by kcompactd */
+
 	int order;			/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
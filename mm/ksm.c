@@ -36,6 +36,8 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/nodemask.h>
+#include <linux/cpumask.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -78,36 +80,66 @@
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
  *    compare it against the stable tree, and then against the unstable tree.)
+ *
+ * On NUMA there is one ksmd thread per node, each with its own list of mms,
+ * its own stable and unstable trees, and its own ksm_scan cursor: an mm is
+ * scanned by the ksmd of the node it entered KSM on.  The threads scan in
+ * parallel, sharing ksm_thread_sem for read; the control paths which touch
+ * every scanner's state take it for write.  Pages are only merged among mms
+ * of the same scanner, which also keeps merged pages local to their users.
  */
 
 /**
  * struct mm_slot - ksm information per mm that is being scanned
  * @link: link to the mm_slots hash list
- * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
+ * @mm_list: link into the mm_slots list, rooted in its ksm_scan's mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @nid: node of the ksm_scan which scans this mm
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+#ifdef CONFIG_NUMA
+	int nid;
+#endif
 };
 
 /**
- * struct ksm_scan - cursor for scanning
+ * struct ksm_scan - cursor for scanning, and the trees it builds
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
  * @seqnr: count of completed full scans (needed when removing unstable node)
+ * @mm_head: head of the list of mm_slots scanned by this cursor
+ * @root_stable_tree: the stable tree of this scanner
+ * @root_unstable_tree: the unstable tree of this scanner
+ * @pages_shared: the number of nodes in the stable tree
+ * @pages_sharing: the number of page slots additionally sharing those nodes
+ * @pages_unshared: the number of nodes in the unstable tree
+ * @rmap_items: the number of rmap_items in use: to calculate pages_volatile
+ * @thread: the ksmd thread running this scanner
+ * @wait: where that thread waits for something to scan
  *
- * There is only the one ksm_scan instance of this cursor structure.
+ * There is one ksm_scan per node, all of its fields but the wait queue
+ * are only modified by its own ksmd, or under ksm_thread_sem for write.
  */
 struct ksm_scan {
 	struct mm_slot *mm_slot;
 	unsigned long address;
 	struct rmap_item **rmap_list;
 	unsigned long seqnr;
+	struct mm_slot mm_head;
+	struct rb_root root_stable_tree;
+	struct rb_root root_unstable_tree;
+	unsigned long pages_shared;
+	unsigned long pages_sharing;
+	unsigned long pages_unshared;
+	unsigned long rmap_items;
+	struct task_struct *thread;
+	wait_queue_head_t wait;
 };
 
 /**
@@ -115,11 +147,15 @@ struct ksm_scan {
  * @node: rb node of this ksm page in the stable tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @nid: node of the ksm_scan whose stable tree holds this node
  */
 struct stable_node {
 	struct rb_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+#ifdef CONFIG_NUMA
+	int nid;
+#endif
 };
 
 /**
@@ -129,6 +165,7 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @nid: node of the ksm_scan which scans this rmap_item's mm
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -139,6 +176,9 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+#ifdef CONFIG_NUMA
+	int nid;
+#endif
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -152,38 +192,29 @@ struct rmap_item {
 #define UNSTABLE_FLAG	0x100	/* is a node of the unstable tree */
 #define STABLE_FLAG	0x200	/* is listed from the stable tree */
 
-/* The stable and unstable tree heads */
-static struct rb_root root_stable_tree = RB_ROOT;
-static struct rb_root root_unstable_tree = RB_ROOT;
+#ifdef CONFIG_NUMA
+#define NUMA(x)		(x)
+#define DO_NUMA(x)	do { (x); } while (0)
+#else
+#define NUMA(x)		(0)
+#define DO_NUMA(x)	do { } while (0)
+#endif
 
 #define MM_SLOTS_HASH_SHIFT 10
 #define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
 static struct hlist_head mm_slots_hash[MM_SLOTS_HASH_HEADS];
 
-static struct mm_slot ksm_mm_head = {
-	.mm_list = LIST_HEAD_INIT(ksm_mm_head.mm_list),
-};
-static struct ksm_scan ksm_scan = {
-	.mm_slot = &ksm_mm_head,
-};
+/* The per-node scanners, indexed by nid */
+static struct ksm_scan *ksm_scans;
+
+/* Scanner for mms entering from a node which has no ksmd of its own */
+static int ksm_first_nid;
 
 static struct kmem_cache *rmap_item_cache;
 static struct kmem_cache *stable_node_cache;
 static struct kmem_cache *mm_slot_cache;
 
-/* The number of nodes in the stable tree */
-static unsigned long ksm_pages_shared;
-
-/* The number of page slots additionally sharing those nodes */
-static unsigned long ksm_pages_sharing;
-
-/* The number of nodes in the unstable tree */
-static unsigned long ksm_pages_unshared;
-
-/* The number of rmap_items in use: to calculate pages_volatile */
-static unsigned long ksm_rmap_items;
-
-/* Number of pages ksmd should scan in one batch */
+/* Number of pages each ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
 
 /* Milliseconds ksmd should sleep between batches */
@@ -194,8 +225,7 @@ static unsigned int ksm_thread_sleep_millisecs = 20;
 #define KSM_RUN_UNMERGE	2
 static unsigned int ksm_run = KSM_RUN_STOP;
 
-static DECLARE_WAIT_QUEUE_HEAD(ksm_thread_wait);
-static DEFINE_MUTEX(ksm_thread_mutex);
+static DECLARE_RWSEM(ksm_thread_sem);
 static DEFINE_SPINLOCK(ksm_mmlist_lock);
 
 #define KSM_KMEM_CACHE(__struct, __flags) kmem_cache_create("ksm_"#__struct,\
@@ -234,19 +264,20 @@ static void __init ksm_slab_free(void)
 	mm_slot_cache = NULL;
 }
 
-static inline struct rmap_item *alloc_rmap_item(void)
+static inline struct rmap_item *alloc_rmap_item(struct ksm_scan *scan)
 {
 	struct rmap_item *rmap_item;
 
 	rmap_item = kmem_cache_zalloc(rmap_item_cache, GFP_KERNEL);
 	if (rmap_item)
-		ksm_rmap_items++;
+		scan->rmap_items++;
 	return rmap_item;
 }
 
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
-	ksm_rmap_items--;
+	ksm_scans[NUMA(rmap_item->nid)].rmap_items--;
+	rmap_item->mm->ksm_rmap_items--;
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -449,20 +480,22 @@ out:		page = NULL;
 
 static void remove_node_from_stable_tree(struct stable_node *stable_node)
 {
+	struct ksm_scan *scan = &ksm_scans[NUMA(stable_node->nid)];
 	struct rmap_item *rmap_item;
 	struct hlist_node *hlist;
 
 	hlist_for_each_entry(rmap_item, hlist, &stable_node->hlist, hlist) {
 		if (rmap_item->hlist.next)
-			ksm_pages_sharing--;
+			scan->pages_sharing--;
 		else
-			ksm_pages_shared--;
+			scan->pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
 		cond_resched();
 	}
 
-	rb_erase(&stable_node->node, &root_stable_tree);
+	rb_erase(&stable_node->node, &scan->root_stable_tree);
 	free_stable_node(stable_node);
 }
 
@@ -484,7 +517,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
  * a page to put something that might look like our key in page->mapping.
  *
  * include/linux/pagemap.h page_cache_get_speculative() is a good reference,
- * but this is different - made simpler by ksm_thread_mutex being held, but
+ * but this is different - made simpler by ksm_thread_sem being held, but
  * interesting for assuming that no other use of the struct page could ever
  * put our expected_mapping into page->mapping (or a field of the union which
  * coincides with page->mapping).  The RCU calls are not for KSM at all, but
@@ -526,6 +559,8 @@ stale:
  */
 static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 {
+	struct ksm_scan *scan = &ksm_scans[NUMA(rmap_item->nid)];
+
 	if (rmap_item->address & STABLE_FLAG) {
 		struct stable_node *stable_node;
 		struct page *page;
@@ -541,9 +576,10 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		put_page(page);
 
 		if (stable_node->hlist.first)
-			ksm_pages_sharing--;
+			scan->pages_sharing--;
 		else
-			ksm_pages_shared--;
+			scan->pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
@@ -557,12 +593,12 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		 * if this rmap_item was inserted by this scan, rather
 		 * than left over from before.
 		 */
-		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
+		age = (unsigned char)(scan->seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
-			rb_erase(&rmap_item->node, &root_unstable_tree);
+			rb_erase(&rmap_item->node, &scan->root_unstable_tree);
 
-		ksm_pages_unshared--;
+		scan->pages_unshared--;
 		rmap_item->address &= PAGE_MASK;
 	}
 out:
@@ -611,10 +647,7 @@ static int unmerge_ksm_pages(struct vm_area_struct *vma,
 }
 
 #ifdef CONFIG_SYSFS
-/*
- * Only called through the sysfs control interface:
- */
-static int unmerge_and_remove_all_rmap_items(void)
+static int unmerge_and_remove_scan_rmap_items(struct ksm_scan *scan)
 {
 	struct mm_slot *mm_slot;
 	struct mm_struct *mm;
@@ -622,12 +655,12 @@ static int unmerge_and_remove_all_rmap_items(void)
 	int err = 0;
 
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
+	scan->mm_slot = list_entry(scan->mm_head.mm_list.next,
 						struct mm_slot, mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
-	for (mm_slot = ksm_scan.mm_slot;
-			mm_slot != &ksm_mm_head; mm_slot = ksm_scan.mm_slot) {
+	for (mm_slot = scan->mm_slot;
+			mm_slot != &scan->mm_head; mm_slot = scan->mm_slot) {
 		mm = mm_slot->mm;
 		down_read(&mm->mmap_sem);
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
@@ -644,7 +677,7 @@ static int unmerge_and_remove_all_rmap_items(void)
 		remove_trailing_rmap_items(mm_slot, &mm_slot->rmap_list);
 
 		spin_lock(&ksm_mmlist_lock);
-		ksm_scan.mm_slot = list_entry(mm_slot->mm_list.next,
+		scan->mm_slot = list_entry(mm_slot->mm_list.next,
 						struct mm_slot, mm_list);
 		if (ksm_test_exit(mm)) {
 			hlist_del(&mm_slot->link);
@@ -661,23 +694,54 @@ static int unmerge_and_remove_all_rmap_items(void)
 		}
 	}
 
-	ksm_scan.seqnr = 0;
+	scan->seqnr = 0;
 	return 0;
 
 error:
 	up_read(&mm->mmap_sem);
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = &ksm_mm_head;
+	scan->mm_slot = &scan->mm_head;
 	spin_unlock(&ksm_mmlist_lock);
 	return err;
 }
+
+/*
+ * Only called through the sysfs control interface:
+ */
+static int unmerge_and_remove_all_rmap_items(void)
+{
+	int nid, err;
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		err = unmerge_and_remove_scan_rmap_items(&ksm_scans[nid]);
+		if (err)
+			return err;
+	}
+	return 0;
+}
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum only serves to keep pages that changed since the last scan
+ * out of the unstable tree, so it need not cover the whole page: a page
+ * being written to usually changes in more than one place.  Hash a 64 byte
+ * chunk at each of KSM_CHECKSUM_CHUNKS evenly spaced offsets, which costs
+ * a fraction of hashing the page and rejects most volatile pages.  Pages
+ * are still compared in full before they are merged.
+ */
+#define KSM_CHECKSUM_CHUNKS	8
+#define KSM_CHECKSUM_WORDS	(64 / sizeof(u32))
+#define KSM_CHECKSUM_STRIDE	(PAGE_SIZE / sizeof(u32) / KSM_CHECKSUM_CHUNKS)
+
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
-	void *addr = kmap_atomic(page);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	u32 checksum = 17;
+	u32 *addr = kmap_atomic(page);
+	int i;
+
+	for (i = 0; i < KSM_CHECKSUM_CHUNKS; i++)
+		checksum = jhash2(addr + i * KSM_CHECKSUM_STRIDE,
+				  KSM_CHECKSUM_WORDS, checksum);
 	kunmap_atomic(addr);
 	return checksum;
 }
@@ -886,6 +950,11 @@ static int try_to_merge_one_page(struct vm_area_struct *vma,
 	 * ptes are necessarily already write-protected.  But in either
 	 * case, we need to lock and check page_count is not raised.
 	 */
+	if (!kpage && PageKsm(page)) {
+		/* Another ksmd is making this forked page a ksm page */
+		unlock_page(page);
+		goto out;
+	}
 	if (write_protect_page(vma, page, &orig_pte) == 0) {
 		if (!kpage) {
 			/*
@@ -987,9 +1056,10 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct ksm_scan *scan,
+				       struct page *page)
 {
-	struct rb_node *node = root_stable_tree.rb_node;
+	struct rb_node *node = scan->root_stable_tree.rb_node;
 	struct stable_node *stable_node;
 
 	stable_node = page_stable_node(page);
@@ -1030,9 +1100,10 @@ static struct page *stable_tree_search(struct page *page)
  * This function returns the stable tree node just allocated on success,
  * NULL otherwise.
  */
-static struct stable_node *stable_tree_insert(struct page *kpage)
+static struct stable_node *stable_tree_insert(struct ksm_scan *scan,
+					      struct page *kpage)
 {
-	struct rb_node **new = &root_stable_tree.rb_node;
+	struct rb_node **new = &scan->root_stable_tree.rb_node;
 	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
 
@@ -1069,11 +1140,12 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 		return NULL;
 
 	rb_link_node(&stable_node->node, parent, new);
-	rb_insert_color(&stable_node->node, &root_stable_tree);
+	rb_insert_color(&stable_node->node, &scan->root_stable_tree);
 
 	INIT_HLIST_HEAD(&stable_node->hlist);
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	DO_NUMA(stable_node->nid = scan - ksm_scans);
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1094,12 +1166,13 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
  * the same walking algorithm in an rbtree.
  */
 static
-struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
+struct rmap_item *unstable_tree_search_insert(struct ksm_scan *scan,
+					      struct rmap_item *rmap_item,
 					      struct page *page,
 					      struct page **tree_pagep)
 
 {
-	struct rb_node **new = &root_unstable_tree.rb_node;
+	struct rb_node **new = &scan->root_unstable_tree.rb_node;
 	struct rb_node *parent = NULL;
 
 	while (*new) {
@@ -1137,11 +1210,11 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 	}
 
 	rmap_item->address |= UNSTABLE_FLAG;
-	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
+	rmap_item->address |= (scan->seqnr & SEQNR_MASK);
 	rb_link_node(&rmap_item->node, parent, new);
-	rb_insert_color(&rmap_item->node, &root_unstable_tree);
+	rb_insert_color(&rmap_item->node, &scan->root_unstable_tree);
 
-	ksm_pages_unshared++;
+	scan->pages_unshared++;
 	return NULL;
 }
 
@@ -1153,14 +1226,17 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 static void stable_tree_append(struct rmap_item *rmap_item,
 			       struct stable_node *stable_node)
 {
+	struct ksm_scan *scan = &ksm_scans[NUMA(stable_node->nid)];
+
 	rmap_item->head = stable_node;
 	rmap_item->address |= STABLE_FLAG;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
 
 	if (rmap_item->hlist.next)
-		ksm_pages_sharing++;
+		scan->pages_sharing++;
 	else
-		ksm_pages_shared++;
+		scan->pages_shared++;
+	rmap_item->mm->ksm_merging_pages++;
 }
 
 /*
@@ -1169,10 +1245,12 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  * be inserted into the unstable tree, or merged with a page already there and
  * both transferred to the stable tree.
  *
+ * @scan: the scanner whose trees are searched
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
  */
-static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
+static void cmp_and_merge_page(struct ksm_scan *scan, struct page *page,
+			       struct rmap_item *rmap_item)
 {
 	struct rmap_item *tree_rmap_item;
 	struct page *tree_page = NULL;
@@ -1183,8 +1261,19 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 
 	remove_rmap_item_from_tree(rmap_item);
 
+	/*
+	 * A ksm page forked into an mm of another node's ksmd: it is
+	 * already shared, and its stable_node belongs to the other ksmd.
+	 */
+	if (PageKsm(page)) {
+		stable_node = page_stable_node(page);
+		if (!stable_node ||
+		    NUMA(stable_node->nid) != NUMA(rmap_item->nid))
+			return;
+	}
+
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = stable_tree_search(scan, page);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1213,7 +1302,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	}
 
 	tree_rmap_item =
-		unstable_tree_search_insert(rmap_item, page, &tree_page);
+		unstable_tree_search_insert(scan, rmap_item, page, &tree_page);
 	if (tree_rmap_item) {
 		kpage = try_to_merge_two_pages(rmap_item, page,
 						tree_rmap_item, tree_page);
@@ -1227,7 +1316,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			remove_rmap_item_from_tree(tree_rmap_item);
 
 			lock_page(kpage);
-			stable_node = stable_tree_insert(kpage);
+			stable_node = stable_tree_insert(scan, kpage);
 			if (stable_node) {
 				stable_tree_append(tree_rmap_item, stable_node);
 				stable_tree_append(rmap_item, stable_node);
@@ -1248,7 +1337,8 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	}
 }
 
-static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
+static struct rmap_item *get_next_rmap_item(struct ksm_scan *scan,
+					    struct mm_slot *mm_slot,
 					    struct rmap_item **rmap_list,
 					    unsigned long addr)
 {
@@ -1265,10 +1355,12 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 		free_rmap_item(rmap_item);
 	}
 
-	rmap_item = alloc_rmap_item();
+	rmap_item = alloc_rmap_item(scan);
 	if (rmap_item) {
 		/* It has already been zeroed */
 		rmap_item->mm = mm_slot->mm;
+		DO_NUMA(rmap_item->nid = mm_slot->nid);
+		rmap_item->mm->ksm_rmap_items++;
 		rmap_item->address = addr;
 		rmap_item->rmap_list = *rmap_list;
 		*rmap_list = rmap_item;
@@ -1276,18 +1368,19 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+static struct rmap_item *scan_get_next_rmap_item(struct ksm_scan *scan,
+						 struct page **page)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
 
-	if (list_empty(&ksm_mm_head.mm_list))
+	if (list_empty(&scan->mm_head.mm_list))
 		return NULL;
 
-	slot = ksm_scan.mm_slot;
-	if (slot == &ksm_mm_head) {
+	slot = scan->mm_slot;
+	if (slot == &scan->mm_head) {
 		/*
 		 * A number of pages can hang around indefinitely on per-cpu
 		 * pagevecs, raised page count preventing write_protect_page
@@ -1300,21 +1393,21 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		 */
 		lru_add_drain_all();
 
-		root_unstable_tree = RB_ROOT;
+		scan->root_unstable_tree = RB_ROOT;
 
 		spin_lock(&ksm_mmlist_lock);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
-		ksm_scan.mm_slot = slot;
+		scan->mm_slot = slot;
 		spin_unlock(&ksm_mmlist_lock);
 		/*
 		 * Although we tested list_empty() above, a racing __ksm_exit
 		 * of the last mm on the list may have removed it since then.
 		 */
-		if (slot == &ksm_mm_head)
+		if (slot == &scan->mm_head)
 			return NULL;
 next_mm:
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 
 	mm = slot->mm;
@@ -1322,60 +1415,60 @@ next_mm:
 	if (ksm_test_exit(mm))
 		vma = NULL;
 	else
-		vma = find_vma(mm, ksm_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	for (; vma; vma = vma->vm_next) {
 		if (!(vma->vm_flags & VM_MERGEABLE))
 			continue;
-		if (ksm_scan.address < vma->vm_start)
-			ksm_scan.address = vma->vm_start;
+		if (scan->address < vma->vm_start)
+			scan->address = vma->vm_start;
 		if (!vma->anon_vma)
-			ksm_scan.address = vma->vm_end;
+			scan->address = vma->vm_end;
 
-		while (ksm_scan.address < vma->vm_end) {
+		while (scan->address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			*page = follow_page(vma, scan->address, FOLL_GET);
 			if (IS_ERR_OR_NULL(*page)) {
-				ksm_scan.address += PAGE_SIZE;
+				scan->address += PAGE_SIZE;
 				cond_resched();
 				continue;
 			}
 			if (PageAnon(*page) ||
 			    page_trans_compound_anon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
+				flush_anon_page(vma, *page, scan->address);
 				flush_dcache_page(*page);
-				rmap_item = get_next_rmap_item(slot,
-					ksm_scan.rmap_list, ksm_scan.address);
+				rmap_item = get_next_rmap_item(scan, slot,
+					scan->rmap_list, scan->address);
 				if (rmap_item) {
-					ksm_scan.rmap_list =
+					scan->rmap_list =
 							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
+					scan->address += PAGE_SIZE;
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
 				return rmap_item;
 			}
 			put_page(*page);
-			ksm_scan.address += PAGE_SIZE;
+			scan->address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
 	if (ksm_test_exit(mm)) {
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
 	 */
-	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	remove_trailing_rmap_items(slot, scan->rmap_list);
 
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
+	scan->mm_slot = list_entry(slot->mm_list.next,
 						struct mm_slot, mm_list);
-	if (ksm_scan.address == 0) {
+	if (scan->address == 0) {
 		/*
 		 * We've completed a full scan of all vmas, holding mmap_sem
 		 * throughout, and found no VM_MERGEABLE: so do the same as
@@ -1399,63 +1492,78 @@ next_mm:
 	}
 
 	/* Repeat until we've completed scanning the whole list */
-	slot = ksm_scan.mm_slot;
-	if (slot != &ksm_mm_head)
+	slot = scan->mm_slot;
+	if (slot != &scan->mm_head)
 		goto next_mm;
 
-	ksm_scan.seqnr++;
+	scan->seqnr++;
 	return NULL;
 }
 
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
+ * @scan - the scanner to advance.
  * @scan_npages - number of pages we want to scan before we return.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static void ksm_do_scan(struct ksm_scan *scan, unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
 
 	while (scan_npages-- && likely(!freezing(current))) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
+		rmap_item = scan_get_next_rmap_item(scan, &page);
 		if (!rmap_item)
 			return;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
-			cmp_and_merge_page(page, rmap_item);
+			cmp_and_merge_page(scan, page, rmap_item);
 		put_page(page);
 	}
 }
 
-static int ksmd_should_run(void)
+static int ksmd_should_run(struct ksm_scan *scan)
 {
-	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
+	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&scan->mm_head.mm_list);
 }
 
-static int ksm_scan_thread(void *nothing)
+static int ksm_scan_thread(void *data)
 {
+	struct ksm_scan *scan = data;
+	int nid = scan - ksm_scans;
+	const struct cpumask *cpumask = cpumask_of_node(nid);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
-		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
-		mutex_unlock(&ksm_thread_mutex);
+		down_read(&ksm_thread_sem);
+		if (ksmd_should_run(scan))
+			ksm_do_scan(scan, ksm_thread_pages_to_scan);
+		up_read(&ksm_thread_sem);
 
 		try_to_freeze();
 
-		if (ksmd_should_run()) {
+		if (ksmd_should_run(scan)) {
 			schedule_timeout_interruptible(
 				msecs_to_jiffies(ksm_thread_sleep_millisecs));
 		} else {
-			wait_event_freezable(ksm_thread_wait,
-				ksmd_should_run() || kthread_should_stop());
+			wait_event_freezable(scan->wait,
+				ksmd_should_run(scan) || kthread_should_stop());
 		}
 	}
 	return 0;
 }
 
+static void ksm_wake_up_all(void)
+{
+	int nid;
+
+	for (nid = 0; nid < nr_node_ids; nid++)
+		wake_up_interruptible(&ksm_scans[nid].wait);
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -1501,15 +1609,24 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 
 int __ksm_enter(struct mm_struct *mm)
 {
+	struct ksm_scan *scan;
 	struct mm_slot *mm_slot;
 	int needs_wakeup;
+	int nid;
 
 	mm_slot = alloc_mm_slot();
 	if (!mm_slot)
 		return -ENOMEM;
 
+	/* Scanned by the ksmd of the node we are running on, if it has one */
+	nid = numa_node_id();
+	if (!ksm_scans[nid].thread)
+		nid = ksm_first_nid;
+	scan = &ksm_scans[nid];
+	DO_NUMA(mm_slot->nid = nid);
+
 	/* Check ksm_run too?  Would need tighter locking */
-	needs_wakeup = list_empty(&ksm_mm_head.mm_list);
+	needs_wakeup = list_empty(&scan->mm_head.mm_list);
 
 	spin_lock(&ksm_mmlist_lock);
 	insert_to_mm_slots_hash(mm, mm_slot);
@@ -1518,20 +1635,21 @@ int __ksm_enter(struct mm_struct *mm)
 	 * down a little; when fork is followed by immediate exec, we don't
 	 * want ksmd to waste time setting up and tearing down an rmap_list.
 	 */
-	list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+	list_add_tail(&mm_slot->mm_list, &scan->mm_slot->mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
 	atomic_inc(&mm->mm_count);
 
 	if (needs_wakeup)
-		wake_up_interruptible(&ksm_thread_wait);
+		wake_up_interruptible(&scan->wait);
 
 	return 0;
 }
 
 void __ksm_exit(struct mm_struct *mm)
 {
+	struct ksm_scan *scan;
 	struct mm_slot *mm_slot;
 	int easy_to_free = 0;
 
@@ -1546,14 +1664,15 @@ void __ksm_exit(struct mm_struct *mm)
 
 	spin_lock(&ksm_mmlist_lock);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && ksm_scan.mm_slot != mm_slot) {
+	scan = mm_slot ? &ksm_scans[NUMA(mm_slot->nid)] : NULL;
+	if (mm_slot && scan->mm_slot != mm_slot) {
 		if (!mm_slot->rmap_list) {
 			hlist_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
 			easy_to_free = 1;
 		} else {
 			list_move(&mm_slot->mm_list,
-				  &ksm_scan.mm_slot->mm_list);
+				  &scan->mm_slot->mm_list);
 		}
 	}
 	spin_unlock(&ksm_mmlist_lock);
@@ -1768,14 +1887,19 @@ static struct stable_node *ksm_check_stable_tree(unsigned long start_pfn,
 						 unsigned long end_pfn)
 {
 	struct rb_node *node;
+	int nid;
 
-	for (node = rb_first(&root_stable_tree); node; node = rb_next(node)) {
-		struct stable_node *stable_node;
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		struct rb_root *root = &ksm_scans[nid].root_stable_tree;
 
-		stable_node = rb_entry(node, struct stable_node, node);
-		if (stable_node->kpfn >= start_pfn &&
-		    stable_node->kpfn < end_pfn)
-			return stable_node;
+		for (node = rb_first(root); node; node = rb_next(node)) {
+			struct stable_node *stable_node;
+
+			stable_node = rb_entry(node, struct stable_node, node);
+			if (stable_node->kpfn >= start_pfn &&
+			    stable_node->kpfn < end_pfn)
+				return stable_node;
+		}
 	}
 	return NULL;
 }
@@ -1791,13 +1915,13 @@ static int ksm_memory_callback(struct notifier_block *self,
 		/*
 		 * Keep it very simple for now: just lock out ksmd and
 		 * MADV_UNMERGEABLE while any memory is going offline.
-		 * mutex_lock_nested() is necessary because lockdep was alarmed
-		 * that here we take ksm_thread_mutex inside notifier chain
+		 * down_write_nested() is necessary because lockdep was alarmed
+		 * that here we take ksm_thread_sem inside notifier chain
 		 * mutex, and later take notifier chain mutex inside
-		 * ksm_thread_mutex to unlock it.   But that's safe because both
+		 * ksm_thread_sem to unlock it.   But that's safe because both
 		 * are inside mem_hotplug_mutex.
 		 */
-		mutex_lock_nested(&ksm_thread_mutex, SINGLE_DEPTH_NESTING);
+		down_write_nested(&ksm_thread_sem, SINGLE_DEPTH_NESTING);
 		break;
 
 	case MEM_OFFLINE:
@@ -1812,7 +1936,7 @@ static int ksm_memory_callback(struct notifier_block *self,
 		/* fallthrough */
 
 	case MEM_CANCEL_OFFLINE:
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 		break;
 	}
 	return NOTIFY_OK;
@@ -1901,7 +2025,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 	 * on the list for when ksmd may be set running again).
 	 */
 
-	mutex_lock(&ksm_thread_mutex);
+	down_write(&ksm_thread_sem);
 	if (ksm_run != flags) {
 		ksm_run = flags;
 		if (flags & KSM_RUN_UNMERGE) {
@@ -1917,33 +2041,43 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 			}
 		}
 	}
-	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_thread_sem);
 
 	if (flags & KSM_RUN_MERGE)
-		wake_up_interruptible(&ksm_thread_wait);
+		ksm_wake_up_all();
 
 	return count;
 }
 KSM_ATTR(run);
 
+/* Sum a statistic over the per-node scanners */
+#define KSM_SUM(_field)						\
+({								\
+	unsigned long __sum = 0;				\
+	int __nid;						\
+	for (__nid = 0; __nid < nr_node_ids; __nid++)		\
+		__sum += ksm_scans[__nid]._field;		\
+	__sum;							\
+})
+
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_pages_shared);
+	return sprintf(buf, "%lu\n", KSM_SUM(pages_shared));
 }
 KSM_ATTR_RO(pages_shared);
 
 static ssize_t pages_sharing_show(struct kobject *kobj,
 				  struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_pages_sharing);
+	return sprintf(buf, "%lu\n", KSM_SUM(pages_sharing));
 }
 KSM_ATTR_RO(pages_sharing);
 
 static ssize_t pages_unshared_show(struct kobject *kobj,
 				   struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_pages_unshared);
+	return sprintf(buf, "%lu\n", KSM_SUM(pages_unshared));
 }
 KSM_ATTR_RO(pages_unshared);
 
@@ -1952,8 +2086,8 @@ static ssize_t pages_volatile_show(struct kobject *kobj,
 {
 	long ksm_pages_volatile;
 
-	ksm_pages_volatile = ksm_rmap_items - ksm_pages_shared
-				- ksm_pages_sharing - ksm_pages_unshared;
+	ksm_pages_volatile = KSM_SUM(rmap_items) - KSM_SUM(pages_shared)
+			- KSM_SUM(pages_sharing) - KSM_SUM(pages_unshared);
 	/*
 	 * It was not worth any locking to calculate that statistic,
 	 * but it might therefore sometimes be negative: conceal that.
@@ -1967,7 +2101,7 @@ KSM_ATTR_RO(pages_volatile);
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_scan.seqnr);
+	return sprintf(buf, "%lu\n", KSM_SUM(seqnr));
 }
 KSM_ATTR_RO(full_scans);
 
@@ -1989,27 +2123,62 @@ static struct attribute_group ksm_attr_group = {
 };
 #endif /* CONFIG_SYSFS */
 
+static void __init ksm_stop_threads(void)
+{
+	int nid;
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		if (ksm_scans[nid].thread)
+			kthread_stop(ksm_scans[nid].thread);
+	}
+}
+
 static int __init ksm_init(void)
 {
 	struct task_struct *ksm_thread;
-	int err;
+	int err, nid;
+
+	ksm_scans = kcalloc(nr_node_ids, sizeof(*ksm_scans), GFP_KERNEL);
+	if (!ksm_scans)
+		return -ENOMEM;
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		struct ksm_scan *scan = &ksm_scans[nid];
+
+		INIT_LIST_HEAD(&scan->mm_head.mm_list);
+		scan->mm_slot = &scan->mm_head;
+		scan->root_stable_tree = RB_ROOT;
+		scan->root_unstable_tree = RB_ROOT;
+		init_waitqueue_head(&scan->wait);
+	}
+	ksm_first_nid = first_online_node;
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
-	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
-	if (IS_ERR(ksm_thread)) {
-		printk(KERN_ERR "ksm: creating kthread failed\n");
-		err = PTR_ERR(ksm_thread);
-		goto out_free;
+	/* One ksmd per node, keeping the old name when there is only one */
+	for_each_online_node(nid) {
+		if (nr_online_nodes > 1)
+			ksm_thread = kthread_run(ksm_scan_thread,
+						 &ksm_scans[nid], "ksmd/%d", nid);
+		else
+			ksm_thread = kthread_run(ksm_scan_thread,
+						 &ksm_scans[nid], "ksmd");
+		if (IS_ERR(ksm_thread)) {
+			printk(KERN_ERR "ksm: creating kthread failed\n");
+			err = PTR_ERR(ksm_thread);
+			ksm_stop_threads();
+			goto out_free;
+		}
+		ksm_scans[nid].thread = ksm_thread;
 	}
 
 #ifdef CONFIG_SYSFS
 	err = sysfs_create_group(mm_kobj, &ksm_attr_group);
 	if (err) {
 		printk(KERN_ERR "ksm: register sysfs failed\n");
-		kthread_stop(ksm_thread);
+		ksm_stop_threads();
 		goto out_free;
 	}
 #else
@@ -2019,7 +2188,7 @@ static int __init ksm_init(void)
 
 #ifdef CONFIG_MEMORY_HOTREMOVE
 	/*
-	 * Choose a high priority since the callback takes ksm_thread_mutex:
+	 * Choose a high priority since the callback takes ksm_thread_sem:
 	 * later callbacks could only be taking locks which nest within that.
 	 */
 	hotplug_memory_notifier(ksm_memory_callback, 100);
@@ -2029,6 +2198,8 @@ static int __init ksm_init(void)
 out_free:
 	ksm_slab_free();
 out:
+	kfree(ksm_scans);
+	ksm_scans = NULL;
 	return err;
 }
 module_init(ksm_init)
@@ -58,6 +58,7 @@
 #include <linux/prefetch.h>
 #include <linux/migrate.h>
 #include <linux/page-debug-flags.h>
+#include <linux/page_reporting.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -442,6 +443,7 @@ static inline void set_page_order(struct page *page, int order)
 static inline void rmv_page_order(struct page *page)
 {
 	__ClearPageBuddy(page);
+	__ClearPageReported(page);
 	set_page_private(page, 0);
 }
 
@@ -6047,3 +6049,170 @@ void dump_page(struct page *page)
 	dump_page_flags(page->flags);
 	mem_cgroup_print_bad_page(page);
 }
+
+#ifdef CONFIG_PAGE_REPORTING
+/*
+ * Free page reporting: every PAGE_REPORTING_DELAY, free blocks of at least
+ * PAGE_REPORTING_MIN_ORDER pages that have not been reported yet are pulled
+ * off the free lists in batches of up to PAGE_REPORTING_CAPACITY, handed to
+ * the registered consumer, and put back at the tail of their free list
+ * marked PageReported.  A block loses the mark when it is allocated or
+ * merged, so only memory that was freed since is reported again.
+ */
+#define PAGE_REPORTING_DELAY	(2 * HZ)
+
+static DEFINE_MUTEX(page_reporting_mutex);
+static struct page_reporting_dev_info *page_reporting_dev;
+static struct scatterlist page_reporting_sg[PAGE_REPORTING_CAPACITY];
+
+static void page_reporting_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(page_reporting_work, page_reporting_work_fn);
+
+/*
+ * Pull up to PAGE_REPORTING_CAPACITY unreported blocks off one free list
+ * into page_reporting_sg, leaving the zone above its high watermark.
+ */
+static unsigned int page_reporting_isolate(struct zone *zone,
+					   unsigned int order, int mt)
+{
+	struct list_head *list = &zone->free_area[order].free_list[mt];
+	struct scatterlist *sg = page_reporting_sg;
+	unsigned long watermark = high_wmark_pages(zone) + (1UL << order);
+	struct page *page, *next;
+	unsigned int nents = 0;
+
+	sg_init_table(sg, PAGE_REPORTING_CAPACITY);
+
+	list_for_each_entry_safe(page, next, list, lru) {
+		if (PageReported(page))
+			continue;
+		if (zone_page_state(zone, NR_FREE_PAGES) < watermark)
+			break;
+
+		list_del(&page->lru);
+		zone->free_area[order].nr_free--;
+		rmv_page_order(page);
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1 << order));
+
+		sg_set_page(&sg[nents], page, PAGE_SIZE << order, 0);
+		if (++nents == PAGE_REPORTING_CAPACITY)
+			break;
+	}
+
+	if (nents)
+		sg_mark_end(&sg[nents - 1]);
+	return nents;
+}
+
+/*
+ * Return the blocks in page_reporting_sg to the free lists.  Their
+ * pageblocks may have changed migratetype meanwhile, e.g. been isolated.
+ */
+static void page_reporting_putback(struct zone *zone, unsigned int order,
+				   unsigned int nents, bool reported)
+{
+	unsigned int i;
+
+	for (i = 0; i < nents; i++) {
+		struct page *page = sg_page(&page_reporting_sg[i]);
+		int mt = get_pageblock_migratetype(page);
+
+		__free_one_page(page, zone, order, mt);
+		__mod_zone_page_state(zone, NR_FREE_PAGES, 1 << order);
+
+		/* A block that merged with a freed buddy is not all reported */
+		if (!reported || !PageBuddy(page) || page_order(page) != order)
+			continue;
+		__SetPageReported(page);
+		list_move_tail(&page->lru,
+			       &zone->free_area[order].free_list[mt]);
+	}
+}
+
+static void page_reporting_zone(struct page_reporting_dev_info *prdev,
+				struct zone *zone)
+{
+	unsigned int nents;
+	int order, mt, err;
+
+	for (order = MAX_ORDER - 1; order >= PAGE_REPORTING_MIN_ORDER; order--) {
+		for (mt = 0; mt < MIGRATE_TYPES; mt++) {
+			if (mt == MIGRATE_ISOLATE)
+				continue;
+			do {
+				spin_lock_irq(&zone->lock);
+				nents = page_reporting_isolate(zone, order, mt);
+				spin_unlock_irq(&zone->lock);
+				if (!nents)
+					break;
+
+				err = prdev->report(prdev, page_reporting_sg,
+						    nents);
+
+				spin_lock_irq(&zone->lock);
+				page_reporting_putback(zone, order, nents,
+						       !err);
+				spin_unlock_irq(&zone->lock);
+				cond_resched();
+			} while (!err && nents == PAGE_REPORTING_CAPACITY);
+		}
+	}
+}
+
+static void page_reporting_work_fn(struct work_struct *work)
+{
+	struct zone *zone;
+
+	mutex_lock(&page_reporting_mutex);
+	if (!page_reporting_dev)
+		goto out;
+
+	for_each_populated_zone(zone)
+		page_reporting_zone(page_reporting_dev, zone);
+
+	schedule_delayed_work(&page_reporting_work, PAGE_REPORTING_DELAY);
+out:
+	mutex_unlock(&page_reporting_mutex);
+}
+
+/**
+ * page_reporting_register - start reporting free pages to a consumer
+ * @prdev: the consumer
+ *
+ * Only one consumer can be registered at a time.  Returns -EBUSY if there
+ * already is one.
+ */
+int page_reporting_register(struct page_reporting_dev_info *prdev)
+{
+	int err = 0;
+
+	mutex_lock(&page_reporting_mutex);
+	if (page_reporting_dev) {
+		err = -EBUSY;
+	} else {
+		page_reporting_dev = prdev;
+		schedule_delayed_work(&page_reporting_work,
+				      PAGE_REPORTING_DELAY);
+	}
+	mutex_unlock(&page_reporting_mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(page_reporting_register);
+
+/**
+ * page_reporting_unregister - stop reporting free pages to a consumer
+ * @prdev: the consumer passed to page_reporting_register()
+ *
+ * No report is in progress when this returns.
+ */
+void page_reporting_unregister(struct page_reporting_dev_info *prdev)
+{
+	mutex_lock(&page_reporting_mutex);
+	if (page_reporting_dev == prdev)
+		page_reporting_dev = NULL;
+	mutex_unlock(&page_reporting_mutex);
+
+	cancel_delayed_work_sync(&page_reporting_work);
+}
+EXPORT_SYMBOL_GPL(page_reporting_unregister);
+#endif /* CONFIG_PAGE_REPORTING */
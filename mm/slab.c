@@ -3848,6 +3848,61 @@ void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/**
+ * kmem_cache_alloc_bulk - Allocate several objects
+ * @cachep: The cache to allocate from.
+ * @flags: See kmalloc().
+ * @size: Number of objects to allocate.
+ * @p: Array the objects are returned in.
+ *
+ * Like calling kmem_cache_alloc() @size times, but interrupts are only
+ * disabled once around the per cpu array cache accesses.  Either all
+ * objects are allocated and @size is returned, or none and 0 is returned.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *cachep, gfp_t flags, size_t size,
+			  void **p)
+{
+	unsigned long save_flags;
+	size_t i, nr;
+
+	flags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(flags);
+
+	if (slab_should_failslab(cachep, flags))
+		return 0;
+
+	cache_alloc_debugcheck_before(cachep, flags);
+	local_irq_save(save_flags);
+	for (nr = 0; nr < size; nr++) {
+		p[nr] = __do_cache_alloc(cachep, flags);
+		if (unlikely(!p[nr]))
+			break;
+	}
+	local_irq_restore(save_flags);
+
+	for (i = 0; i < nr; i++) {
+		p[i] = cache_alloc_debugcheck_after(cachep, flags, p[i],
+						    __builtin_return_address(0));
+		kmemleak_alloc_recursive(p[i], cachep->object_size, 1,
+					 cachep->flags, flags);
+		kmemcheck_slab_alloc(cachep, flags, p[i], cachep->object_size);
+
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, cachep->object_size);
+
+		trace_kmem_cache_alloc(_RET_IP_, p[i],
+				       cachep->object_size, cachep->size, flags);
+	}
+
+	if (unlikely(nr < size)) {
+		kmem_cache_free_bulk(cachep, nr, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 #ifdef CONFIG_TRACING
 void *
 kmem_cache_alloc_trace(size_t size, struct kmem_cache *cachep, gfp_t flags)
@@ -4002,6 +4057,34 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_free_bulk - Deallocate several objects
+ * @cachep: The cache the allocations were from.
+ * @size: Number of objects to free.
+ * @p: The previously allocated objects.
+ *
+ * Like calling kmem_cache_free() on each object, with interrupts disabled
+ * only once.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *cachep, size_t size, void **p)
+{
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	for (i = 0; i < size; i++) {
+		debug_check_no_locks_freed(p[i], cachep->object_size);
+		if (!(cachep->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(p[i], cachep->object_size);
+		__cache_free(cachep, p[i], __builtin_return_address(0));
+	}
+	local_irq_restore(flags);
+
+	for (i = 0; i < size; i++)
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /**
  * kfree - free previously allocated memory
  * @objp: pointer returned by kmalloc.
@@ -30,4 +30,9 @@ extern struct list_head slab_caches;
 struct kmem_cache *__kmem_cache_create(const char *name, size_t size,
 	size_t align, unsigned long flags, void (*ctor)(void *));
 
+/* Object at a time versions of kmem_cache_{alloc,free}_bulk() */
+int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+	void **p);
+void __kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p);
+
 #endif
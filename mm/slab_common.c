@@ -114,6 +114,33 @@ out:
 }
 EXPORT_SYMBOL(kmem_cache_create);
 
+/*
+ * Fallback for allocators, and caches, that have no better way to handle
+ * several objects at once than one at a time.
+ */
+void __kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		kmem_cache_free(s, p[i]);
+}
+
+int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			    void **p)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		p[i] = kmem_cache_alloc(s, flags);
+		if (unlikely(!p[i])) {
+			__kmem_cache_free_bulk(s, i, p);
+			return 0;
+		}
+	}
+	return size;
+}
+
 int slab_is_available(void)
 {
 	return slab_state >= UP;
@@ -607,6 +607,19 @@ void kmem_cache_free(struct kmem_cache *c, void *b)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+int kmem_cache_alloc_bulk(struct kmem_cache *c, gfp_t flags, size_t size,
+			  void **p)
+{
+	return __kmem_cache_alloc_bulk(c, flags, size, p);
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
+void kmem_cache_free_bulk(struct kmem_cache *c, size_t size, void **p)
+{
+	__kmem_cache_free_bulk(c, size, p);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 unsigned int kmem_cache_size(struct kmem_cache *c)
 {
 	return c->size;
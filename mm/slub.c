@@ -1979,6 +1979,167 @@ int put_cpu_partial(struct kmem_cache *s, struct page *page, int drain)
 	return pobjects;
 }
 
+/*
+ * Per cpu object arrays.
+ *
+ * Objects freed to a slab other than the cpu slab normally go through
+ * __slab_free(), which may have to take the node list_lock. That is the
+ * common case for objects freed on a different cpu than they were allocated
+ * on. If the cache has a cpu_array size set, such objects are stashed in
+ * an array on the freeing cpu instead, and handed out again by the next
+ * allocations there, whatever slab they belong to.
+ *
+ * The arrays are only used with interrupts disabled on the cpu that owns
+ * them. They are replaced from an IPI on that cpu, see resize_cpu_arrays().
+ */
+#define CPU_ARRAY_MAX	512
+
+static void __slab_free(struct kmem_cache *s, struct page *page,
+			void *x, unsigned long addr);
+
+static void cpu_array_drain(struct kmem_cache *s, struct kmem_cache_array *a)
+{
+	while (a->count) {
+		void *object = a->objects[--a->count];
+
+		__slab_free(s, virt_to_head_page(object), object, _RET_IP_);
+	}
+}
+
+static inline void *cpu_array_pop(struct kmem_cache *s,
+				  struct kmem_cache_cpu *c)
+{
+	struct kmem_cache_array *a = c->array;
+
+	if (!a || !a->count)
+		return NULL;
+
+	stat(s, ALLOC_ARRAY);
+	return a->objects[--a->count];
+}
+
+static bool cpu_array_push(struct kmem_cache *s, struct kmem_cache_cpu *c,
+			   struct page *page, void *object)
+{
+	struct kmem_cache_array *a = c->array;
+
+	/* Keep pfmemalloc reserves away from ordinary allocations */
+	if (!a || PageSlabPfmemalloc(page))
+		return false;
+
+	if (unlikely(a->count == a->size)) {
+		/* Make room by returning the older half to their slabs */
+		unsigned int i, nr = (a->size + 1) / 2;
+
+		for (i = 0; i < nr; i++)
+			__slab_free(s, virt_to_head_page(a->objects[i]),
+				    a->objects[i], _RET_IP_);
+		a->count -= nr;
+		memmove(a->objects, a->objects + nr,
+			a->count * sizeof(void *));
+		stat(s, CPU_ARRAY_FLUSH);
+	}
+
+	a->objects[a->count++] = object;
+	stat(s, FREE_ARRAY);
+	return true;
+}
+
+static void *cpu_array_alloc(struct kmem_cache *s)
+{
+	unsigned long flags;
+	void *object;
+
+	local_irq_save(flags);
+	object = cpu_array_pop(s, this_cpu_ptr(s->cpu_slab));
+	local_irq_restore(flags);
+	return object;
+}
+
+static bool cpu_array_free(struct kmem_cache *s, struct page *page, void *x)
+{
+	unsigned long flags;
+	bool ret;
+
+	local_irq_save(flags);
+	ret = cpu_array_push(s, this_cpu_ptr(s->cpu_slab), page, x);
+	local_irq_restore(flags);
+	return ret;
+}
+
+struct cpu_array_swap {
+	struct kmem_cache *s;
+	struct kmem_cache_array **arrays;
+};
+
+static void swap_cpu_array(void *info)
+{
+	struct cpu_array_swap *sw = info;
+	struct kmem_cache_cpu *c = this_cpu_ptr(sw->s->cpu_slab);
+
+	swap(c->array, sw->arrays[smp_processor_id()]);
+}
+
+/*
+ * Install new per cpu arrays of @objects entries, or remove them if
+ * @objects is 0. The objects in the old arrays are returned to their slabs.
+ */
+static int resize_cpu_arrays(struct kmem_cache *s, unsigned int objects)
+{
+	struct kmem_cache_array **arrays;
+	struct cpu_array_swap sw;
+	int cpu;
+
+	arrays = kcalloc(nr_cpu_ids, sizeof(*arrays), GFP_KERNEL);
+	if (!arrays)
+		return -ENOMEM;
+	sw.s = s;
+	sw.arrays = arrays;
+
+	if (objects) {
+		for_each_possible_cpu(cpu) {
+			arrays[cpu] = kmalloc_node(sizeof(**arrays) +
+					objects * sizeof(void *),
+					GFP_KERNEL, cpu_to_node(cpu));
+			if (!arrays[cpu])
+				goto nomem;
+			arrays[cpu]->size = objects;
+			arrays[cpu]->count = 0;
+		}
+	}
+
+	get_online_cpus();
+	mutex_lock(&slab_mutex);
+	if (!objects)
+		s->cpu_array = 0;
+	for_each_possible_cpu(cpu) {
+		if (cpu_online(cpu))
+			smp_call_function_single(cpu, swap_cpu_array, &sw, 1);
+		else
+			swap(per_cpu_ptr(s->cpu_slab, cpu)->array,
+			     arrays[cpu]);
+	}
+	s->cpu_array = objects;
+	mutex_unlock(&slab_mutex);
+	put_online_cpus();
+
+	/* The old arrays are not reachable anymore */
+	for_each_possible_cpu(cpu) {
+		if (arrays[cpu]) {
+			cpu_array_drain(s, arrays[cpu]);
+			kfree(arrays[cpu]);
+		}
+	}
+	kfree(arrays);
+	return 0;
+
+nomem:
+	for_each_possible_cpu(cpu)
+		kfree(arrays[cpu]);
+	kfree(arrays);
+	return -ENOMEM;
+}
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	stat(s, CPUSLAB_FLUSH);
@@ -1999,6 +2160,9 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
 	if (likely(c)) {
+		if (c->array)
+			cpu_array_drain(s, c->array);
+
 		if (c->page)
 			flush_slab(s, c);
 
@@ -2018,7 +2182,7 @@ static bool has_cpu_slab(int cpu, void *info)
 	struct kmem_cache *s = info;
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	return c->page || c->partial;
+	return c->page || c->partial || (c->array && c->array->count);
 }
 
 static void flush_all(struct kmem_cache *s)
@@ -2321,6 +2485,12 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 	if (slab_pre_alloc_hook(s, gfpflags))
 		return NULL;
 
+	if (s->cpu_array && node == NUMA_NO_NODE) {
+		object = cpu_array_alloc(s);
+		if (object)
+			goto out;
+	}
+
 redo:
 
 	/*
@@ -2372,6 +2542,7 @@ redo:
 		stat(s, ALLOC_FASTPATH);
 	}
 
+out:
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
 		memset(object, 0, s->object_size);
 
@@ -2601,7 +2772,7 @@ redo:
 			goto redo;
 		}
 		stat(s, FREE_FASTPATH);
-	} else
+	} else if (!s->cpu_array || !cpu_array_free(s, page, x))
 		__slab_free(s, page, x, addr);
 
 }
@@ -2618,6 +2789,110 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Bulk freeing. Interrupts are disabled once for all objects, which go
+ * directly onto the cpu freelist if they belong to the cpu slab and into
+ * the cpu object array otherwise, if there is one.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	size_t i;
+
+	if (kmem_cache_debug(s)) {
+		__kmem_cache_free_bulk(s, size, p);
+		return;
+	}
+
+	local_irq_disable();
+	c = this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void **object = p[i];
+		struct page *page = virt_to_head_page(object);
+
+		slab_free_hook(s, object);
+
+		if (page == c->page) {
+			set_freepointer(s, object, c->freelist);
+			c->freelist = object;
+			stat(s, FREE_FASTPATH);
+		} else if (!cpu_array_push(s, c, page, object))
+			__slab_free(s, page, object, _RET_IP_);
+	}
+
+	/* Fail lockless fastpath operations that were interrupted */
+	c->tid = next_tid(c->tid);
+	local_irq_enable();
+
+	for (i = 0; i < size; i++)
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/*
+ * Bulk allocation. The cpu object array is emptied first, then objects are
+ * taken off the cpu freelist, and only when that runs out __slab_alloc() is
+ * called. Either all @size objects are allocated or none.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	size_t i = 0, nr;
+	void *object;
+
+	if (kmem_cache_debug(s))
+		return __kmem_cache_alloc_bulk(s, flags, size, p);
+
+	if (slab_pre_alloc_hook(s, flags))
+		return 0;
+
+	local_irq_disable();
+	c = this_cpu_ptr(s->cpu_slab);
+
+	while (i < size && (object = cpu_array_pop(s, c)))
+		p[i++] = object;
+
+	for (; i < size; i++) {
+		object = c->freelist;
+		if (unlikely(!object)) {
+			/*
+			 * __slab_alloc() may enable interrupts to allocate
+			 * a new slab, so the tid must be advanced first.
+			 */
+			c->tid = next_tid(c->tid);
+			object = __slab_alloc(s, flags, NUMA_NO_NODE,
+					      _RET_IP_, c);
+			if (unlikely(!object))
+				break;
+			c = this_cpu_ptr(s->cpu_slab);
+		} else {
+			c->freelist = get_freepointer(s, object);
+			stat(s, ALLOC_FASTPATH);
+		}
+		p[i] = object;
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_enable();
+
+	nr = i;
+	for (i = 0; i < nr; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->object_size);
+		slab_post_alloc_hook(s, flags, p[i]);
+		trace_kmem_cache_alloc(_RET_IP_, p[i], s->object_size,
+				       s->size, flags);
+	}
+
+	if (unlikely(nr < size)) {
+		kmem_cache_free_bulk(s, nr, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /*
  * Object placement in a slab is made very easy because we always start at
  * offset 0. If we tune the size of the object to the alignment then we can
@@ -3180,8 +3455,11 @@ static void free_partial(struct kmem_cache *s, struct kmem_cache_node *n)
 static inline int kmem_cache_close(struct kmem_cache *s)
 {
 	int node;
+	int cpu;
 
 	flush_all(s);
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu_ptr(s->cpu_slab, cpu)->array);
 	free_percpu(s->cpu_slab);
 	/* Attempt to free all objects */
 	for_each_node_state(node, N_NORMAL_MEMORY) {
@@ -4698,6 +4976,30 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+static ssize_t cpu_array_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", s->cpu_array);
+}
+
+static ssize_t cpu_array_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects > CPU_ARRAY_MAX || (objects && kmem_cache_debug(s)))
+		return -EINVAL;
+
+	err = resize_cpu_arrays(s, objects);
+	if (err)
+		return err;
+	return length;
+}
+SLAB_ATTR(cpu_array);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5093,6 +5395,9 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(ALLOC_ARRAY, alloc_array);
+STAT_ATTR(FREE_ARRAY, free_array);
+STAT_ATTR(CPU_ARRAY_FLUSH, cpu_array_flush);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -5102,6 +5407,7 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+	&cpu_array_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -5160,6 +5466,9 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&alloc_array_attr.attr,
+	&free_array_attr.attr,
+	&cpu_array_flush_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
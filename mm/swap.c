@@ -33,12 +33,15 @@
 
 #include "internal.h"
 
+#include <trace/events/vmscan.h>
+
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
 static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, activate_page_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -288,14 +291,30 @@ int get_kernel_page(unsigned long start, int write, struct page **pages)
 }
 EXPORT_SYMBOL_GPL(get_kernel_page);
 
+/*
+ * Drop the lru_lock taken for a batch of @nr pages at @start, and account
+ * the batch.
+ */
+static void lru_batch_unlock(struct zone *zone, unsigned long flags,
+			     u64 start, int nr)
+{
+	u64 held = local_clock() - start;
+
+	spin_unlock_irqrestore(&zone->lru_lock, flags);
+	count_vm_event(LRU_BATCH_LOCKS);
+	count_vm_events(LRU_BATCH_PAGES, nr);
+	trace_mm_lru_lock_hold(zone, LRU_LOCK_PAGEVEC, nr, held);
+}
+
 static void pagevec_lru_move_fn(struct pagevec *pvec,
 	void (*move_fn)(struct page *page, struct lruvec *lruvec, void *arg),
 	void *arg)
 {
-	int i;
+	int i, nr = 0;
 	struct zone *zone = NULL;
 	struct lruvec *lruvec;
 	unsigned long flags = 0;
+	u64 start = 0;
 
 	for (i = 0; i < pagevec_count(pvec); i++) {
 		struct page *page = pvec->pages[i];
@@ -303,16 +322,19 @@ static void pagevec_lru_move_fn(struct pagevec *pvec,
 
 		if (pagezone != zone) {
 			if (zone)
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
+				lru_batch_unlock(zone, flags, start, nr);
 			zone = pagezone;
+			nr = 0;
 			spin_lock_irqsave(&zone->lru_lock, flags);
+			start = local_clock();
 		}
 
 		lruvec = mem_cgroup_page_lruvec(page, zone);
 		(*move_fn)(page, lruvec, arg);
+		nr++;
 	}
 	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		lru_batch_unlock(zone, flags, start, nr);
 	release_pages(pvec->pages, pvec->nr, pvec->cold);
 	pagevec_reinit(pvec);
 }
@@ -389,9 +411,6 @@ static void __activate_page(struct page *page, struct lruvec *lruvec,
 	}
 }
 
-#ifdef CONFIG_SMP
-static DEFINE_PER_CPU(struct pagevec, activate_page_pvecs);
-
 static void activate_page_drain(int cpu)
 {
 	struct pagevec *pvec = &per_cpu(activate_page_pvecs, cpu);
@@ -412,21 +431,6 @@ void activate_page(struct page *page)
 	}
 }
 
-#else
-static inline void activate_page_drain(int cpu)
-{
-}
-
-void activate_page(struct page *page)
-{
-	struct zone *zone = page_zone(page);
-
-	spin_lock_irq(&zone->lru_lock);
-	__activate_page(page, mem_cgroup_page_lruvec(page, zone), NULL);
-	spin_unlock_irq(&zone->lru_lock);
-}
-#endif
-
 /*
  * Mark a page as having seen activity.
  *
@@ -637,12 +641,57 @@ static void lru_add_drain_per_cpu(struct work_struct *dummy)
 	lru_add_drain();
 }
 
+static DEFINE_PER_CPU(struct work_struct, lru_add_drain_work);
+
+/* Does @cpu have any LRU moves queued in its pagevecs? */
+static bool lru_add_pending(int cpu)
+{
+	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
+	int lru;
+
+	for_each_lru(lru) {
+		if (pagevec_count(&pvecs[lru - LRU_BASE]))
+			return true;
+	}
+
+	return pagevec_count(&per_cpu(lru_rotate_pvecs, cpu)) ||
+		pagevec_count(&per_cpu(lru_deactivate_pvecs, cpu)) ||
+		pagevec_count(&per_cpu(activate_page_pvecs, cpu));
+}
+
 /*
+ * Drain the LRU pagevecs of all cpus.  Pages stay queued on a cpu until it
+ * drains its own pagevecs, so only the cpus that have some queued get
+ * drain work scheduled; the others are not woken up.
+ *
  * Returns 0 for success
  */
 int lru_add_drain_all(void)
 {
-	return schedule_on_each_cpu(lru_add_drain_per_cpu);
+	static DEFINE_MUTEX(lock);
+	static struct cpumask has_work;
+	int cpu;
+
+	mutex_lock(&lock);
+	get_online_cpus();
+	cpumask_clear(&has_work);
+
+	for_each_online_cpu(cpu) {
+		struct work_struct *work = &per_cpu(lru_add_drain_work, cpu);
+
+		if (lru_add_pending(cpu)) {
+			INIT_WORK(work, lru_add_drain_per_cpu);
+			schedule_work_on(cpu, work);
+			cpumask_set_cpu(cpu, &has_work);
+		}
+	}
+
+	for_each_cpu(cpu, &has_work)
+		flush_work(&per_cpu(lru_add_drain_work, cpu));
+
+	put_online_cpus();
+	mutex_unlock(&lock);
+	return 0;
 }
 
 /*
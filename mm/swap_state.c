@@ -253,37 +253,83 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
+/*
+ * Per-VMA swap readahead state, kept in vma->swap_readahead_info: the
+ * page-aligned address of the last swap fault or readahead hit in the VMA,
+ * the size of the last readahead window, and the readahead hits since.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 (hits))
+
+/* Largest VMA-based readahead window, in pages */
+#define SWAP_RA_MAX_WIN		32
+
+static void swap_ra_hit(struct vm_area_struct *vma, unsigned long addr)
+{
+	unsigned long ra_val = atomic_long_read(&vma->swap_readahead_info);
+	unsigned long hits = min(SWAP_RA_HITS(ra_val) + 1, SWAP_RA_HITS_MAX);
+
+	atomic_long_set(&vma->swap_readahead_info,
+			SWAP_RA_VAL(addr, SWAP_RA_WIN(ra_val), hits));
+}
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * If the page was brought in by readahead, this counts as a readahead
+ * hit, for @vma too if it is given.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
+			       unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		/* PG_readahead is PG_reclaim while under writeback */
+		if (!PageWriteback(page) && TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma)
+				swap_ra_hit(vma, addr);
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-/* 
+/*
  * Locate a page of swap in physical memory, reserving swap cache space
- * and reading the disk if it is not already cached.
- * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
+ * for it if it is not already cached.  A newly added page is returned
+ * locked and not uptodate, with *new_page_allocated set; the caller must
+ * fill it.  A failure return means that either the page allocation failed
+ * or that the swap entry is no longer in use.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			bool *new_page_allocated)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*new_page_allocated = false;
+
 	do {
 		/*
 		 * First check the swap cache.  Since this is normally
@@ -329,11 +375,8 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		err = __add_to_swap_cache(new_page, entry);
 		if (likely(!err)) {
 			radix_tree_preload_end();
-			/*
-			 * Initiate read into locked page and return.
-			 */
 			lru_cache_add_anon(new_page);
-			swap_readpage(new_page);
+			*new_page_allocated = true;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -351,6 +394,48 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/* 
+ * Locate a page of swap in physical memory, reserving swap cache space
+ * and reading the disk if it is not already cached.
+ * A failure return means that either the page allocation failed or that
+ * the swap entry is no longer in use.
+ */
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool page_was_allocated;
+	struct page *page = __read_swap_cache_async(entry, gfp_mask,
+					vma, addr, &page_was_allocated);
+
+	/*
+	 * Initiate read into locked page and return.
+	 */
+	if (page_was_allocated)
+		swap_readpage(page);
+
+	return page;
+}
+
+/*
+ * Start reading a page that nobody asked for yet, marking it so that a
+ * later lookup_swap_cache() can tell that readahead was worth it.
+ */
+static struct page *swap_readahead_one(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool page_was_allocated;
+	struct page *page = __read_swap_cache_async(entry, gfp_mask,
+					vma, addr, &page_was_allocated);
+
+	if (page_was_allocated) {
+		SetPageReadahead(page);
+		swap_readpage(page);
+		count_vm_event(SWAP_RA);
+	}
+
+	return page;
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -374,7 +459,8 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
 	struct page *page;
-	unsigned long offset = swp_offset(entry);
+	unsigned long entry_offset = swp_offset(entry);
+	unsigned long offset = entry_offset;
 	unsigned long start_offset, end_offset;
 	unsigned long mask = (1UL << page_cluster) - 1;
 	struct blk_plug plug;
@@ -387,9 +473,129 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 
 	blk_start_plug(&plug);
 	for (offset = start_offset; offset <= end_offset ; offset++) {
+		if (offset == entry_offset)
+			continue;
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
+		page = swap_readahead_one(swp_entry(swp_type(entry), offset),
+					  gfp_mask, vma, addr);
+		if (!page)
+			continue;
+		page_cache_release(page);
+	}
+	blk_finish_plug(&plug);
+
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+	return read_swap_cache_async(entry, gfp_mask, vma, addr);
+}
+
+/*
+ * Size the next VMA readahead window from the hits the last one got.  With
+ * no hits, only read ahead if the fault is next to the previous one.  The
+ * window never shrinks by more than half at a time, so that a few misses
+ * in a sequential run don't stop readahead.
+ */
+static unsigned int swapin_nr_pages(unsigned long prev_pfn, unsigned long pfn,
+				    unsigned int hits, unsigned int max_pages,
+				    unsigned int prev_win)
+{
+	unsigned int pages, last_ra;
+
+	pages = hits + 2;
+	if (pages == 2) {
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			pages = 1;
+	} else {
+		pages = roundup_pow_of_two(pages);
+	}
+
+	if (pages > max_pages)
+		pages = max_pages;
+
+	last_ra = prev_win / 2;
+	if (pages < last_ra)
+		pages = last_ra;
+
+	return pages;
+}
+
+/**
+ * swapin_vma_readahead - swap in pages around a fault in hope we need them soon
+ * @entry: swap entry of the faulting pte
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the fault is in
+ * @addr: faulting address
+ * @pmd: pmd mapping the page table of the faulting pte
+ *
+ * Returns the struct page for entry and addr, after queueing swapin.
+ *
+ * swapin_readahead() reads neighbours in the swap area, which are only
+ * useful if pages were swapped out in the order they are used.  This
+ * reads the swap entries of the neighbouring ptes instead.  The window
+ * grows while the pages it read get used and shrinks when they don't, up
+ * to (1 << page_cluster) pages, and is placed ahead of or behind the fault
+ * when faults in the VMA are moving in that direction.  It does not cross
+ * the VMA or the page table of the fault.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swapin_vma_readahead(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			pmd_t *pmd)
+{
+	unsigned long ra_val, pfn, prev_pfn, start, end, lo, hi;
+	unsigned int max_win, win, prev_win, hits, i;
+	pte_t ptes[SWAP_RA_MAX_WIN], *pte;
+	struct blk_plug plug;
+	struct page *page;
+
+	if (page_cluster < ilog2(SWAP_RA_MAX_WIN))
+		max_win = 1 << page_cluster;
+	else
+		max_win = SWAP_RA_MAX_WIN;
+
+	addr &= PAGE_MASK;
+	pfn = addr >> PAGE_SHIFT;
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	prev_pfn = SWAP_RA_ADDR(ra_val) >> PAGE_SHIFT;
+	prev_win = SWAP_RA_WIN(ra_val);
+	hits = SWAP_RA_HITS(ra_val);
+	win = swapin_nr_pages(prev_pfn, pfn, hits, max_win, prev_win);
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(addr, win, 0));
+
+	if (win == 1)
+		goto out;
+
+	if (pfn == prev_pfn + 1) {
+		start = pfn;
+	} else if (pfn == prev_pfn - 1) {
+		start = pfn > win - 1 ? pfn - (win - 1) : 0;
+	} else {
+		start = pfn > (win - 1) / 2 ? pfn - (win - 1) / 2 : 0;
+	}
+	end = start + win;
+
+	lo = max(vma->vm_start, addr & PMD_MASK) >> PAGE_SHIFT;
+	hi = pmd_addr_end(addr, vma->vm_end) >> PAGE_SHIFT;
+	start = max(start, lo);
+	end = min(end, hi);
+
+	/* Copy the ptes, the reads below may sleep */
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < end - start; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	blk_start_plug(&plug);
+	for (i = 0; i < end - start; i++) {
+		swp_entry_t ra_entry;
+
+		if (start + i == pfn || !is_swap_pte(ptes[i]))
+			continue;
+		ra_entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(ra_entry)))
+			continue;
+		page = swap_readahead_one(ra_entry, gfp_mask, vma,
+					  (start + i) << PAGE_SHIFT);
 		if (!page)
 			continue;
 		page_cache_release(page);
@@ -397,5 +603,6 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	blk_finish_plug(&plug);
 
 	lru_add_drain();	/* Push any new pages onto the LRU now */
+out:
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
@@ -27,6 +27,8 @@
 #include <linux/pfn.h>
 #include <linux/kmemleak.h>
 #include <linux/atomic.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
 #include <asm/uaccess.h>
 #include <asm/tlbflush.h>
 #include <asm/shmparam.h>
@@ -551,8 +553,35 @@ static unsigned long lazy_max_pages(void)
 	return log * (32UL * 1024 * 1024 / PAGE_SIZE);
 }
 
+/*
+ * Past lazy_max_pages, lazily freed areas are purged by purge_vmap_work.
+ * If that falls this far behind, the task freeing an area purges them
+ * itself.
+ */
+static unsigned long lazy_sync_pages(void)
+{
+	return 2 * lazy_max_pages();
+}
+
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/*
+ * Up to this many runs of purged address space are flushed separately,
+ * when that is less than flushing everything between the lowest and the
+ * highest purged address.
+ */
+#define VMAP_PURGE_MAX_RANGES	8
+
+/* Shown in /proc/vmallocstat, protected by purge_lock */
+static struct vmap_purge_stat {
+	unsigned long purges;		/* purges that freed areas */
+	unsigned long pages;		/* pages of address space freed */
+	unsigned long flushes;		/* flush_tlb_kernel_range() calls */
+	unsigned long worker_runs;	/* purges started by the worker */
+	u64 time_ns;			/* total time spent purging */
+	u64 max_ns;			/* longest purge */
+} vmap_purge_stat;
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -562,7 +591,50 @@ static void purge_fragmented_blocks_allcpus(void);
  */
 void set_iounmap_nonlazy(void)
 {
-	atomic_set(&vmap_lazy_nr, lazy_max_pages()+1);
+	atomic_set(&vmap_lazy_nr, lazy_sync_pages()+1);
+}
+
+/*
+ * Flush the kernel TLB for the purged areas on @valist, which are sorted
+ * by address and span @start to @end.  Adjacent areas are merged, and if
+ * that leaves a few runs covering less than half the span, only those are
+ * flushed: architectures that flush a kernel range page by page would
+ * otherwise walk all the address space in between.  Returns the number of
+ * flushes done.
+ */
+static int flush_purged_vmap_areas(struct list_head *valist,
+				   unsigned long start, unsigned long end)
+{
+	struct {
+		unsigned long start, end;
+	} runs[VMAP_PURGE_MAX_RANGES];
+	unsigned long covered = 0;
+	struct vmap_area *va;
+	int nr = 0, i;
+
+	list_for_each_entry(va, valist, purge_list) {
+		if (nr && runs[nr - 1].end == va->va_start) {
+			runs[nr - 1].end = va->va_end;
+		} else {
+			if (nr == VMAP_PURGE_MAX_RANGES)
+				goto flush_all;
+			runs[nr].start = va->va_start;
+			runs[nr].end = va->va_end;
+			nr++;
+		}
+		covered += va->va_end - va->va_start;
+	}
+
+	if (!nr || covered > (end - start) / 2)
+		goto flush_all;
+
+	for (i = 0; i < nr; i++)
+		flush_tlb_kernel_range(runs[i].start, runs[i].end);
+	return nr;
+
+flush_all:
+	flush_tlb_kernel_range(start, end);
+	return 1;
 }
 
 /*
@@ -572,17 +644,20 @@ void set_iounmap_nonlazy(void)
  * If force_flush is 1, then flush kernel TLBs between *start and *end even
  * if we found no lazy vmap areas to unmap (callers can use this to optimise
  * their own TLB flushing).
+ * worker is 1 when called from purge_vmap_work, for the statistics.
  * Returns with *start = min(*start, lowest purged address)
  *              *end = max(*end, highest purged address)
  */
 static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
-					int sync, int force_flush)
+					int sync, int force_flush, int worker)
 {
 	static DEFINE_SPINLOCK(purge_lock);
 	LIST_HEAD(valist);
 	struct vmap_area *va;
 	struct vmap_area *n_va;
 	int nr = 0;
+	ktime_t begin;
+	u64 delta;
 
 	/*
 	 * If sync is 0 but force_flush is 1, we'll go sync anyway but callers
@@ -595,6 +670,9 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	} else
 		spin_lock(&purge_lock);
 
+	begin = ktime_get();
+	if (worker)
+		vmap_purge_stat.worker_runs++;
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
@@ -616,14 +694,26 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
 
-	if (nr || force_flush)
+	if (force_flush) {
 		flush_tlb_kernel_range(*start, *end);
+		vmap_purge_stat.flushes++;
+	} else if (nr) {
+		vmap_purge_stat.flushes +=
+			flush_purged_vmap_areas(&valist, *start, *end);
+	}
 
 	if (nr) {
 		spin_lock(&vmap_area_lock);
 		list_for_each_entry_safe(va, n_va, &valist, purge_list)
 			__free_vmap_area(va);
 		spin_unlock(&vmap_area_lock);
+
+		delta = ktime_to_ns(ktime_sub(ktime_get(), begin));
+		vmap_purge_stat.purges++;
+		vmap_purge_stat.pages += nr;
+		vmap_purge_stat.time_ns += delta;
+		if (delta > vmap_purge_stat.max_ns)
+			vmap_purge_stat.max_ns = delta;
 	}
 	spin_unlock(&purge_lock);
 }
@@ -632,11 +722,11 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
  * Kick off a purge of the outstanding lazy areas. Don't bother if somebody
  * is already purging.
  */
-static void try_purge_vmap_area_lazy(void)
+static void try_purge_vmap_area_lazy(int worker)
 {
 	unsigned long start = ULONG_MAX, end = 0;
 
-	__purge_vmap_area_lazy(&start, &end, 0, 0);
+	__purge_vmap_area_lazy(&start, &end, 0, 0, worker);
 }
 
 /*
@@ -646,9 +736,16 @@ static void purge_vmap_area_lazy(void)
 {
 	unsigned long start = ULONG_MAX, end = 0;
 
-	__purge_vmap_area_lazy(&start, &end, 1, 0);
+	__purge_vmap_area_lazy(&start, &end, 1, 0, 0);
+}
+
+static void purge_vmap_work_fn(struct work_struct *work)
+{
+	try_purge_vmap_area_lazy(1);
 }
 
+static DECLARE_WORK(purge_vmap_work, purge_vmap_work_fn);
+
 /*
  * Free a vmap area, caller ensuring that the area has been unmapped
  * and flush_cache_vunmap had been called for the correct range
@@ -656,10 +753,19 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
+	unsigned long nr_lazy;
+
 	va->flags |= VM_LAZY_FREE;
-	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
-	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
-		try_purge_vmap_area_lazy();
+	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
+				    &vmap_lazy_nr);
+	if (likely(nr_lazy <= lazy_max_pages()))
+		return;
+
+	/* Leave the purge and its TLB flush to the worker if we can */
+	if (nr_lazy <= lazy_sync_pages() && keventd_up())
+		schedule_work(&purge_vmap_work);
+	else
+		try_purge_vmap_area_lazy(0);
 }
 
 /*
@@ -1058,7 +1164,7 @@ void vm_unmap_aliases(void)
 		rcu_read_unlock();
 	}
 
-	__purge_vmap_area_lazy(&start, &end, 1, flush);
+	__purge_vmap_area_lazy(&start, &end, 1, flush, 0);
 }
 EXPORT_SYMBOL_GPL(vm_unmap_aliases);
 
@@ -2637,9 +2743,39 @@ static const struct file_operations proc_vmalloc_operations = {
 	.release	= seq_release_private,
 };
 
+static int vmallocstat_show(struct seq_file *m, void *v)
+{
+	struct vmap_purge_stat *stat = &vmap_purge_stat;
+
+	seq_printf(m, "lazy_pages %d\n", atomic_read(&vmap_lazy_nr));
+	seq_printf(m, "lazy_max_pages %lu\n", lazy_max_pages());
+	seq_printf(m, "purges %lu\n", stat->purges);
+	seq_printf(m, "purged_pages %lu\n", stat->pages);
+	seq_printf(m, "purge_worker_runs %lu\n", stat->worker_runs);
+	seq_printf(m, "tlb_flushes %lu\n", stat->flushes);
+	seq_printf(m, "purge_time_us %llu\n",
+		   (unsigned long long)div_u64(stat->time_ns, NSEC_PER_USEC));
+	seq_printf(m, "purge_max_us %llu\n",
+		   (unsigned long long)div_u64(stat->max_ns, NSEC_PER_USEC));
+	return 0;
+}
+
+static int vmallocstat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, vmallocstat_show, NULL);
+}
+
+static const struct file_operations proc_vmallocstat_operations = {
+	.open		= vmallocstat_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int __init proc_vmalloc_init(void)
 {
 	proc_create("vmallocinfo", S_IRUSR, NULL, &proc_vmalloc_operations);
+	proc_create("vmallocstat", S_IRUSR, NULL, &proc_vmallocstat_operations);
 	return 0;
 }
 module_init(proc_vmalloc_init);
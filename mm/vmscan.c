@@ -1242,6 +1242,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 	int file = is_file_lru(lru);
 	struct zone *zone = lruvec_zone(lruvec);
 	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
+	u64 lock_start;
 
 	while (unlikely(too_many_isolated(zone, file, sc))) {
 		congestion_wait(BLK_RW_ASYNC, HZ/10);
@@ -1259,6 +1260,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 		isolate_mode |= ISOLATE_CLEAN;
 
 	spin_lock_irq(&zone->lru_lock);
+	lock_start = local_clock();
 
 	nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &page_list,
 				     &nr_scanned, sc, isolate_mode, lru);
@@ -1274,6 +1276,8 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 			__count_zone_vm_events(PGSCAN_DIRECT, zone, nr_scanned);
 	}
 	spin_unlock_irq(&zone->lru_lock);
+	trace_mm_lru_lock_hold(zone, LRU_LOCK_ISOLATE, nr_taken,
+			       local_clock() - lock_start);
 
 	if (nr_taken == 0)
 		return 0;
@@ -1282,6 +1286,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 						&nr_dirty, &nr_writeback);
 
 	spin_lock_irq(&zone->lru_lock);
+	lock_start = local_clock();
 
 	reclaim_stat->recent_scanned[file] += nr_taken;
 
@@ -1299,6 +1304,8 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON + file, -nr_taken);
 
 	spin_unlock_irq(&zone->lru_lock);
+	trace_mm_lru_lock_hold(zone, LRU_LOCK_PUTBACK, nr_taken,
+			       local_clock() - lock_start);
 
 	free_hot_cold_page_list(&page_list, 1);
 
@@ -1412,6 +1419,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	isolate_mode_t isolate_mode = 0;
 	int file = is_file_lru(lru);
 	struct zone *zone = lruvec_zone(lruvec);
+	u64 lock_start;
 
 	lru_add_drain();
 
@@ -1421,6 +1429,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 		isolate_mode |= ISOLATE_CLEAN;
 
 	spin_lock_irq(&zone->lru_lock);
+	lock_start = local_clock();
 
 	nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &l_hold,
 				     &nr_scanned, sc, isolate_mode, lru);
@@ -1433,6 +1442,8 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	__mod_zone_page_state(zone, NR_LRU_BASE + lru, -nr_taken);
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON + file, nr_taken);
 	spin_unlock_irq(&zone->lru_lock);
+	trace_mm_lru_lock_hold(zone, LRU_LOCK_ISOLATE, nr_taken,
+			       local_clock() - lock_start);
 
 	while (!list_empty(&l_hold)) {
 		cond_resched();
@@ -1478,6 +1489,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	 * Move pages back to the lru list.
 	 */
 	spin_lock_irq(&zone->lru_lock);
+	lock_start = local_clock();
 	/*
 	 * Count referenced pages from currently used mappings as rotated,
 	 * even though only some of them are actually re-activated.  This
@@ -1490,6 +1502,8 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	move_active_pages_to_lru(lruvec, &l_inactive, &l_hold, lru - LRU_ACTIVE);
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON + file, -nr_taken);
 	spin_unlock_irq(&zone->lru_lock);
+	trace_mm_lru_lock_hold(zone, LRU_LOCK_PUTBACK, nr_taken,
+			       local_clock() - lock_start);
 
 	free_hot_cold_page_list(&l_hold, 1);
 }
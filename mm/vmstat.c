@@ -760,6 +760,13 @@ const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"lru_batch_locks",
+	"lru_batch_pages",
+
+#ifdef CONFIG_SWAP
+	"swap_ra",
+	"swap_ra_hit",
+#endif
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -768,6 +775,9 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_direct_pages_moved",
+	"compact_daemon_wake",
+	"compact_daemon_pages_moved",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
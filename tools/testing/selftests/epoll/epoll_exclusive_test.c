@@ -0,0 +1,164 @@
+/*
+ * Count how many epoll instances watching the same pipe are woken by a
+ * single write, with and without EPOLLEXCLUSIVE.
+ *
+ * Every waiter thread has an epoll instance of its own, as an acceptor
+ * thread per core would.  Without EPOLLEXCLUSIVE all of them wake up;
+ * with it exactly one should.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1 << 28)
+#endif
+
+#define NR_WAITERS	16
+#define WAIT_MS		2000
+
+static int pipefd[2];
+static int waiting;
+static int woken;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *waiter(void *arg)
+{
+	int epfd = (long)arg;
+	struct epoll_event ev;
+
+	pthread_mutex_lock(&lock);
+	waiting++;
+	pthread_mutex_unlock(&lock);
+
+	if (epoll_wait(epfd, &ev, 1, WAIT_MS) == 1) {
+		pthread_mutex_lock(&lock);
+		woken++;
+		pthread_mutex_unlock(&lock);
+	}
+	return NULL;
+}
+
+static int count_wakeups(unsigned int flags)
+{
+	pthread_t threads[NR_WAITERS];
+	int epfds[NR_WAITERS];
+	struct epoll_event ev;
+	int i;
+
+	if (pipe(pipefd)) {
+		perror("pipe");
+		exit(1);
+	}
+
+	waiting = woken = 0;
+	for (i = 0; i < NR_WAITERS; i++) {
+		epfds[i] = epoll_create1(0);
+		if (epfds[i] < 0) {
+			perror("epoll_create1");
+			exit(1);
+		}
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | flags;
+		if (epoll_ctl(epfds[i], EPOLL_CTL_ADD, pipefd[0], &ev)) {
+			perror("epoll_ctl");
+			exit(1);
+		}
+		pthread_create(&threads[i], NULL, waiter, (void *)(long)epfds[i]);
+	}
+
+	/* Give every thread time to block in epoll_wait() */
+	while (1) {
+		pthread_mutex_lock(&lock);
+		i = waiting;
+		pthread_mutex_unlock(&lock);
+		if (i == NR_WAITERS)
+			break;
+		usleep(1000);
+	}
+	usleep(100 * 1000);
+
+	if (write(pipefd[1], "x", 1) != 1) {
+		perror("write");
+		exit(1);
+	}
+
+	for (i = 0; i < NR_WAITERS; i++) {
+		pthread_join(threads[i], NULL);
+		close(epfds[i]);
+	}
+	close(pipefd[0]);
+	close(pipefd[1]);
+
+	return woken;
+}
+
+static int check_ctl_errors(void)
+{
+	struct epoll_event ev;
+	int epfd, ret = 0;
+
+	if (pipe(pipefd)) {
+		perror("pipe");
+		exit(1);
+	}
+	epfd = epoll_create1(0);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, pipefd[0], &ev);
+
+	/* The wait queue entry is set up at ADD time, MOD can't change it */
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, pipefd[0], &ev) != -1 ||
+	    errno != EINVAL) {
+		printf("[FAIL]\tEPOLL_CTL_MOD accepted EPOLLEXCLUSIVE\n");
+		ret = 1;
+	}
+
+	/* Nor does it combine with EPOLLONESHOT */
+	ev.events = EPOLLIN | EPOLLONESHOT | EPOLLEXCLUSIVE;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, pipefd[1], &ev) != -1 ||
+	    errno != EINVAL) {
+		printf("[FAIL]\tEPOLLEXCLUSIVE accepted with EPOLLONESHOT\n");
+		ret = 1;
+	}
+
+	close(epfd);
+	close(pipefd[0]);
+	close(pipefd[1]);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int shared, exclusive;
+	int ret = 0;
+
+	shared = count_wakeups(0);
+	exclusive = count_wakeups(EPOLLEXCLUSIVE);
+
+	printf("%d waiters, one write: %d woken, %d with EPOLLEXCLUSIVE\n",
+	       NR_WAITERS, shared, exclusive);
+
+	if (exclusive != 1) {
+		printf("[FAIL]\texpected exactly one exclusive wakeup\n");
+		ret = 1;
+	}
+	if (shared != NR_WAITERS) {
+		printf("[FAIL]\texpected every non-exclusive waiter to wake\n");
+		ret = 1;
+	}
+
+	ret |= check_ctl_errors();
+
+	if (!ret)
+		printf("[PASS]\n");
+	return ret;
+}